@@ -142,16 +142,19 @@ class GccCompiler(Compiler):
 class AccIrCompiler(Compiler):
     """ACC (IR-only) compiler."""
 
-    def __init__(self, path, output, regalloc=False):
+    def __init__(self, path, output, regalloc=False, opt=None):
         super().__init__(output)
         self._path = path
         self._regalloc = regalloc
+        self._opt = opt
 
     def compile(self, source, output):
         if self._regalloc:
             cmd = [self._path, "-i", "-", "-"]
         else:
             cmd = [self._path, "-i", "-", "-r", "-"]
+        if self._opt:
+            cmd[1:1] = ["-O", self._opt]
         ir = subprocess.run(cmd, input=source.encode(), check=True, capture_output=True)
 
         gcc_cmd = [GCC_COMPILER, "-x", "c", "-o", output, "-"]
@@ -186,15 +189,18 @@ class AccAsmCompiler(Compiler):
     Generates ARM assembly. Should be assembled with:
     arm-linux-gnueabi-gcc-8
     """
-    def __init__(self, path, output):
+    def __init__(self, path, output, opt=None):
         self._path = path
         self._output = output
+        self._opt = opt
     
     def __str__(self):
         return "ACC"
     
     def compile(self, source, output):
         cmd = [self._path, '-', '-']
+        if self._opt:
+            cmd[1:1] = ['-O', self._opt]
         acc_proc = subprocess.run(cmd, input=source.encode(), check=True, capture_output=True)
 
         cmd = [ARM_GCC_COMPILER, '-march=armv8-a', '-x', 'assembler', '-nostdlib', '-o', output, '-']
@@ -0,0 +1,104 @@
+/*
+ * Assembly/IR emitter benchmark
+ *
+ * Compiles a synthetic source input (many small functions) through to allocated
+ * IR, then times assembly_gen and Ir_to_str writing to a temporary file, and
+ * reports the output rate in MB/s.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "analysis.h"
+#include "error.h"
+#include "ir.h"
+#include "ir_gen.h"
+#include "liveness.h"
+#include "parser.h"
+#include "regalloc.h"
+#include "scanner.h"
+#include "symbol.h"
+
+#define FUNCTIONS 10000
+#define ITERATIONS 5
+
+void assembly_gen(FILE *fd, IrFunction *program);
+
+static const char *SNIPPET = "int f%d(int n)\n"
+                             "{\n"
+                             "    int i = 0, tot = 0;\n"
+                             "    char arr[32];\n"
+                             "    while(i < n)\n"
+                             "    {\n"
+                             "        arr[i %% 32] = i;\n"
+                             "        tot += arr[i++] * 2 >> 1;\n"
+                             "    }\n"
+                             "    if(tot != 0) return tot; else return -1;\n"
+                             "}\n";
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void measure(const char *name, FILE *fd, IrFunction *program,
+                    void (*emit)(FILE *, IrFunction *, int *), int *registers)
+{
+    double elapsed = 0;
+    long bytes = 0;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        rewind(fd);
+        double start = now();
+        emit(fd, program, registers);
+        fflush(fd);
+        elapsed += now() - start;
+        bytes += ftell(fd);
+    }
+
+    double size = bytes / (double)(1024 * 1024);
+    printf("%-14s %8.2f MB in %7.3fs (%8.2f MB/s)\n", name, size, elapsed, size / elapsed);
+}
+
+static void emit_assembly(FILE *fd, IrFunction *program, int *registers)
+{
+    assembly_gen(fd, program);
+}
+
+int main(void)
+{
+    int snippet_len = strlen(SNIPPET) + 8;
+    char *source = malloc(snippet_len * FUNCTIONS + 1), *ptr = source;
+    for (int i = 0; i < FUNCTIONS; i++)
+    {
+        ptr += sprintf(ptr, SNIPPET, i);
+    }
+
+    ErrorReporter *error_reporter = Error_init();
+    Scanner *scanner = Scanner_init_n(source, ptr - source, error_reporter);
+    Parser *parser = Parser_init(scanner, error_reporter);
+    SymbolTable *tab = symbol_table_create(NULL);
+
+    DeclAstNode *ast = Parser_translation_unit(parser);
+    analysis_ast_walk(error_reporter, ast, NULL, NULL, tab);
+    if (Error_has_errors(error_reporter))
+    {
+        printf("FAIL. Errors reported compiling the synthetic source\n");
+        return 1;
+    }
+
+    IrFunction *program = Ir_generate(ast, tab);
+    Liveness_analysis(program);
+    int registers[] = {4, 5, 6, 7, 8, 9, 10, 11, 12, -1};
+    regalloc(program, registers);
+
+    FILE *fd = tmpfile();
+    printf("Emitter throughput (%d functions):\n", FUNCTIONS);
+    measure("assembly_gen", fd, program, emit_assembly, NULL);
+    measure("Ir_to_str", fd, program, Ir_to_str, registers);
+    fclose(fd);
+    return 0;
+}
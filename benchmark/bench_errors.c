@@ -0,0 +1,68 @@
+/*
+ * Error reporting benchmark
+ *
+ * Reports 10k and 100k errors (in reverse source order, the worst case for keeping
+ * errors sorted as they are reported), then retrieves them all in order, and
+ * reports errors/s. Reporting should be linear in the number of errors: if the rate
+ * for 100k errors drops well below the rate for 10k, the benchmark fails.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "error.h"
+
+// Minimum ratio of errors/s (largest / smallest).
+#define MIN_SCALING 0.5
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double measure(int count)
+{
+    ErrorReporter *error_reporter = Error_init();
+
+    double start = now();
+    for (int i = count; i > 0; i--)
+    {
+        Position pos = {i, 4};
+        Error_report_error(error_reporter, ANALYSIS, pos, "Undeclared identifier");
+    }
+
+    ErrorType type;
+    int line_number, line_position, previous = 0;
+    char *msg;
+    for (_Bool beginning = true; Error_get_errors(error_reporter, &type, &line_number,
+                                                  &line_position, &msg, beginning);
+         beginning = false)
+    {
+        if (line_number <= previous)
+        {
+            printf("FAIL. Errors are not ordered by line number\n");
+            return 0;
+        }
+        previous = line_number;
+    }
+    double elapsed = now() - start;
+
+    printf("%7d errors in %7.3fs (%10.0f errors/s)\n", count, elapsed, count / elapsed);
+    Error_destroy(error_reporter);
+    return count / elapsed;
+}
+
+int main(void)
+{
+    printf("Error reporting:\n");
+    double small = measure(10000);
+    double large = measure(100000);
+
+    if (large < small * MIN_SCALING)
+    {
+        printf("FAIL. Error reporting does not scale linearly with the error count\n");
+        return 1;
+    }
+    return 0;
+}
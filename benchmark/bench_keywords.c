@@ -0,0 +1,134 @@
+/*
+ * Keyword recognition benchmark
+ *
+ * Compares identifiers/s for the perfect-hash keyword lookup (Token_keyword) against
+ * the linear strlen+strncmp search over all keywords which the scanner previously
+ * used. Also reports identifiers/s for the scanner, on an identifier-heavy input.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "error.h"
+#include "scanner.h"
+#include "token.h"
+
+#define COUNT(n) (sizeof(n) / sizeof(n[0]))
+#define ITERATIONS 2000000
+
+static const char *LEXEMES[] = {
+    "i",      "tot",    "arr",    "calc_sum", "int",      "while",  "return",
+    "n",      "unsigned", "char", "fib",      "total",    "index_1", "if",
+    "else",   "sizeof", "buffer", "short",    "signed",   "value",  "static_count",
+    "length", "void",   "x",      "register", "volatile", "ptr",    "main",
+};
+
+/* The linear keyword search previously used by the scanner (the baseline). */
+static TokenType linear_keyword(const char *lexeme, int length)
+{
+    char *keywords[] = {
+        "auto",   "char",   "const",    "else",   "extern",   "if",
+        "int",    "long",   "register", "return", "short",    "signed",
+        "sizeof", "static", "unsigned", "void",   "volatile", "while",
+    };
+
+    for (int i = 0; i < COUNT(keywords); i++)
+    {
+        if (strlen(keywords[i]) != length)
+            continue;
+        if (strncmp(lexeme, keywords[i], length))
+            continue;
+
+        return AUTO + i;
+    }
+    return IDENTIFIER;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double measure(const char *name, TokenType (*lookup)(const char *, int))
+{
+    int lengths[COUNT(LEXEMES)];
+    for (int i = 0; i < COUNT(LEXEMES); i++)
+    {
+        lengths[i] = strlen(LEXEMES[i]);
+    }
+
+    volatile int keywords = 0;
+    double start = now();
+    for (int n = 0; n < ITERATIONS; n++)
+    {
+        int i = n % COUNT(LEXEMES);
+        keywords += lookup(LEXEMES[i], lengths[i]) != IDENTIFIER;
+    }
+    double elapsed = now() - start;
+    double rate = ITERATIONS / elapsed;
+
+    printf("%-14s %12.0f identifiers/s\n", name, rate);
+    return rate;
+}
+
+static void measure_scanner()
+{
+    // Build a source input from the lexemes, separated by spaces.
+    int size = 0, repeats = 100000;
+    for (int i = 0; i < COUNT(LEXEMES); i++)
+    {
+        size += strlen(LEXEMES[i]) + 1;
+    }
+    char *source = malloc(size * repeats + 1), *ptr = source;
+    for (int r = 0; r < repeats; r++)
+    {
+        for (int i = 0; i < COUNT(LEXEMES); i++)
+        {
+            ptr += sprintf(ptr, "%s ", LEXEMES[i]);
+        }
+    }
+
+    ErrorReporter *error_reporter = Error_init();
+    Scanner *scanner = Scanner_init_n(source, ptr - source, error_reporter);
+
+    long identifiers = 0;
+    double start = now();
+    for (;; identifiers++)
+    {
+        Token *token = Scanner_get_next(scanner);
+        if (token->type == END_OF_FILE)
+            break;
+    }
+    double elapsed = now() - start;
+
+    printf("%-14s %12.0f identifiers/s\n", "scanner", identifiers / elapsed);
+
+    Scanner_destroy(scanner);
+    Error_destroy(error_reporter);
+    free(source);
+}
+
+int main(void)
+{
+    // Both implementations must agree.
+    for (int i = 0; i < COUNT(LEXEMES); i++)
+    {
+        int len = strlen(LEXEMES[i]);
+        if (linear_keyword(LEXEMES[i], len) != Token_keyword(LEXEMES[i], len))
+        {
+            printf("FAIL. Keyword lookup mismatch for '%s'\n", LEXEMES[i]);
+            return 1;
+        }
+    }
+
+    printf("Keyword recognition:\n");
+    double before = measure("linear search", linear_keyword);
+    double after = measure("perfect hash", Token_keyword);
+    printf("Speed-up: %.2fx\n", after / before);
+
+    measure_scanner();
+    return 0;
+}
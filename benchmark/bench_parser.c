@@ -0,0 +1,76 @@
+/*
+ * Parser throughput benchmark
+ *
+ * Parses a synthetic 10MB source input, and reports the throughput of the parser
+ * (including scanning) in MB/s, along with the time taken to free the whole AST.
+ * The AST is allocated from the parser's arena, so the teardown should be a small
+ * fraction of the parse time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "error.h"
+#include "parser.h"
+#include "scanner.h"
+
+#define MB (1024 * 1024)
+#define SIZE (10 * MB)
+
+static const char *SNIPPET = "int calc_sum(unsigned char * arr, int n)\n"
+                             "{\n"
+                             "    int i = 0, tot = 0;\n"
+                             "    while(i < n)\n"
+                             "    {\n"
+                             "        tot += arr[i++] * 2 >> 1;\n"
+                             "    }\n"
+                             "    if(tot != 0) return tot; else return -1;\n"
+                             "}\n";
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    int snippet_len = strlen(SNIPPET), length = 0;
+    char *source = malloc(SIZE + 1);
+    for (; length + snippet_len <= SIZE; length += snippet_len)
+    {
+        memcpy(source + length, SNIPPET, snippet_len);
+    }
+    source[length] = '\0';
+
+    ErrorReporter *error_reporter = Error_init();
+    Scanner *scanner = Scanner_init_n(source, length, error_reporter);
+    Parser *parser = Parser_init(scanner, error_reporter);
+
+    double start = now();
+    DeclAstNode *ast = Parser_translation_unit(parser);
+    double parse_elapsed = now() - start;
+
+    int functions = 0;
+    for (; ast; ast = ast->next)
+    {
+        functions++;
+    }
+
+    start = now();
+    Parser_destroy(parser);
+    double destroy_elapsed = now() - start;
+
+    printf("Parser throughput:\n");
+    double size = length / (double)MB;
+    printf("%5.1f MB: %8d functions in %7.3fs (%8.2f MB/s)\n", size, functions,
+           parse_elapsed, size / parse_elapsed);
+    printf("AST freed in %.3fs\n", destroy_elapsed);
+
+    Scanner_destroy(scanner);
+    Error_destroy(error_reporter);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Scanner throughput benchmark
+ *
+ * Scans synthetic source inputs of increasing size (1MB, 10MB, 100MB), and reports
+ * the throughput of the scanner in MB/s. Lexing should be linear in the size of the
+ * input: if throughput on the largest input drops well below throughput on the
+ * smallest, the benchmark fails. Peak memory usage (RSS) is also reported, since all
+ * tokens are held in the scanner's arena until it is destroyed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "error.h"
+#include "scanner.h"
+#include "token.h"
+
+#define MB (1024 * 1024)
+
+// Minimum ratio of throughput (largest input / smallest input).
+#define MIN_SCALING 0.5
+
+static const char *SNIPPET = "int calc_sum(unsigned char * arr, int n)\n"
+                             "{\n"
+                             "    int i = 0, tot = 0; // Running total\n"
+                             "    while(i < n)\n"
+                             "    {\n"
+                             "        tot += arr[i++] * 2 >> 1;\n"
+                             "    }\n"
+                             "    /* Return the total. */\n"
+                             "    return tot != 0 ? tot : -1;\n"
+                             "}\n";
+
+static char *synthetic_source(int size)
+{
+    char *source = malloc(size + 1);
+    int snippet_len = strlen(SNIPPET);
+
+    int offset = 0;
+    for (; offset + snippet_len <= size; offset += snippet_len)
+    {
+        memcpy(source + offset, SNIPPET, snippet_len);
+    }
+    memset(source + offset, ' ', size - offset);
+    source[size] = '\0';
+    return source;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double measure(int size)
+{
+    char *source = synthetic_source(size);
+    ErrorReporter *error_reporter = Error_init();
+    Scanner *scanner = Scanner_init_n(source, size, error_reporter);
+
+    long tokens = 0;
+    double start = now();
+    for (;; tokens++)
+    {
+        Token *token = Scanner_get_next(scanner);
+        if (token->type == END_OF_FILE)
+            break;
+    }
+    double elapsed = now() - start;
+    double throughput = (size / (double)MB) / elapsed;
+
+    printf("%4d MB: %10ld tokens in %7.3fs (%8.2f MB/s)\n", size / MB, tokens, elapsed,
+           throughput);
+
+    Scanner_destroy(scanner);
+    Error_destroy(error_reporter);
+    free(source);
+    return throughput;
+}
+
+int main(void)
+{
+    int sizes[] = {1 * MB, 10 * MB, 100 * MB};
+    double throughput[3];
+
+    printf("Scanner throughput:\n");
+    for (int i = 0; i < 3; i++)
+    {
+        throughput[i] = measure(sizes[i]);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Peak RSS: %ld MB\n", usage.ru_maxrss / 1024);
+
+    if (throughput[2] < throughput[0] * MIN_SCALING)
+    {
+        printf("FAIL. Scanner throughput does not scale linearly with input size\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Symbol table benchmark
+ *
+ * Defines 100k symbols across nested scopes (half in global scope, and the rest
+ * spread over a chain of nested scopes), then resolves every one of them from the
+ * innermost scope, and reports lookups/s. For comparison, the same lookups are
+ * timed (on a sample of the names) against the linked-list symbol table with a
+ * linear scan per scope, which analysis previously used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "intern.h"
+#include "symbol.h"
+
+#define SYMBOLS 100000
+#define SCOPES 100
+#define GLOBALS (SYMBOLS / 2)
+#define LOCALS_PER_SCOPE ((SYMBOLS - GLOBALS) / SCOPES)
+#define LINEAR_SAMPLE 2000
+
+/* The linked-list symbol table previously used by analysis (the baseline). */
+typedef struct LinearSymbol
+{
+    const char *name;
+    struct LinearSymbol *next;
+} LinearSymbol;
+
+typedef struct LinearTable
+{
+    struct LinearTable *parent;
+    LinearSymbol *symbols;
+} LinearTable;
+
+static LinearSymbol *linear_get(LinearTable *tab, const char *name)
+{
+    for (; tab; tab = tab->parent)
+    {
+        for (LinearSymbol *sym = tab->symbols; sym; sym = sym->next)
+        {
+            if (strcmp(name, sym->name) == 0)
+                return sym;
+        }
+    }
+    return NULL;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Scope in which the i'th symbol is defined (0 is global scope). */
+static int scope_of(int i)
+{
+    return i < GLOBALS ? 0 : 1 + (i - GLOBALS) / LOCALS_PER_SCOPE;
+}
+
+int main(void)
+{
+    const char **names = malloc(SYMBOLS * sizeof(char *));
+    for (int i = 0; i < SYMBOLS; i++)
+    {
+        char buf[32];
+        sprintf(buf, "symbol_%d", i);
+        names[i] = Intern_cstr(buf);
+    }
+
+    // Hash-based symbol tables.
+    SymbolTable *scopes[SCOPES + 1];
+    double start = now();
+    scopes[0] = symbol_table_create(NULL);
+    for (int s = 1; s <= SCOPES; s++)
+    {
+        scopes[s] = symbol_table_create(scopes[s - 1]);
+    }
+    for (int i = 0; i < SYMBOLS; i++)
+    {
+        symbol_table_put(scopes[scope_of(i)], names[i], (CType *)(long)(i + 1));
+    }
+    double put_elapsed = now() - start;
+
+    start = now();
+    for (int i = 0; i < SYMBOLS; i++)
+    {
+        Symbol *sym = symbol_table_get(scopes[SCOPES], names[i], true);
+        if (!sym || sym->type != (CType *)(long)(i + 1))
+        {
+            printf("FAIL. Symbol '%s' not resolved\n", names[i]);
+            return 1;
+        }
+    }
+    double get_elapsed = now() - start;
+
+    // Linked-list symbol tables.
+    LinearTable linear[SCOPES + 1] = {};
+    for (int s = 1; s <= SCOPES; s++)
+    {
+        linear[s].parent = &linear[s - 1];
+    }
+    for (int i = 0; i < SYMBOLS; i++)
+    {
+        LinearSymbol *sym = malloc(sizeof(LinearSymbol));
+        *sym = (LinearSymbol){names[i], linear[scope_of(i)].symbols};
+        linear[scope_of(i)].symbols = sym;
+    }
+
+    start = now();
+    for (int n = 0; n < LINEAR_SAMPLE; n++)
+    {
+        const char *name = names[(long)n * SYMBOLS / LINEAR_SAMPLE];
+        if (!linear_get(&linear[SCOPES], name))
+        {
+            printf("FAIL. Symbol '%s' not resolved (linear)\n", name);
+            return 1;
+        }
+    }
+    double linear_elapsed = now() - start;
+
+    double rate = SYMBOLS / get_elapsed, linear_rate = LINEAR_SAMPLE / linear_elapsed;
+    printf("Symbol table (%d symbols, %d nested scopes):\n", SYMBOLS, SCOPES);
+    printf("%-14s %12.0f puts/s\n", "hash table", SYMBOLS / put_elapsed);
+    printf("%-14s %12.0f lookups/s\n", "hash table", rate);
+    printf("%-14s %12.0f lookups/s\n", "linear search", linear_rate);
+    printf("Speed-up: %.0fx\n", rate / linear_rate);
+
+    Intern_destroy();
+    return 0;
+}
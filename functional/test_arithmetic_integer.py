@@ -168,3 +168,46 @@ def test_associativity(cc):
     cc.expression("-1 - 1 - 1 == ((-1 - 1) - 1)")
     cc.expression("5 == 5 == 1")
     cc.body("int a, b;a = b = 4;return a != 4;")
+
+
+def test_immediate(cc):
+    """Test arithmetic with constant operands.
+
+    The constant is passed through a function argument, so that it is not
+    known at compile time. This covers immediate values which can, and cannot
+    be encoded directly in an instruction.
+    """
+    program = "int f(int a){{return {expression};}} int main(){{return !f(3);}}"
+    cc.program(program.format(expression="a + 1 == 4"))
+    cc.program(program.format(expression="a + 74565 == 74568"))
+    cc.program(program.format(expression="a + -1 == 2"))
+    cc.program(program.format(expression="a - 4 == -1"))
+    cc.program(program.format(expression="a - -256 == 259"))
+    cc.program(program.format(expression="(a & 65535) == 3"))
+    cc.program(program.format(expression="(a & -2) == 2"))
+    cc.program(program.format(expression="(a | -16777216) == -16777213"))
+    cc.program(program.format(expression="(a ^ 65537) == 65538"))
+    cc.program(program.format(expression="a << 4 == 48"))
+    cc.program(program.format(expression="a >> 1 == 1"))
+    cc.program(program.format(expression="a > -1"))
+    cc.program(program.format(expression="a < 65537"))
+    cc.program(program.format(expression="a != 74565"))
+
+
+def test_register_pressure(cc):
+    """Test expressions with more live values than registers (which are spilled)."""
+    decls = "".join("int v%d = a * %d;" % (i, i + 1) for i in range(16))
+    total = " + ".join("v%d * v%d" % (i, 15 - i) for i in range(16))
+    expected = sum((i + 1) * (16 - i) for i in range(16)) * 4
+    cc.program("int f(int a){%s return %s;} int main(){return f(2) != %d;}" % (decls, total, expected))
+
+
+def test_register_pressure_constants(cc):
+    """Test constants and array addresses live across high register pressure (which
+    are recomputed, rather than spilled)."""
+    decls = "".join("int v%d = a * %d;" % (i, i + 1) for i in range(12))
+    total = " + ".join("v%d" % i for i in range(12))
+    stores = "x[0] = 1000; y[0] = 2000; x[1] = v0 + v1; y[1] = v2 + v3;"
+    expected = 1000 + 2000 + 6 + 14 + 2 * 78 + 100000 + 2000
+    cc.program("int f(int a){int x[4]; int y[4]; %s %s return x[0] + y[0] + x[1] + y[1] + %s"
+               " + 100000 + a * 1000;} int main(){return f(2) != %d;}" % (decls, stores, total, expected))
@@ -77,3 +77,27 @@ def test_assignment(type, cc):
     preamble = f"{type} a[5];a[0] = 15;{type} * ap = &a[4];"
     cc.body(preamble + f"return *(ap -= 4) != 15;")
     cc.body(preamble + f"ap -= 4;return *ap != 15;")
+
+
+@pytest.mark.parametrize("type", ["char", "short", "int"])
+def test_addressing(type, cc):
+    """Test array accesses with variable indexes and constant offsets.
+
+    The index is passed through a function argument, so that it is not known at
+    compile time. Large offsets cannot be encoded in a load/store instruction.
+    """
+    program = f"""
+    int f(int i)
+    {{
+        {type} a[1200];
+        {type} * p = a + i;
+        a[i] = 3;
+        a[i + 1] = 4;
+        p[2] = 5;
+        a[1100] = 6;
+        *(p + 1090) = 7;
+        return a[i] + a[i + 1] + *(p + 2) + a[1100] + a[1091] == 25;
+    }}
+    int main(){{return !f(1);}}
+    """
+    cc.program(program)
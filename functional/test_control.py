@@ -31,6 +31,14 @@ def cc(request):
         return request.param(temp_file.name)
 
 
+@pytest.fixture(params=[(compiler, opt) for compiler in COMPILERS[1:] for opt in ["0", "1"]])
+def acc_opt(request):
+    """ACC compilers, at each optimisation level."""
+    compiler, opt = request.param
+    with tempfile.NamedTemporaryFile() as temp_file:
+        return compiler(temp_file.name, opt=opt)
+
+
 @pytest.mark.skip("Not implemented yet")
 def test_for(cc):
     assert False
@@ -69,6 +77,245 @@ def test_if(cc):
     cc.body("if(0) { return 1; } else { return 0; }")
 
 
+def test_if_else(cc):
+    """Test if/else statements, with conditions not known at compile time."""
+    program = """
+    int f(int n)
+    {
+        int i = 0, total = 0;
+        while(i < n)
+        {
+            if(i > 3) total += i; else total -= 1;
+            if(i == 5) {
+                if(total > 100) return 1;
+            } else if(i == 6) total += 100;
+            i += 1;
+        }
+        return total;
+    }
+    int main(){return f(10) != 135;}
+    """
+    cc.program(program)
+
+
+def test_loop_variables(cc):
+    """Test variables assigned in loops, and on only some paths (joined in SSA
+    form), including variables swapped on each iteration."""
+    program = """
+    int f(int n)
+    {
+        int a = 1, b = 2, i = 0, last;
+        while(i < n)
+        {
+            int t = a;
+            a = b;
+            b = t;
+            if(a > 3) a = a - 1; else b = b + a;
+            if(i > 2) last = i;
+            i = i + 1;
+        }
+        return a * 100 + b * 10 + last;
+    }
+    int main(){return f(7) != 836;}
+    """
+    cc.program(program)
+
+
+def test_loop_invariants(cc):
+    """Test expressions which do not change in nested loops (hoisted out of the
+    loops), including division, in loops which may not run at all."""
+    program = """
+    int f(int n, int m, int d)
+    {
+        int table[4];
+        int total = 0, i = 0;
+        table[0] = table[1] = table[2] = table[3] = 0;
+        while(i < n)
+        {
+            int j = 0;
+            while(j < m)
+            {
+                table[j & 3] = table[j & 3] + n * 3 + i;
+                total = total + n * m + table[j & 3] / d;
+                j = j + 1;
+            }
+            i = i + 1;
+        }
+        return total;
+    }
+    int main(){return (f(0, 5, 0) != 0) + (f(4, 3, 2) != 336);}
+    """
+    cc.program(program)
+
+
+def test_loop_arrays(cc):
+    """Test loops walking arrays of each size (addressed with pointers incremented
+    on each iteration), with offsets from the loop counter, steps other than one,
+    and loops which do not run at all."""
+    program = """
+    int sum(unsigned char * arr, int n)
+    {
+        int i = 0, tot = 0;
+        while(i < n)
+        {
+            tot += arr[i++];
+        }
+        return tot;
+    }
+    int f(int s)
+    {
+        int a[20];
+        int i = 0;
+        while(i < 20) { a[i] = i * 3 + s; i = i + 1; }
+        int tot = 0;
+        i = 1;
+        while(i <= 18) { tot = tot + a[i + 1] - a[i - 1]; i = i + 2; }
+        int j = s;
+        while(j < 10) { tot = tot + a[j]; j = j + 1; }
+        int m = 5;
+        while(m < 3) { tot = tot + a[m]; m = m + 1; }
+        int q = 0;
+        while(q < 19) { a[q] = a[q + 1]; q = q + 3; }
+        tot = tot + q + a[0] + a[3];
+        short h[6];
+        int r = 0;
+        while(r < 6) { h[r] = r - 3; r++; }
+        r = 0;
+        while(r < 6) { tot = tot * 3 + h[r]; r++; }
+        char c[10];
+        int x = 0;
+        while(x < 10) { int y = 0; c[x] = x; while(y < x) { c[y] = c[y] + 1; y++; } x++; }
+        x = 0;
+        while(x < 10) { tot = tot + c[x] * x; x++; }
+        return tot;
+    }
+    int main()
+    {
+        unsigned char b[5];
+        b[0] = 1; b[1] = 2; b[2] = 3; b[3] = 200; b[4] = 5;
+        return (f(2) != 175910) + (f(0) != 163517) + (sum(b, 5) != 211) + (sum(b, 0) != 0);
+    }
+    """
+    cc.program(program)
+
+
+def test_loop_register_pressure(cc):
+    """Test loops with more live values than registers (values used within the loops
+    are kept in registers, and others are spilled)."""
+    program = """
+    int f(int x)
+    {
+        int a = x * 3, b = x * 5, c = x * 7, d = x * 11;
+        int e = x * 13, g = x * 19, h = x * 23, k = x * 29;
+        int arr[100];
+        int i = 0;
+        while(i < 100) { arr[i] = i * a + b; i++; }
+        int s = 0, t = 0;
+        i = 0;
+        while(i < 100) { s = s + arr[i] * c; t = t + arr[i] * d; i++; }
+        return s + t + a + b + c + d + e + g + h + k;
+    }
+    int main()
+    {
+        return (f(2) != 1105420) + (f(-1) != 276190);
+    }
+    """
+    cc.program(program)
+
+
+def test_block_labels(cc):
+    """Test basic blocks added by the optimiser (on critical edges) are labelled
+    distinctly from the basic blocks of other functions."""
+    program = """
+    int f(int n)
+    {
+        int s = 0, i = 0;
+        while(i < n)
+        {
+            if(i & 1) s = s + 1;
+            if(i & 2) s = s + 2;
+            if(i & 4) s = s + 4;
+            i++;
+        }
+        return s;
+    }
+    int main()
+    {
+        int t = 0, j = 0;
+        while(j < 3) { t = t + f(j + 5); j++; }
+        return t != 46;
+    }
+    """
+    cc.program(program)
+
+
+def test_live_across_loop(acc_opt):
+    """Test values held in registers before a loop, and used after it, are kept (or
+    stored) where the loop reuses their registers."""
+    program = """
+    int f(int a, int b) { return a; }
+    int main()
+    {
+        int v0 = 8;
+        int v1 = 3;
+        int a[8];
+        if(f(1, v1))
+        {
+            int c = 0;
+            while(c < 9) { c++; }
+            f(3, a[2]);
+        }
+        return v0 != 8;
+    }
+    """
+    acc_opt.program(program)
+
+
+def test_live_across_nested_loops(acc_opt):
+    """Test parameters stay live across nested loops calling a helper function."""
+    program = """
+    int h(int a, int b) { return a - b; }
+    int g(int p, int q)
+    {
+        int s = 0, i = 0;
+        while(i < 3)
+        {
+            int j = 0;
+            while(j < 4) { s = s + h(j, i); j++; }
+            i++;
+        }
+        s = h(s, q);
+        return p * 100 + q * 10 + s;
+    }
+    int main()
+    {
+        return g(2, 3) != 233;
+    }
+    """
+    acc_opt.program(program)
+
+@pytest.mark.parametrize("op", ["==", "!=", "<", "<=", ">", ">="])
+def test_if_comparison(op, cc):
+    """Test branching on each comparison (and its negation), with operands which are
+    not known at compile time, and immediate operands."""
+    program = """
+    int f(int a, int b)
+    {{
+        int taken = 0;
+        if(a {op} b) taken += 1;
+        if(!(a {op} b)) taken += 2;
+        if(a {op} 2) taken += 4;
+        if(a {op} 74565) taken += 8;
+        return taken;
+    }}
+    int main(){{return f(2, {b}) != {expected};}}
+    """
+    compare = lambda b: eval("2 %s %d" % (op, b))
+    for b in [1, 2, 3]:
+        expected = (1 if compare(b) else 2) + 4 * compare(2) + 8 * compare(74565)
+        cc.program(program.format(op=op, b=b, expected=expected))
+
+
 def test_conditional(cc):
     cc.expression("(1 == 1 ? 2 : 3) == 2")
     cc.expression("(1 == 2 ? 2 : 3) == 3")
@@ -23,6 +23,54 @@ def test_json():
     print(proc.stdout.decode())
     assert "errors" in json.loads(proc.stdout.decode())
 
+def test_timing():
+    """Passing -t should report time spent in each phase on stderr."""
+    src = "int main(){return 0;}"
+    proc = subprocess.run([ACC_PATH, '-t', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    report = proc.stderr.decode()
+    for phase in ["parse", "analysis", "ir_gen", "liveness", "regalloc", "asm_gen", "total"]:
+        assert re.search(r'^\s*' + phase + r'\s', report, re.MULTILINE)
+
+def test_timing_json():
+    """Passing -t with -j should report time spent in each phase in json."""
+    src = "int main(){return 0;}"
+    proc = subprocess.run([ACC_PATH, '-t', '-j', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    phases = {p["name"]: p for p in json.loads(proc.stderr.decode())["phases"]}
+    assert {"parse", "analysis", "ir_gen", "liveness", "regalloc", "asm_gen"} <= set(phases)
+    assert {"allocate", "resolve"} == {t["name"] for t in phases["regalloc"]["timers"]}
+    assert phases["ir_gen"]["allocations"] > 0
+
+def test_timing_allocations():
+    """Every phase's heap allocations should be counted, not only the arenas'."""
+    src = """
+    int f(int n)
+    {
+        int a = n * 3, b = n * 5, total = 0, i = 0;
+        while(i < n)
+        {
+            total += a * i + b;
+            i++;
+        }
+        return total;
+    }
+    """
+    proc = subprocess.run([ACC_PATH, '-t', '-j', '-O', '1', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    phases = {p["name"]: p for p in json.loads(proc.stderr.decode())["phases"]}
+    for phase in ["analysis", "liveness", "regalloc", "ssa", "asm_gen"]:
+        assert phases[phase]["allocations"] > 0
+        assert phases[phase]["peak_bytes"] > 0
+
+def test_error_limit():
+    """Passing -e N should stop after N errors."""
+    src = "\n".join("int f%d() { return x%d; }" % (i, i) for i in range(100))
+    proc = subprocess.run([ACC_PATH, '-j', '-e', '3', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 1
+    errors = json.loads(proc.stdout.decode())["errors"]
+    assert [e["line_number"] for e in errors] == [1, 2, 3]
+
 def test_check():
     """Passing -c should check the source input only (no output)."""
     src = "int main(){}"
@@ -51,6 +99,91 @@ def test_intermediate_output_file():
         with open(temp.name, 'r') as tempfd:
             assert re.match(r'// === ACC \(\d\.\d\.\d\) IR ===', tempfd.read())
 
+def test_intermediate_output_moves_removed():
+    """The IR output should report the number of MOVs removed in each function."""
+    src = "int f(int a){int b = a; return b + a;} int main(){return f(1) - 2;}"
+    proc = subprocess.run([ACC_PATH, '-i', '-', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    removed = re.findall(r'// Moves removed: (\d+)', proc.stdout.decode())
+    assert len(removed) == 2 and sum(map(int, removed)) > 0
+
+def test_intermediate_output_redundant_removed():
+    """The IR output should report the number of redundant instructions removed."""
+    src = "int f(int a, int b){int c[4]; c[a] = a * b; return c[a] + a * b;}"
+    proc = subprocess.run([ACC_PATH, '-O', '1', '-i', '-', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    removed = re.findall(r'// Redundant instructions removed: (\d+)', proc.stdout.decode())
+    assert len(removed) == 1 and int(removed[0]) >= 2
+
+def test_intermediate_output_loops():
+    """The IR output should report the instructions hoisted out of loops, and the
+    loop depth of each basic block."""
+    src = "int f(int n){int i = 0; while(i < n){int j = 0; while(j < n) j = j + n * 3; i = i + 1;} return i;}"
+    proc = subprocess.run([ACC_PATH, '-O', '1', '-i', '-', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    hoisted = re.findall(r'// Invariants hoisted: (\d+)', proc.stdout.decode())
+    assert len(hoisted) == 1 and int(hoisted[0]) >= 1
+    depths = re.findall(r'//LoopDepth=(\d+)', proc.stdout.decode())
+    assert set(depths) == {'1', '2'}
+
+def test_intermediate_output_rematerialised():
+    """The IR output should report the number of spilled registers recomputed at
+    each use (constants, and stack object addresses)."""
+    decls = "".join("int v%d = a * %d;" % (i, i + 1) for i in range(12))
+    total = " + ".join("v%d" % i for i in range(12))
+    src = "int f(int a){int x[4];%s x[0] = 1000; x[1] = %s; return x[0] + x[1] + a * 1000;}" % (decls, total)
+    proc = subprocess.run([ACC_PATH, '-O', '1', '-i', '-', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    remat = re.findall(r'// Rematerialised: (\d+)', proc.stdout.decode())
+    assert len(remat) == 1 and int(remat[0]) > 0
+
+def test_stack_addressing():
+    """Spilled registers and local arrays should be addressed directly from sp."""
+    decls = "".join("int v%d = a * %d;" % (i, i + 1) for i in range(12))
+    total = " + ".join("v%d" % i for i in range(12))
+    src = "int f(int a){int arr[4];%s arr[3] = %s; return arr[3];}" % (decls, total)
+    proc = subprocess.run([ACC_PATH, '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    asm = proc.stdout.decode()
+    assert re.search(r'str r\d+, \[sp, #\d+\]', asm)
+    assert re.search(r'ldr r\d+, \[sp, #\d+\]', asm)
+    assert not re.search(r'add r\d+, r\d+, sp', asm)
+
+def test_block_layout():
+    """Jumps to the next basic block, and block placeholders, should be omitted."""
+    src = "int f(int n){int i = 0; while(i < n){if(i > 3) n -= 1; i += 1;} return i;}"
+    proc = subprocess.run([ACC_PATH, '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 0
+    lines = proc.stdout.decode().splitlines()
+    assert not any(line.strip().startswith("nop") for line in lines)
+    for line, label in zip(lines, lines[1:]):
+        match = re.match(r'\s+b\w* (_bb_\d+)$', line)
+        assert not (match and label == match.group(1) + ":")
+
+def test_dead_code():
+    """Unreachable code, and results that are never used, should be removed."""
+    src = ("int f(int a){int unused = a * 7; if(1) return a + 1; else return a - 1;"
+           " a = a + 5; return a;}")
+    asm = {}
+    for level in ["0", "1"]:
+        proc = subprocess.run([ACC_PATH, '-O', level, '-'], capture_output=True,
+                              input=src.encode())
+        assert proc.returncode == 0
+        asm[level] = proc.stdout.decode()
+    assert re.search(r'\bmul\b', asm["0"]) and not re.search(r'\bmul\b', asm["1"])
+    assert not re.search(r'sub r\d+, r\d+, #1$', asm["1"], re.M)
+    assert asm["1"].count("bx lr") < asm["0"].count("bx lr")
+
+def test_optimise_level():
+    """-O sets the optimisation level, which must not be negative."""
+    src = "int main(){return 2 * 3 - 6;}"
+    for level in ['0', '1']:
+        proc = subprocess.run([ACC_PATH, '-O', level, '-'], capture_output=True, input=src.encode())
+        assert proc.returncode == 0
+
+    proc = subprocess.run([ACC_PATH, '-O', '-1', '-'], capture_output=True, input=src.encode())
+    assert proc.returncode == 1
+
 def test_file_input():
     """Test reading input from file (not '-')."""
     with tempfile.NamedTemporaryFile() as temp:
@@ -14,6 +14,8 @@
 #ifndef __AST__
 #define __AST__
 
+#include <stddef.h>
+
 #include "ctype.h"
 #include "symbol.h"
 #include "token.h"
@@ -240,17 +242,30 @@ typedef struct StmtAstNode_t
     struct StmtAstNode_t *next;
 } StmtAstNode;
 
+/*
+ * AST arena.
+ *
+ * AST nodes (and the parameter/argument lists and types hanging off them) are
+ * bump-allocated from an arena, which is owned by the Parser. The whole AST is
+ * freed at once by Ast_arena_destroy().
+ */
+typedef struct AstArena AstArena;
+
+AstArena *Ast_arena_init(void);
+void *Ast_arena_alloc(AstArena *, size_t size);
+void Ast_arena_destroy(AstArena *);
+
 /*
  * Create new AST nodes
  *
  * These functions take an AST by value (presumably allocated automatically),
- * and copy it to a new ExprAstNode/DeclAstNode allocated dynamically.
+ * and copy it to a new ExprAstNode/DeclAstNode allocated from the arena.
  *
  * E.g.:
- * > Ast_create_expr_node((ExprAstNode){.primary.identifier=...});
+ * > Ast_create_expr_node(arena, (ExprAstNode){.primary.identifier=...});
  */
-ExprAstNode *Ast_create_expr_node(ExprAstNode);
-DeclAstNode *Ast_create_decl_node(DeclAstNode);
-StmtAstNode *Ast_create_stmt_node(StmtAstNode);
+ExprAstNode *Ast_create_expr_node(AstArena *, ExprAstNode);
+DeclAstNode *Ast_create_decl_node(AstArena *, DeclAstNode);
+StmtAstNode *Ast_create_stmt_node(AstArena *, StmtAstNode);
 
 #endif
@@ -51,12 +51,25 @@ void Error_destroy(ErrorReporter *);
  */
 int Error_has_errors(ErrorReporter *);
 
+/*
+ * Limit the number of errors collected. Once 'limit' errors have been reported,
+ * further errors are dropped. A limit of 0 (the default) means no limit.
+ */
+void Error_set_limit(ErrorReporter *, int limit);
+
+/*
+ * Check if the error limit has been reached. The scanner/parser/analysis can
+ * use this to stop early, rather than process the rest of the input.
+ */
+int Error_limit_reached(ErrorReporter *);
+
 /*
  * Iterate through errors reported to the ErrorReporter instance.
  *
  * This function iterates through the reported errors, and sets the error
  * attributes (type, line, position, title, description) for each error.
  * To start from the beginning of the reported errors list, set beginning = true.
+ * Errors are ordered by line number, line position, and then type.
  *
  * Returns 0 if there are no more errors left.
  */
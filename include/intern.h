@@ -0,0 +1,35 @@
+/*
+ * Identifier interning.
+ *
+ * Every distinct identifier is stored exactly once, in a process-wide hash set keyed
+ * on the identifier's characters. Interning the same characters again returns the
+ * same (canonical) pointer, so interned strings can be compared for equality by
+ * pointer instead of with strcmp.
+ *
+ * The scanner interns all IDENTIFIER tokens, and the canonical pointer is shared by
+ * the AST, symbol tables, and IR. Interned strings are null-terminated, must not be
+ * modified, and live until Intern_destroy() is called.
+ */
+#ifndef __INTERN__
+#define __INTERN__
+
+/*
+ * Get the canonical string for the first 'length' characters of 'str'.
+ *
+ * 'str' does not need to be null-terminated (e.g. a slice of the source input).
+ */
+const char *Intern_string(const char *str, int length);
+
+/*
+ * Get the canonical string for the null-terminated string 'str'.
+ */
+const char *Intern_cstr(const char *str);
+
+/*
+ * Free all interned strings.
+ *
+ * Any canonical pointers returned previously are invalidated.
+ */
+void Intern_destroy(void);
+
+#endif
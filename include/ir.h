@@ -16,7 +16,7 @@ typedef struct IrFunction IrFunction;
 typedef enum IrOpcode
 {
     // Arithmetic instructions
-    // dest = left OP right
+    // dest = left OP right (or dest = left OP value, for immediate instructions)
     IR_ADD,
     IR_SUB,
     IR_MUL,
@@ -43,12 +43,14 @@ typedef enum IrOpcode
     // Move instruction. dest = left
     IR_MOV,
 
-    // Store instruction memory @ left = right
+    // Store instruction memory @ address = right
     IR_STORE8,
     IR_STORE16,
     IR_STORE32,
 
-    // Load instruction dest = memory @ left
+    // Load instruction dest = memory @ address
+    // The address is left, left + (index << shift), or left + value (immediate).
+    // If left is NULL, the base is the stack pointer (E.g. stack slot sp + value).
     IR_LOAD8,
     IR_LOAD16,
     IR_LOAD32,
@@ -64,28 +66,35 @@ typedef enum IrOpcode
     IR_BRANCHZ,
     IR_JUMP,
 
+    // Compare-and-branch: jump_true if left OP right (or value, if immediate),
+    // else jump_false.
+    IR_BRANCH_EQ,
+    IR_BRANCH_LT,
+    IR_BRANCH_LE,
+
     // Call & Return
     IR_CALL,
     IR_RETURN,
 
+    // Phi (SSA form only, at the start of a basic block):
+    // dest = left if entered from control.jump_true, or right if from
+    // control.jump_false (the predecessor blocks).
+    IR_PHI,
+
     IR_NOP
 } IrOpcode;
 
 typedef enum
 {
     REG_RESERVED,
-    REG_ANY,
-    REG_SPILL
+    REG_ANY
 } IrRegType;
 
 typedef struct IrRegister
 {
     IrRegType type;
 
-    union {
-        int index;
-        int spill;
-    };
+    int index;
 
     struct
     {
@@ -93,6 +102,14 @@ typedef struct IrRegister
         unsigned int finish;
     } liveness;
 
+    // The instruction defining the register, if its value can be recomputed at
+    // each use (IR_LOADI or IR_LOADSO) rather than spilled. Set by regalloc.
+    struct IrInstruction *remat;
+
+    // Estimated cost of spilling the register: the loads and stores needed, each
+    // weighted by 10^(loop depth). Set by regalloc.
+    float spill_cost;
+
     struct IrRegister *next;
 } IrRegister;
 
@@ -114,12 +131,28 @@ typedef struct IrInstruction
 {
     IrOpcode op;
 
+    // Loadi instruction, or the right operand of an immediate instruction.
+    int value;
+
+    // The right operand is the constant 'value' (and 'right' is NULL).
+    // Supported for IR_ADD, IR_SUB, IR_SLL, IR_SLR, IR_OR, IR_AND, IR_XOR, the
+    // comparisons, and compare-and-branch. For loads and stores, 'value' is the
+    // address offset.
+    bool immediate;
+
+    // Loads and stores: scale applied to the 'index' address offset.
+    uint8_t shift;
+
+    // Loads and stores: the address is 'left' alone, which is then incremented by
+    // 'value' (post-indexed addressing, E.g. ldr r0, [r1], #4).
+    bool post_index;
+
+    int live_position;
+
     IrRegister *dest;
     IrRegister *left;
     IrRegister *right;
-
-    // Loadi instruction
-    int value;
+    IrRegister *index;
 
     struct {
         IrBasicBlock * jump_true;
@@ -128,11 +161,11 @@ typedef struct IrInstruction
         
     } control;
 
-    int live_position;
-
     struct IrInstruction *next, *prev;
 } IrInstruction;
 
+typedef struct IrInstructionChunk IrInstructionChunk;
+
 typedef struct IrBasicBlock
 {
     int index;
@@ -145,13 +178,19 @@ typedef struct IrBasicBlock
 
     IrBasicBlock * cfg_entry[2];
 
+    // Immediate dominator (NULL for the entry block), set by SSA construction.
+    IrBasicBlock *idom;
+
+    // Number of loops containing the basic block, set by loop-invariant code motion.
+    int loop_depth;
+
     IrInstruction *head, *tail;
     IrBasicBlock *next;
 } IrBasicBlock;
 
 typedef struct IrFunction
 {
-    char *name;
+    const char *name;
     int stack_size;
 
     struct 
@@ -164,19 +203,83 @@ typedef struct IrFunction
     bool has_regalloc;
     int regalloc_count;
 
+    // Number of MOVs removed by copy propagation and register coalescing.
+    int movs_removed;
+
+    // Number of redundant instructions removed by value numbering.
+    int redundant_removed;
+
+    // Number of instructions hoisted out of loops.
+    int invariants_hoisted;
+
+    // Number of spilled registers recomputed at each use, instead of reloaded.
+    int rematerialised;
+
+    // Instruction storage.
+    //
+    // After Ir_compact(), all instructions are stored contiguously in 'array',
+    // in basic block order (so each basic block is a range of the array). New
+    // instructions (E.g. spill code) are allocated from 'pending' chunks, until
+    // they are merged into the array by the next Ir_compact().
+    struct
+    {
+        IrInstruction *array;
+        int count;
+        IrInstructionChunk *pending;
+    } instrs;
+
     IrBasicBlock *head, *tail;
     struct IrFunction *next;
 } IrFunction;
 
+/*
+ * Check if an opcode has an immediate form (see IrInstruction.immediate).
+ */
+bool Ir_has_immediate(IrOpcode op);
+
+/*
+ * Check if control leaves a basic block through an instruction (a jump, branch, or
+ * return), rather than falling through to the next block.
+ */
+bool Ir_is_terminator(IrInstruction *instr);
+
+/*
+ * Get the successors of a basic block (the targets of its terminator, or the next
+ * block if it falls through). Returns the number of successors (up to 2).
+ */
+int Ir_successors(IrBasicBlock *bb, IrBasicBlock **succ);
+
+/*
+ * Get one past the highest basic block index in the program (and in 'function').
+ * Basic block indices are unique across the whole program, since they are used
+ * for assembly labels.
+ */
+int Ir_block_count(IrFunction * function);
+
+/*
+ * Get the index for a new basic block in 'function', unique across the program.
+ */
+int Ir_new_block_index(IrFunction * function);
+
+/*
+ * Allocate a new REG_ANY register, and add it to the function's register list.
+ */
+IrRegister * Ir_new_register(IrFunction * function);
+
 /*
  * Generate string-representation of the IR.
  */
 void Ir_to_str(FILE *, IrFunction *, int *);
 
+/*
+ * Allocate a new instruction for a function (not yet linked into a basic block).
+ */
+IrInstruction * Ir_new_instr(IrFunction * function, IrInstruction instr);
+
 /*
  * Append an instruction to a basic block.
  */
-void Ir_emit_instr(IrBasicBlock * bb, IrInstruction instr);
+void Ir_emit_instr(IrFunction * function, IrBasicBlock * bb, IrInstruction instr);
 
 /*
  * Insert a new instruction before/after another instruction.
@@ -184,4 +287,15 @@ void Ir_emit_instr(IrBasicBlock * bb, IrInstruction instr);
 void Ir_emit_instr_after(IrInstruction * after, IrInstruction * instr);
 void Ir_emit_instr_before(IrInstruction * before, IrInstruction * instr);
 
+/*
+ * Unlink an instruction from a basic block.
+ */
+void Ir_remove_instr(IrBasicBlock * bb, IrInstruction * instr);
+
+/*
+ * Move all of a function's instructions into a single contiguous array, in basic
+ * block order, merging any pending instructions.
+ */
+void Ir_compact(IrFunction * function);
+
 #endif
@@ -0,0 +1,122 @@
+#ifndef __OPTIMISE_H__
+#define __OPTIMISE_H__
+/*
+ * IR Optimisation passes
+ *
+ * Each pass operates on all functions (IrFunction) in the Intermediate
+ * Representation (ir.h), after IR generation, and before liveness analysis.
+ */
+#include "ir.h"
+
+/*
+ * Constant folding and algebraic simplification.
+ *
+ * IR generation loads every literal into a fresh register (IR_LOADI). Within each
+ * basic block, registers holding known constants are tracked, and:
+ *  - operations with constant operands are replaced with IR_LOADI of the result
+ *  - identities (E.g. x + 0, x * 1, x & 0xFFFFFFFF) are replaced with IR_MOV
+ *  - multiplies by a power of two are replaced with shifts (IR_SLL)
+ *  - other operations with a constant operand use the immediate form, if any
+ *  - IR_BRANCHZ on a constant is replaced with IR_JUMP
+ * IR_LOADI instructions which are no longer used are then removed.
+ */
+void Optimise_constant_folding(IrFunction *program);
+
+/*
+ * Copy propagation.
+ *
+ * IR generation emits a MOV for every variable read, and for every initialiser.
+ * Within each basic block, registers that are copies of another (REG_ANY) register
+ * are replaced with the original, while neither register is redefined. MOVs
+ * whose destination is no longer read are then removed (and counted in
+ * IrFunction.movs_removed), and unused registers are dropped from the function's
+ * register list.
+ */
+void Optimise_copy_propagation(IrFunction *program);
+
+/*
+ * Dead code elimination.
+ *
+ * Instructions following a terminator (E.g. after a return statement), and basic
+ * blocks not reachable from the entry block (E.g. after a branch is folded), are
+ * removed, and the CFG edges (IrBasicBlock.cfg_entry) are rebuilt. Instructions
+ * whose result is never read, on any path through the function, are then removed.
+ */
+void Optimise_dead_code(IrFunction *program);
+
+/*
+ * Global value numbering (for functions in SSA form - see ssa.h).
+ *
+ * The dominator tree is walked, keeping the values computed by pure instructions
+ * (arithmetic, comparisons, IR_LOADI, IR_LOADSO) in dominating blocks. Instructions
+ * recomputing a value, copies (IR_MOV), and phis selecting a single value, are
+ * removed and their uses replaced (counted in IrFunction.redundant_removed and
+ * .movs_removed). Loads are also reused, where no store or call may have run in
+ * between (conservatively, at any join point in the CFG), and loads of a word just
+ * stored are replaced with the register stored.
+ */
+void Optimise_value_numbering(IrFunction *program);
+
+/*
+ * Loop-invariant code motion (for functions in SSA form - see ssa.h).
+ *
+ * Natural loops are found from the back edges in the CFG (to a basic block
+ * dominating the source), and a preheader is inserted before each loop header
+ * where the block entering the loop also branches elsewhere. Pure instructions
+ * whose operands are all defined outside a loop (E.g. IR_LOADSO of an array, or
+ * IR_LOADI) are moved into the preheader, innermost loops first (counted in
+ * IrFunction.invariants_hoisted). Loads and division by a register, which may
+ * fault, are not moved. The number of loops containing each basic block is set in
+ * IrBasicBlock.loop_depth.
+ */
+void Optimise_loop_invariant_code_motion(IrFunction *program);
+
+/*
+ * Induction variable strength reduction (for functions in SSA form - see ssa.h).
+ *
+ * Basic induction variables are incremented by a constant on each iteration of a
+ * loop (i = i + c). Array accesses in the loop calculate the address from one
+ * (base + ((i + d) << k), with a loop-invariant base), which is replaced with a
+ * pointer incremented alongside it (by c << k), addressed at offset d << k. Where
+ * the variable is then only used by the loop's exit test, against a constant
+ * limit (and starting from a constant), the test is replaced with a test of the
+ * pointer, and the variable is removed.
+ */
+void Optimise_induction_variables(IrFunction *program);
+
+/*
+ * Addressing modes.
+ *
+ * Array and pointer accesses calculate the address with an IR_ADD (of a scaled
+ * index, or a constant offset), used by loads and stores in the same basic block.
+ * The calculation is folded into each load/store address (IrInstruction.index and
+ * .shift, or .value), matching the A32 [rn, rm, lsl #n] and [rn, #n] forms.
+ * Stack objects (IR_LOADSO) are addressed directly from the stack pointer. Address
+ * registers incremented after the access (E.g. pointer induction variables) use
+ * post-indexed addressing ([rn], #n - IrInstruction.post_index).
+ */
+void Optimise_addressing_modes(IrFunction *program);
+
+/*
+ * Compare-and-branch fusion.
+ *
+ * Conditions are evaluated to 0 or 1 by a comparison (IR_EQ, IR_LT, IR_LE),
+ * possibly negated by IR_NOT (for >, >=, !=), before IR_BRANCHZ tests the
+ * result. Where the result is only used by the branch, the comparison is fused
+ * into a compare-and-branch (IR_BRANCH_EQ, IR_BRANCH_LT, IR_BRANCH_LE), and
+ * negations are removed by swapping the branch targets.
+ */
+void Optimise_branch_fusion(IrFunction *program);
+
+/*
+ * Basic block layout.
+ *
+ * Basic blocks are reordered so that each is followed by its most likely
+ * successor (the target of its jump, or the true arm of its branch - E.g. a loop
+ * body), and blocks which return from the function are placed last. The
+ * assembly generator omits jumps to the next basic block, and inverts branch
+ * conditions to fall through to the next block.
+ */
+void Optimise_block_layout(IrFunction *program);
+
+#endif
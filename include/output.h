@@ -0,0 +1,49 @@
+/*
+ * Buffered text output, used by the assembly and IR emitters.
+ *
+ * Output is collected in a large buffer, which is written to the underlying file
+ * in blocks (when full, and by Output_flush/Output_destroy). Formatting is done by
+ * Output_format, which supports a small subset of printf conversions:
+ *  - %d (int)
+ *  - %u (unsigned int)
+ *  - %s (null-terminated string)
+ *  - %c (char)
+ *  - %% (literal '%')
+ * Integers are formatted directly into the buffer, avoiding the overhead of stdio
+ * formatting for every register number and immediate value.
+ */
+#ifndef __OUTPUT__
+#define __OUTPUT__
+
+#include <stdio.h>
+
+typedef struct Output Output;
+
+/*
+ * Create a new output buffer, writing to 'fd'.
+ *
+ * This should be later destroyed with Output_destroy()
+ */
+Output *Output_init(FILE *fd);
+
+/*
+ * Flush and destroy the output buffer. The underlying file is not closed.
+ */
+void Output_destroy(Output *);
+
+/*
+ * Write the buffer contents to the underlying file.
+ */
+void Output_flush(Output *);
+
+/*
+ * Append a null-terminated string.
+ */
+void Output_str(Output *, const char *str);
+
+/*
+ * Append formatted output (see above for the supported conversions).
+ */
+void Output_format(Output *, const char *fmt, ...);
+
+#endif
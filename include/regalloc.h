@@ -5,8 +5,9 @@
  * 
  * REG_ANY register indexes are mapped from an infinite domain (the output of the IR generation)
  * to a finite range - the register file of the target architecture. The allocation algorithm
- * is Linear scan, using the liveness-analysis information carried by REG_ANY registers in the .liveness
- * struct field.
+ * is second-chance binpacking: instructions are visited in basic block layout order, and each
+ * value's live interval is split wherever register pressure requires, using the liveness-analysis
+ * information carried by each basic block (IrBasicBlock.live).
  */
 #include "ir.h"
 
@@ -18,16 +19,33 @@
 /*
  * Number of arguments reserved for register spill handling.
  */
-#define REGS_SPILL 4
+#define REGS_SPILL 3
 
 /*
  * This function tries to allocate all REG_ANY registers in each function a register index in the set
  * free_registers. Otherwise, registers are spilled to the stack, and store/load operations are
  * substituted in the code.
  * 
- * The first four registers in free_registers are reserved for spill code (the first is used for holding 
- * stack addresses in spill code; the remaining three are used for storing destination, left, and right
- * instruction registers).
+ * The first three registers in free_registers are reserved for spill code (used for storing destination,
+ * left, and right instruction registers). Spill slots are addressed directly from the stack pointer.
+ * 
+ * Each value is held in a register, or in its stack slot, and may move between them: where no
+ * register is free, the value held which is next used furthest ahead is spilled (stored, if it has
+ * changed since it was loaded), and reloaded at its next use - its second chance. Leaving a loop
+ * counts as a long way ahead, so values used within a loop are kept in registers through it, and
+ * stored before it, or after it, instead. Values next used equally far ahead are spilled by the
+ * fewest loads and stores needed per instruction they are live for, each weighted by
+ * 10^(IrBasicBlock.loop_depth).
+ *
+ * Where a value is in different locations at the end of a basic block and the start of its
+ * successor, stores, moves, and loads are inserted on the CFG edge - at the end of the predecessor
+ * or start of the successor, or in a new basic block between them. Copies (IR_MOV) of a value
+ * which dies there are removed (counted in IrFunction.movs_removed).
+ *
+ * Registers defined once by IR_LOADI or IR_LOADSO are rematerialised instead: the
+ * definition is re-emitted where the value is reloaded (counted in
+ * IrFunction.rematerialised), and removed if the value is not given a register there,
+ * so no spill slot or store is needed.
  * 
  * The free_registers set must include at least REGS_SPILL registers. If |free_registers| = REGS_SPILL, 
  * all registers are spilled. free_registers is an array of integers, that must terminate in -1.
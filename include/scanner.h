@@ -31,6 +31,22 @@ typedef struct Scanner_t Scanner;
  */
 Scanner *Scanner_init(char const *source, ErrorReporter *error_reporter);
 
+/*
+ * Initialize Scanner, with a known source length.
+ *
+ * Equivalent to Scanner_init, without measuring the source with strlen().
+ * The source buffer must be terminated with '\0' at source[len], which the
+ * scanner uses as a sentinel.
+ *
+ * Parameters:
+ *  source - pointer to source code
+ *  len - length of the source code, in bytes (excluding the terminator)
+ *
+ * Returns:
+ *  pointer to allocated Scanner instance.
+ */
+Scanner *Scanner_init_n(char const *source, int len, ErrorReporter *error_reporter);
+
 /*
  * Get the next token
  *
@@ -0,0 +1,48 @@
+#ifndef __SSA_H__
+#define __SSA_H__
+/*
+ * Static Single Assignment (SSA) form
+ *
+ * In SSA form, every REG_ANY register is defined by exactly one instruction, which
+ * dominates all of its uses. Where different definitions of a variable reach a
+ * join point in the CFG, an IR_PHI instruction at the start of the basic block
+ * selects the value for the predecessor control was entered from.
+ *
+ * IR generation reuses registers across assignments (E.g. for every assignment to
+ * a local variable), so optimisation passes which rely on SSA form run between
+ * Ssa_construct and Ssa_destruct. Passes which change the CFG must keep the phis'
+ * predecessor blocks up to date.
+ */
+#include <stdbool.h>
+
+#include "ir.h"
+
+/*
+ * Convert each function into SSA form.
+ *
+ * Dominators (IrBasicBlock.idom) are found from the CFG edges (cfg_entry), and
+ * phis are placed at the iterated dominance frontier of the definitions of each
+ * register live across basic blocks. Registers are then renamed by walking the
+ * dominator tree, and phis whose results are never used are removed.
+ */
+void Ssa_construct(IrFunction *program);
+
+/*
+ * Check that a function is in SSA form: each REG_ANY register is defined once,
+ * and the definition dominates every use (the end of the predecessor block, for
+ * phi operands); phis are only at the start of basic blocks, with one operand for
+ * each predecessor. Returns false if not.
+ */
+bool Ssa_verify(IrFunction *function);
+
+/*
+ * Convert each function out of SSA form, before liveness analysis.
+ *
+ * Critical edges (from a block with two successors, to a block with phis) are
+ * split, and the phis in each basic block are replaced with a parallel copy at
+ * the end of each predecessor, which is sequentialised into MOVs (using a new
+ * register to break cycles, E.g. swaps).
+ */
+void Ssa_destruct(IrFunction *program);
+
+#endif
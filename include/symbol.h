@@ -20,7 +20,8 @@
  */
 typedef struct Symbol_t
 {
-    char *name;
+    /* Interned name (see intern.h) */
+    const char *name;
     CType *type;
 
     struct
@@ -29,8 +30,6 @@ typedef struct Symbol_t
         IrRegister *regster;
         IrFunction *function;
     } ir;
-
-    struct Symbol_t *next;
 } Symbol;
 
 typedef struct SymbolTable_t SymbolTable;
@@ -46,16 +45,18 @@ SymbolTable *symbol_table_create(SymbolTable *parent);
 /*
  * Define a entry in a symbol table.
  *
+ * 'name' must be interned (see intern.h).
  * Returns a pointer to the new symbol, or NULL if it does not exist.
  */
-Symbol *symbol_table_put(SymbolTable *table, char *name, CType *type);
+Symbol *symbol_table_put(SymbolTable *table, const char *name, CType *type);
 
 /*
  * Retrieve a symbol table entry within this scope.
  *
+ * 'name' must be interned (see intern.h), since symbols are matched by pointer.
  * 'search_parent' instructs this function to recursively
  * search ancestors' symbol tables also.
  */
-Symbol *symbol_table_get(SymbolTable *table, char *name, bool search_parent);
+Symbol *symbol_table_get(SymbolTable *table, const char *name, bool search_parent);
 
 #endif
\ No newline at end of file
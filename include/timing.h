@@ -0,0 +1,58 @@
+/*
+ * Compiler instrumentation (acc -t).
+ *
+ * Phases of the compiler are timed by bracketing them with Timing_start() and
+ * Timing_stop(). Timers nest: a timer started while another is running is recorded
+ * as a sub-timer of it, and starting a timer with the same name (under the same
+ * parent) again accumulates into the existing timer. E.g.:
+ *
+ * > Timing_start("regalloc");
+ * > for (each function) {
+ * >     Timing_start("fixup");
+ * >     ...
+ * >     Timing_stop();
+ * > }
+ * > Timing_stop();
+ *
+ * For each timer, the wall-clock and CPU time, the number of heap blocks allocated
+ * (by xmalloc() and friends, see util.h), and the peak number of heap bytes in use
+ * are recorded.
+ * Timing is disabled by default, and Timing_start()/Timing_stop() do nothing until
+ * Timing_enable() is called.
+ */
+#ifndef __TIMING__
+#define __TIMING__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Enable timers.
+ */
+void Timing_enable(void);
+
+/*
+ * Start a timer, nested within the currently running timer (if any).
+ *
+ * 'name' must remain valid until Timing_report() (E.g. a string literal).
+ */
+void Timing_start(const char *name);
+
+/*
+ * Stop the most recently started timer.
+ */
+void Timing_stop(void);
+
+/*
+ * Record a heap block of 'bytes' allocated (or freed).
+ */
+void Timing_allocated(size_t bytes);
+void Timing_freed(size_t bytes);
+
+/*
+ * Print a report of all timers, as a table or as JSON.
+ */
+void Timing_report(FILE *fd, bool json);
+
+#endif
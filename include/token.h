@@ -102,8 +102,15 @@ typedef struct Token_t
 
     Position pos;
 
-    /* Token lexeme. Null-terminated string */
-    char *lexeme;
+    /* Token lexeme. A slice of the source input (not null-terminated) */
+    struct
+    {
+        int length;
+        const char *start;
+    } lexeme;
+
+    /* Interned identifier name (see intern.h). Only set for IDENTIFIER tokens */
+    const char *name;
 
     union {
         long int const_value;
@@ -112,4 +119,10 @@ typedef struct Token_t
 
 char *Token_str(TokenType);
 
+/*
+ * Get the keyword token type (AUTO..WHILE) for a lexeme of the given length,
+ * or IDENTIFIER if the lexeme is not a keyword.
+ */
+TokenType Token_keyword(const char *lexeme, int length);
+
 #endif
@@ -1,7 +1,9 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
-#define STR_CONCAT(...) str_concat((char *[]){__VA_ARGS__, NULL})
+#include <stddef.h>
+
+#define STR_CONCAT(...) str_concat((const char *[]){__VA_ARGS__, NULL})
 
 /*
  * Concatenate a sequence of null-terminated strings into a single string.
@@ -9,6 +11,18 @@
  *
  * The returned string is allocated from the heap.
  */
-char *str_concat(char **);
+char *str_concat(const char **);
+
+/*
+ * Heap allocation, as malloc(), calloc(), realloc() and free().
+ *
+ * Each block allocated and freed is recorded by the compiler's instrumentation
+ * (acc -t), under the running timer. A block from xmalloc(), xcalloc() or
+ * xrealloc() must be resized with xrealloc(), and freed with xfree().
+ */
+void *xmalloc(size_t size);
+void *xcalloc(size_t count, size_t size);
+void *xrealloc(void *ptr, size_t size);
+void xfree(void *ptr);
 
 #endif
\ No newline at end of file
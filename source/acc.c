@@ -6,6 +6,7 @@
 
 #include "analysis.h"
 #include "error.h"
+#include "intern.h"
 #include "ir.h"
 #include "ir_gen.h"
 #include "parser.h"
@@ -13,7 +14,11 @@
 #include "scanner.h"
 #include "symbol.h"
 #include "liveness.h"
+#include "optimise.h"
 #include "regalloc.h"
+#include "ssa.h"
+#include "timing.h"
+#include "util.h"
 #include "version.h"
 
 #ifndef GIT_COMMIT
@@ -49,6 +54,9 @@ typedef struct CommandLineArgs_t
     _Bool json;
     _Bool check_only;
     _Bool omit_regalloc;
+    _Bool timing;
+    int error_limit;
+    int optimise_level;
     const char *ir_output;
 } CommandLineArgs;
 
@@ -72,6 +80,9 @@ static void help(const char *exe_path)
     printf("  -c check only (do not compile)\n");
     printf("  -i [FILE] Save Intermediate Representation (IR) output to file\n");
     printf("  -r omit register allocation (use virtual register allocations)\n");
+    printf("  -t report time and memory used by each phase (on stderr)\n");
+    printf("  -e [N] stop after N errors\n");
+    printf("  -O [N] optimisation level (0: none, 1: default)\n");
     printf("\n");
     printf("[FILE] is a file path to the C source file which will be compiled\n");
     printf("(use '-' to read from stdin).\n\n");
@@ -97,14 +108,36 @@ static _Bool parse_cmd_args(int argc, char **argv, struct CommandLineArgs_t *arg
     args->json = false;
     args->check_only = false;
     args->omit_regalloc = false;
+    args->timing = false;
+    args->error_limit = 0;
+    args->optimise_level = 1;
 
-    while ((c = getopt(argc, argv, "rvhjci:")) != -1)
+    while ((c = getopt(argc, argv, "rvhjcte:i:O:")) != -1)
     {
         switch (c)
         {
         case 'r':
             args->omit_regalloc = true;
             break;
+        case 't':
+            args->timing = true;
+            break;
+        case 'e':
+            args->error_limit = atoi(optarg);
+            if (args->error_limit <= 0)
+            {
+                printf("-e must be a positive number of errors\n");
+                exit(1);
+            }
+            break;
+        case 'O':
+            args->optimise_level = atoi(optarg);
+            if (args->optimise_level < 0)
+            {
+                printf("-O must be a non-negative optimisation level\n");
+                exit(1);
+            }
+            break;
         case 'h':
             help(argv[0]);
             exit(0);
@@ -140,10 +173,11 @@ static _Bool parse_cmd_args(int argc, char **argv, struct CommandLineArgs_t *arg
     args->source_file = argv[optind];
 }
 
-static char *read_source_stdin()
+static char *read_source_stdin(int *length)
 {
-    // Read from stdin in 256-byte chunks.
-    char *source_buf = malloc(STDIN_READ_CHUNK_SIZE + 1);
+    // Read from stdin in 256-byte chunks, doubling the buffer as it fills.
+    int buf_size = STDIN_READ_CHUNK_SIZE;
+    char *source_buf = xmalloc(buf_size + 1);
 
     for (int read_offset = 0;;)
     {
@@ -151,17 +185,22 @@ static char *read_source_stdin()
         if (read_size != STDIN_READ_CHUNK_SIZE)
         {
             source_buf[read_offset + read_size] = '\0';
+            *length = read_offset + read_size;
             return source_buf;
         }
         else
         {
             read_offset += STDIN_READ_CHUNK_SIZE;
-            source_buf = realloc(source_buf, read_offset + STDIN_READ_CHUNK_SIZE + 1);
+            if (read_offset + STDIN_READ_CHUNK_SIZE > buf_size)
+            {
+                buf_size *= 2;
+                source_buf = xrealloc(source_buf, buf_size + 1);
+            }
         }
     }
 }
 
-static char *read_source_file(const char *path)
+static char *read_source_file(const char *path, int *length)
 {
     char *file_contents = NULL;
     FILE *f = fopen(path, "r");
@@ -182,7 +221,7 @@ static char *read_source_file(const char *path)
     }
 
     // Allocate storage space on the heap for the file.
-    file_contents = calloc(fsize + 1, 1);
+    file_contents = xcalloc(fsize + 1, 1);
     if (!file_contents)
     {
         printf("Unable to allocate sufficient space for the file\n");
@@ -194,36 +233,43 @@ static char *read_source_file(const char *path)
         goto err;
     fclose(f);
 
+    *length = fsize;
     return file_contents;
 err:
     if (file_contents)
-        free(file_contents);
+        xfree(file_contents);
     printf("Unable to read source file:\n%s\n", strerror(errno));
     return NULL;
 }
 
-static char *read_source(const char *path)
+/*
+ * Read the source input, from file or stdin. The returned buffer is
+ * '\0'-terminated, and 'length' is set to the size of the source.
+ */
+static char *read_source(const char *path, int *length)
 {
     if (*path == '-')
     {
-        return read_source_stdin();
+        return read_source_stdin(length);
     }
     else
     {
-        return read_source_file(path);
+        return read_source_file(path, length);
     }
 }
 
-static AccCompiler *compiler_init(const char *path)
+static AccCompiler *compiler_init(const char *path, int error_limit)
 {
-    char *src = read_source(path);
+    int src_length;
+    char *src = read_source(path, &src_length);
     if (!src)
         return NULL;
 
-    AccCompiler *compiler = calloc(1, sizeof(AccCompiler));
+    AccCompiler *compiler = xcalloc(1, sizeof(AccCompiler));
     compiler->source = src;
     compiler->error_reporter = Error_init();
-    compiler->scanner = Scanner_init(src, compiler->error_reporter);
+    Error_set_limit(compiler->error_reporter, error_limit);
+    compiler->scanner = Scanner_init_n(src, src_length, compiler->error_reporter);
     compiler->parser = Parser_init(compiler->scanner, compiler->error_reporter);
     compiler->tab = symbol_table_create(NULL);
 
@@ -263,7 +309,7 @@ static void print_error_commandline(ErrorType type, const char *line, int line_n
                                     int pos, char *msg)
 {
     int line_len = strchr(line, '\n') - line;
-    char *line_cpy = malloc(line_len + 1);
+    char *line_cpy = xmalloc(line_len + 1);
     strncpy(line_cpy, line, line_len);
     line_cpy[line_len] = '\0';
 
@@ -324,6 +370,10 @@ static void compiler_print_errors(AccCompiler *compiler, _Bool json)
     if (!json)
     {
         printf("%d errors reported in total.\n", errors);
+        if (Error_limit_reached(compiler->error_reporter))
+        {
+            printf("Stopped after reaching the error limit.\n");
+        }
     }
     else
     {
@@ -336,7 +386,8 @@ static void compiler_destroy(AccCompiler *compiler)
     Error_destroy(compiler->error_reporter);
     Parser_destroy(compiler->parser);
     Scanner_destroy(compiler->scanner);
-    free(compiler->source);
+    Intern_destroy();
+    xfree(compiler->source);
 }
 
 int main(int argc, char **argv)
@@ -347,16 +398,31 @@ int main(int argc, char **argv)
 
     parse_cmd_args(argc, argv, &args);
 
-    if (!(compiler = compiler_init(args.source_file)))
+    if (args.timing)
+    {
+        Timing_enable();
+    }
+
+    Timing_start("read");
+    compiler = compiler_init(args.source_file, args.error_limit);
+    Timing_stop();
+    if (!compiler)
     {
         return 1;
     }
 
     // Generate the AST, from the source input.
+    Timing_start("parse");
     DeclAstNode *ast_root = compiler_parse(compiler);
+    Timing_stop();
 
-    // Context-sensitive analysis on the AST.
-    compiler_analysis(compiler, ast_root);
+    // Context-sensitive analysis on the AST (unless parsing already stopped early).
+    if (!Error_limit_reached(compiler->error_reporter))
+    {
+        Timing_start("analysis");
+        compiler_analysis(compiler, ast_root);
+        Timing_stop();
+    }
 
     // Check if errors occurred during scanning/parsing/analysis.
     // Abort if we cannot proceed.
@@ -373,8 +439,62 @@ int main(int argc, char **argv)
     }
 
     // Compiler to IR
+    Timing_start("ir_gen");
     IrFunction *ir_program = Ir_generate(ast_root, compiler->tab);
+    Timing_stop();
+
+    // Optimisation passes.
+    if (args.optimise_level >= 1)
+    {
+        Timing_start("constant_folding");
+        Optimise_constant_folding(ir_program);
+        Timing_stop();
+
+        Timing_start("copy_propagation");
+        Optimise_copy_propagation(ir_program);
+        Timing_stop();
+
+        Timing_start("dead_code");
+        Optimise_dead_code(ir_program);
+        Timing_stop();
+
+        // Passes relying on SSA form run between construction and destruction.
+        Timing_start("ssa");
+        Ssa_construct(ir_program);
+        Timing_stop();
+
+        Timing_start("value_numbering");
+        Optimise_value_numbering(ir_program);
+        Timing_stop();
+
+        Timing_start("loop_invariant_code_motion");
+        Optimise_loop_invariant_code_motion(ir_program);
+        Timing_stop();
+
+        Timing_start("induction_variables");
+        Optimise_induction_variables(ir_program);
+        Timing_stop();
+
+        Timing_start("out_of_ssa");
+        Ssa_destruct(ir_program);
+        Timing_stop();
+
+        Timing_start("addressing_modes");
+        Optimise_addressing_modes(ir_program);
+        Timing_stop();
+
+        Timing_start("branch_fusion");
+        Optimise_branch_fusion(ir_program);
+        Timing_stop();
+
+        Timing_start("block_layout");
+        Optimise_block_layout(ir_program);
+        Timing_stop();
+    }
+
+    Timing_start("liveness");
     Liveness_analysis(ir_program);
+    Timing_stop();
 
     // Register set.
     int * free_register_set = NULL;
@@ -383,11 +503,14 @@ int main(int argc, char **argv)
     if (!args.omit_regalloc)
     {
         free_register_set = (int[]){4,5,6,7,8,9,10,11,12,-1};
+        Timing_start("regalloc");
         regalloc(ir_program, free_register_set);
+        Timing_stop();
     }
 
     if (args.ir_output)
     {
+        Timing_start("ir_output");
         if(strcmp(args.ir_output, "-") == 0)
         {
             Ir_to_str(stdout, ir_program, free_register_set);
@@ -398,12 +521,20 @@ int main(int argc, char **argv)
             Ir_to_str(ir_fh, ir_program, free_register_set);
             fclose(ir_fh);
         }
-        return 0;
+        Timing_stop();
+        goto tidyup;
     }
 
+    Timing_start("asm_gen");
     assembly_gen(stdout, ir_program);
+    Timing_stop();
 
 tidyup:
+    if (args.timing)
+    {
+        fflush(stdout);
+        Timing_report(stderr, args.json);
+    }
     compiler_destroy(compiler);
     return err;
 }
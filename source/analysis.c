@@ -112,7 +112,7 @@ static const OpRequirements binary_op_requirements[] = {
 
 static ExprAstNode *create_cast(ExprAstNode *node, CType *to, CType *from)
 {
-    ExprAstNode *cast_node = calloc(1, sizeof(ExprAstNode));
+    ExprAstNode *cast_node = xcalloc(1, sizeof(ExprAstNode));
     cast_node->type = CAST;
     cast_node->cast.to = to;
     cast_node->cast.from = from;
@@ -170,7 +170,7 @@ static CType *integer_promote(ExprAstNode **node, CType *ctype)
     }
 
     // Since ACC doesn't support long, all other types have a lower rank than int.
-    CType *cast_type = calloc(1, sizeof(CType));
+    CType *cast_type = xcalloc(1, sizeof(CType));
     cast_type->type = TYPE_BASIC;
     cast_type->basic.type_specifier = TYPE_SIGNED_INT;
 
@@ -217,11 +217,11 @@ static CType *walk_expr_primary(ErrorReporter *error, ExprAstNode *node, SymbolT
         return &int_type;
     }
 
-    Symbol *sym = symbol_table_get(tab, node->primary.identifier->lexeme, true);
+    Symbol *sym = symbol_table_get(tab, node->primary.identifier->name, true);
     if (sym == NULL)
     {
         char *err =
-            STR_CONCAT("Undeclared identifier '", node->primary.identifier->lexeme, "'");
+            STR_CONCAT("Undeclared identifier '", node->primary.identifier->name, "'");
         Error_report_error(error, ANALYSIS, node->pos, err);
         return NULL;
     }
@@ -229,7 +229,7 @@ static CType *walk_expr_primary(ErrorReporter *error, ExprAstNode *node, SymbolT
 
     if (node->primary.symbol->type->type == TYPE_ARRAY)
     {
-        CType *ptr_type = calloc(1, sizeof(CType));
+        CType *ptr_type = xcalloc(1, sizeof(CType));
         ptr_type->type = TYPE_POINTER;
         ptr_type->derived.type = node->primary.symbol->type->derived.type;
         return ptr_type;
@@ -416,7 +416,7 @@ static CType *walk_expr_unary(ErrorReporter *error, ExprAstNode *node, SymbolTab
         }
 
         // Address-of operator.
-        CType *addr_of = calloc(1, sizeof(CType));
+        CType *addr_of = xcalloc(1, sizeof(CType));
         addr_of->type = TYPE_POINTER;
         addr_of->derived.type = ctype;
 
@@ -537,7 +537,7 @@ static CType *walk_expr(ErrorReporter *error, ExprAstNode *node, SymbolTable *ta
 
 static void walk_decl_function(ErrorReporter *error, DeclAstNode *node, SymbolTable *tab)
 {
-    Symbol * fn = symbol_table_get(tab, node->identifier->lexeme, false);
+    Symbol * fn = symbol_table_get(tab, node->identifier->name, false);
 
     if(fn)
     {
@@ -559,7 +559,7 @@ static void walk_decl_function(ErrorReporter *error, DeclAstNode *node, SymbolTa
     }
     else if(!fn)
     {
-        node->symbol = symbol_table_put(tab, node->identifier->lexeme, node->type);
+        node->symbol = symbol_table_put(tab, node->identifier->name, node->type);
         node->symbol->type = node->type;
     }
     
@@ -573,8 +573,8 @@ static void walk_decl_function(ErrorReporter *error, DeclAstNode *node, SymbolTa
         for (ParameterListItem *param = node->type->derived.params; param != NULL;
              param = param->next)
         {
-            *ptr = calloc(1, sizeof(ActualParameterListItem));
-            (*ptr)->sym = symbol_table_put(ft, param->name->lexeme, param->type);
+            *ptr = xcalloc(1, sizeof(ActualParameterListItem));
+            (*ptr)->sym = symbol_table_put(ft, param->name->name, param->type);
 
             ptr = &((*ptr)->next);
         }
@@ -584,17 +584,17 @@ static void walk_decl_function(ErrorReporter *error, DeclAstNode *node, SymbolTa
 
 static void walk_decl_object(ErrorReporter *error, DeclAstNode *node, SymbolTable *tab)
 {
-    if(symbol_table_get(tab, node->identifier->lexeme, false))
+    if(symbol_table_get(tab, node->identifier->name, false))
     {
         // Check if there is already a symbol table entry for this
         // identifier within the current scope.
         char *err =
-            STR_CONCAT("Previously declared identifier '", node->identifier->lexeme, "'");
+            STR_CONCAT("Previously declared identifier '", node->identifier->name, "'");
         Error_report_error(error, ANALYSIS, node->pos, err);
         return;
     }
 
-    node->symbol = symbol_table_put(tab, node->identifier->lexeme, node->type);
+    node->symbol = symbol_table_put(tab, node->identifier->name, node->type);
     node->symbol->type = node->type;
 
     if (node->initializer)
@@ -624,7 +624,7 @@ static void walk_decl(ErrorReporter *error, DeclAstNode *node, SymbolTable *tab,
     {
         // Check if we're trying to define a function within a function.
         char *err = STR_CONCAT("Cannot have nested functions ('",
-                               node->identifier->lexeme, "'). Try Rust?");
+                               node->identifier->name, "'). Try Rust?");
         Error_report_error(error, ANALYSIS, node->pos, err);
     }
     else
@@ -639,6 +639,10 @@ static void walk_decl(ErrorReporter *error, DeclAstNode *node, SymbolTable *tab,
         }
     }
 
+    // Stop at the next top-level declaration once the error limit is reached.
+    if (tu && Error_limit_reached(error))
+        return;
+
     if (node->next)
         walk_decl(error, node->next, tab, tu);
 }
@@ -1,6 +1,10 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "ir.h"
+#include "output.h"
 #include "version.h"
 
 #define HEADER                \
@@ -11,27 +15,153 @@
 
 #define INDENT "    "
 
-static void function_enter(FILE * fd, IrFunction * function)
+// Scratch register, for immediate values which cannot be encoded in an instruction.
+// lr is saved on function entry, and is otherwise only used by calls.
+#define SCRATCH_REG 14
+
+static void function_enter(Output * out, IrFunction * function)
 {
     // Store all registers except r0, r1, r2, r3.
-    fprintf(fd, INDENT "push {r4,r5,r6,r7,r8,r9,r10,r11,lr}\n");
+    Output_format(out, INDENT "push {r4,r5,r6,r7,r8,r9,r10,r11,lr}\n");
 
     // Decrement the stack pointer.
-    fprintf(fd, INDENT "sub sp, sp, #%u\n", function->stack_size);
+    Output_format(out, INDENT "sub sp, sp, #%u\n", function->stack_size);
 }
 
-static void function_exit(FILE * fd, IrFunction * function)
+static void function_exit(Output * out, IrFunction * function)
 {
     // Increment the stack pointer.
     for(int shift=0;shift < 32;shift += 8)
     {
-        fprintf(fd, INDENT "add sp, sp, #%u\n", function->stack_size & (0xFF << shift));
+        Output_format(out, INDENT "add sp, sp, #%u\n", function->stack_size & (0xFF << shift));
     }
 
     // Function postamble.
     // Pop all registers except r0, r1, r2, r3 off the stack and branch.
-    fprintf(fd, INDENT "pop {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
-    fprintf(fd, INDENT "bx lr\n");
+    Output_format(out, INDENT "pop {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
+    Output_format(out, INDENT "bx lr\n");
+}
+
+/*
+ * Check if a value can be encoded as an A32 modified immediate (an 8-bit value,
+ * rotated right by an even number of bits).
+ */
+static bool immediate_encodable(uint32_t value)
+{
+    for(int rotate = 0;rotate < 32;rotate += 2)
+    {
+        uint32_t rotated = (value << rotate) | (value >> ((32 - rotate) & 31));
+        if(rotated < 256) return true;
+    }
+    return false;
+}
+
+static void load_constant(Output * out, int reg, int constant)
+{
+    if(immediate_encodable(constant))
+    {
+        Output_format(out, INDENT "mov r%d, #%u\n", reg, constant);
+        return;
+    }
+    if(immediate_encodable(~constant))
+    {
+        Output_format(out, INDENT "mvn r%d, #%u\n", reg, ~constant);
+        return;
+    }
+
+    bool movop = true;
+    for(int shift = 0;shift < 32;shift += 8)
+    {
+        int imm = constant & (0xFF << shift);
+        if(movop && imm)
+        {
+            Output_format(out, INDENT "mov r%d, #%d\n", reg, imm);
+            movop = false;
+        }
+        else if(imm)
+        {
+            Output_format(out, INDENT "orr r%d, r%d, #%d\n", reg, reg, imm);
+        }
+    }
+}
+
+/*
+ * Arithmetic instructions with an immediate operand:
+ * - IR_ADD
+ * - IR_SUB
+ * - IR_SLL
+ * - IR_SLR
+ * - IR_OR
+ * - IR_AND
+ * - IR_XOR
+ * Immediates which cannot be encoded (directly, or by using the complementary
+ * instruction) are loaded into the scratch register.
+ */
+static void arithmetic_immediate(Output * out, IrInstruction * instr)
+{
+    int dest = instr->dest->index, left = instr->left->index;
+    uint32_t value = instr->value;
+    char * op = NULL;
+
+    switch(instr->op) {
+        case IR_ADD:
+        case IR_SUB:
+            op = instr->op == IR_ADD ? "add" : "sub";
+            if(!immediate_encodable(value) && immediate_encodable(-value))
+            {
+                op = instr->op == IR_ADD ? "sub" : "add";
+                value = -value;
+            }
+            break;
+
+        case IR_SLL:
+        case IR_SLR:
+            // Shifts of 32 or more use the register form (as in C, these are
+            // undefined, but the register form matches the non-immediate IR).
+            op = instr->op == IR_SLL ? "lsl" : "lsr";
+            if(value < 32)
+            {
+                Output_format(out, INDENT "%s r%d, r%d, #%u\n", op, dest, left, value);
+            }
+            else
+            {
+                load_constant(out, SCRATCH_REG, value);
+                Output_format(out, INDENT "%s r%d, r%d, r%d\n", op, dest, left, SCRATCH_REG);
+            }
+            return;
+
+        case IR_OR:
+            op = "orr";
+            break;
+
+        case IR_AND:
+            op = "and";
+            if(value == 0xFFFF)
+            {
+                Output_format(out, INDENT "uxth r%d, r%d\n", dest, left);
+                return;
+            }
+            if(!immediate_encodable(value) && immediate_encodable(~value))
+            {
+                op = "bic";
+                value = ~value;
+            }
+            break;
+
+        case IR_XOR:
+            op = "eor";
+            break;
+    }
+
+    if(immediate_encodable(value))
+    {
+        Output_format(out, INDENT "%s r%d, r%d, #%u\n", op, dest, left, value);
+    }
+    else
+    {
+        load_constant(out, SCRATCH_REG, instr->value);
+        Output_format(out, INDENT "%s r%d, r%d, r%d\n", op, dest, left, SCRATCH_REG);
+    }
 }
 
 /*
@@ -48,8 +178,14 @@ static void function_exit(FILE * fd, IrFunction * function)
  * - IR_FLIP
  * - IR_XOR
  */
-static void arithmetic(FILE * fd, IrInstruction * instr)
+static void arithmetic(Output * out, IrInstruction * instr)
 {
+    if(instr->immediate)
+    {
+        arithmetic_immediate(out, instr);
+        return;
+    }
+
     char * op;
     switch(instr->op) {
         case IR_ADD:
@@ -65,9 +201,9 @@ static void arithmetic(FILE * fd, IrInstruction * instr)
             op = "sdiv";
             break;
         case IR_MOD:
-            fprintf(fd, INDENT "sdiv r%d, r%d, r%d\n", instr->dest->index, instr->left->index, instr->right->index);
-            fprintf(fd, INDENT "mul r%d, r%d, r%d\n", instr->dest->index, instr->dest->index, instr->right->index);
-            fprintf(fd, INDENT "sub r%d, r%d, r%d\n", instr->dest->index, instr->left->index, instr->dest->index);
+            Output_format(out, INDENT "sdiv r%d, r%d, r%d\n", instr->dest->index, instr->left->index, instr->right->index);
+            Output_format(out, INDENT "mul r%d, r%d, r%d\n", instr->dest->index, instr->dest->index, instr->right->index);
+            Output_format(out, INDENT "sub r%d, r%d, r%d\n", instr->dest->index, instr->left->index, instr->dest->index);
             return;
         case IR_SLL:
             op = "lsl";
@@ -86,21 +222,48 @@ static void arithmetic(FILE * fd, IrInstruction * instr)
             break;
 
         case IR_NOT:
-            fprintf(fd, INDENT "cmp r%d, #0\n", instr->left->index);
-            fprintf(fd, INDENT "moveq r%d, #1\n", instr->dest->index);
-            fprintf(fd, INDENT "movne r%d, #0\n", instr->dest->index);
+            Output_format(out, INDENT "cmp r%d, #0\n", instr->left->index);
+            Output_format(out, INDENT "moveq r%d, #1\n", instr->dest->index);
+            Output_format(out, INDENT "movne r%d, #0\n", instr->dest->index);
             return;
 
         case IR_FLIP:
-            fprintf(fd, INDENT "mvn r%d, #0\n", instr->dest->index);
-            fprintf(fd, INDENT "eor r%d, r%d, r%d\n", instr->dest->index, instr->dest->index, instr->left->index);
+            Output_format(out, INDENT "mvn r%d, #0\n", instr->dest->index);
+            Output_format(out, INDENT "eor r%d, r%d, r%d\n", instr->dest->index, instr->dest->index, instr->left->index);
             return;
 
         case IR_XOR:
             op = "eor";
             break;
     }
-    fprintf(fd, INDENT "%s r%d, r%d, r%d\n", op, instr->dest->index, instr->left->index, instr->right->index);
+    Output_format(out, INDENT "%s r%d, r%d, r%d\n", op, instr->dest->index, instr->left->index, instr->right->index);
+}
+
+/*
+ * Compare the left operand with the right operand (or immediate value), setting
+ * the condition flags.
+ */
+static void compare(Output * out, IrInstruction * instr)
+{
+    uint32_t value = instr->value;
+
+    if(!instr->immediate)
+    {
+        Output_format(out, INDENT "cmp r%d, r%d\n", instr->left->index, instr->right->index);
+    }
+    else if(immediate_encodable(value))
+    {
+        Output_format(out, INDENT "cmp r%d, #%u\n", instr->left->index, value);
+    }
+    else if(immediate_encodable(-value))
+    {
+        Output_format(out, INDENT "cmn r%d, #%u\n", instr->left->index, -value);
+    }
+    else
+    {
+        load_constant(out, SCRATCH_REG, value);
+        Output_format(out, INDENT "cmp r%d, r%d\n", instr->left->index, SCRATCH_REG);
+    }
 }
 
 /*
@@ -109,24 +272,25 @@ static void arithmetic(FILE * fd, IrInstruction * instr)
  * - IR_LT
  * - IR_LE
  */
-static void comparison(FILE * fd, IrInstruction * instr)
+static void comparison(Output * out, IrInstruction * instr)
 {
-    fprintf(fd, INDENT "cmp r%d, r%d\n", instr->left->index, instr->right->index);
+    compare(out, instr);
+
     switch(instr->op)
     {
         case IR_EQ:
-            fprintf(fd, INDENT "moveq r%d, #1\n", instr->dest->index);
-            fprintf(fd, INDENT "movne r%d, #0\n", instr->dest->index);
+            Output_format(out, INDENT "moveq r%d, #1\n", instr->dest->index);
+            Output_format(out, INDENT "movne r%d, #0\n", instr->dest->index);
             break;
         
         case IR_LT:
-            fprintf(fd, INDENT "movlt r%d, #1\n", instr->dest->index);
-            fprintf(fd, INDENT "movge r%d, #0\n", instr->dest->index);
+            Output_format(out, INDENT "movlt r%d, #1\n", instr->dest->index);
+            Output_format(out, INDENT "movge r%d, #0\n", instr->dest->index);
             break;
         
         case IR_LE:
-            fprintf(fd, INDENT "movle r%d, #1\n", instr->dest->index);
-            fprintf(fd, INDENT "movgt r%d, #0\n", instr->dest->index);
+            Output_format(out, INDENT "movle r%d, #1\n", instr->dest->index);
+            Output_format(out, INDENT "movgt r%d, #0\n", instr->dest->index);
             break;
     }
 }
@@ -136,15 +300,15 @@ static void comparison(FILE * fd, IrInstruction * instr)
  * - IR_SIGN_EXTEND_8
  * - IR_SIGN_EXTEND_16
  */
-static void sign_extend(FILE * fd, IrInstruction * instr)
+static void sign_extend(Output * out, IrInstruction * instr)
 {
     switch(instr->op)
     {
         case IR_SIGN_EXTEND_16:
-            fprintf(fd, INDENT "sxth r%d, r%d\n", instr->dest->index, instr->left->index);
+            Output_format(out, INDENT "sxth r%d, r%d\n", instr->dest->index, instr->left->index);
             break;
         case IR_SIGN_EXTEND_8:
-            fprintf(fd, INDENT "sxtb r%d, r%d\n", instr->dest->index, instr->left->index);
+            Output_format(out, INDENT "sxtb r%d, r%d\n", instr->dest->index, instr->left->index);
             break;
     }
 }
@@ -152,9 +316,65 @@ static void sign_extend(FILE * fd, IrInstruction * instr)
 /*
  * IR_MOV instruction
  */
-static void move(FILE * fd, IrInstruction * instr)
+static void move(Output * out, IrInstruction * instr)
 {
-    fprintf(fd, INDENT "mov r%d, r%d\n", instr->dest->index, instr->left->index);
+    Output_format(out, INDENT "mov r%d, r%d\n", instr->dest->index, instr->left->index);
+}
+
+/*
+ * Load/store using the instruction's address: [rn], [rn, rm, lsl #shift], or
+ * [rn, #offset], where rn is sp if there is no base register. Halfword transfers
+ * have no shifted register form, and a smaller offset range, so other addresses
+ * are calculated in the scratch register. Post-indexed transfers ([rn], #offset)
+ * increment rn after the access.
+ */
+static void memory(Output * out, const char * op, int reg, IrInstruction * instr)
+{
+    bool halfword = instr->op == IR_LOAD16 || instr->op == IR_STORE16;
+    char base[8] = "sp";
+    if(instr->left)
+        sprintf(base, "r%d", instr->left->index);
+
+    if(instr->post_index)
+    {
+        // Writeback to the transfer register is unpredictable, but rn can only
+        // share it if rn is no longer live.
+        if(reg == instr->left->index)
+            Output_format(out, INDENT "%s r%d, [%s]\n", op, reg, base);
+        else
+            Output_format(out, INDENT "%s r%d, [%s], #%d\n", op, reg, base, instr->value);
+    }
+    else if(instr->index && (instr->shift == 0 || !halfword))
+    {
+        if(instr->shift)
+            Output_format(out, INDENT "%s r%d, [%s, r%d, lsl #%d]\n", op, reg, base,
+                          instr->index->index, instr->shift);
+        else
+            Output_format(out, INDENT "%s r%d, [%s, r%d]\n", op, reg, base, instr->index->index);
+    }
+    else if(instr->index)
+    {
+        Output_format(out, INDENT "add r%d, %s, r%d, lsl #%d\n", SCRATCH_REG, base,
+                      instr->index->index, instr->shift);
+        Output_format(out, INDENT "%s r%d, [r%d]\n", op, reg, SCRATCH_REG);
+    }
+    else if(instr->immediate)
+    {
+        int limit = halfword ? 255 : 4095;
+        if(instr->value >= -limit && instr->value <= limit)
+        {
+            Output_format(out, INDENT "%s r%d, [%s, #%d]\n", op, reg, base, instr->value);
+        }
+        else
+        {
+            load_constant(out, SCRATCH_REG, instr->value);
+            Output_format(out, INDENT "%s r%d, [%s, r%d]\n", op, reg, base, SCRATCH_REG);
+        }
+    }
+    else
+    {
+        Output_format(out, INDENT "%s r%d, [%s]\n", op, reg, base);
+    }
 }
 
 /*
@@ -163,18 +383,18 @@ static void move(FILE * fd, IrInstruction * instr)
  * - IR_STORE16
  * - IR_STORE32
  */
-static void store(FILE * fd, IrInstruction * instr)
+static void store(Output * out, IrInstruction * instr)
 {
     switch(instr->op)
     {
         case IR_STORE32:
-            fprintf(fd, INDENT "str r%d, [r%d]\n", instr->right->index, instr->left->index);
+            memory(out, "str", instr->right->index, instr);
             break;
         case IR_STORE16:
-            fprintf(fd, INDENT "strh r%d, [r%d]\n", instr->right->index, instr->left->index);
+            memory(out, "strh", instr->right->index, instr);
             break;
         case IR_STORE8:
-            fprintf(fd, INDENT "strb r%d, [r%d]\n", instr->right->index, instr->left->index);
+            memory(out, "strb", instr->right->index, instr);
             break;
     }
 }
@@ -186,98 +406,126 @@ static void store(FILE * fd, IrInstruction * instr)
  * - IR_LOAD16
  * - IR_LOAD32
  */
-static void load(FILE * fd, IrInstruction * instr)
+static void load(Output * out, IrInstruction * instr)
 {
     switch(instr->op)
     {
         case IR_LOAD32:
-            fprintf(fd, INDENT "ldr r%d, [r%d]\n", instr->dest->index, instr->left->index);
+            memory(out, "ldr", instr->dest->index, instr);
             break;
         case IR_LOAD16:
-            fprintf(fd, INDENT "ldrh r%d, [r%d]\n", instr->dest->index, instr->left->index);
+            memory(out, "ldrh", instr->dest->index, instr);
             break;
         case IR_LOAD8:
-            fprintf(fd, INDENT "ldrb r%d, [r%d]\n", instr->dest->index, instr->left->index);
+            memory(out, "ldrb", instr->dest->index, instr);
             break;
     }
 }
 
-static void load_constant(FILE * fd, IrRegister * reg, int constant)
-{
-    bool movop = true;
-    for(int shift = 0;shift < 32;shift += 8)
-    {
-        int imm = constant & (0xFF << shift);
-        if(movop && imm)
-        {
-            fprintf(fd, INDENT "mov r%d, #%d\n", reg->index, imm);
-            movop = false;
-        }
-        else if(imm)
-        {
-            fprintf(fd, INDENT "orr r%d, r%d, #%d\n", reg->index, reg->index, imm);
-        }
-    }
-    if(movop)
-    {
-        // Load all zero's.
-        fprintf(fd, INDENT "mov r%d, #0\n", reg->index);
-    }
-}
-
 /*
  * IR_LOADI instruction
  */
-static void loadi(FILE * fd, IrInstruction * instr)
+static void loadi(Output * out, IrInstruction * instr)
 {
-    load_constant(fd, instr->dest, instr->value);
+    load_constant(out, instr->dest->index, instr->value);
 }
 
 /*
  * IR_LOADSO instruction
  */
-static void loadso(FILE * fd, IrInstruction * instr)
+static void loadso(Output * out, IrInstruction * instr)
 {
+    if(immediate_encodable(instr->value))
+    {
+        Output_format(out, INDENT "add r%d, sp, #%d\n", instr->dest->index, instr->value);
+        return;
+    }
+
     // Load the offset first.
-    load_constant(fd, instr->dest, instr->value);
+    load_constant(out, instr->dest->index, instr->value);
     
     // Add the SP
-    fprintf(fd, INDENT "add r%d, r%d, sp\n", instr->dest->index, instr->dest->index);
+    Output_format(out, INDENT "add r%d, r%d, sp\n", instr->dest->index, instr->dest->index);
 }
 
 /* 
  * Control instructions:
  * - IR_BRANCHZ
  * - IR_JUMP
+ * - IR_BRANCH_EQ
+ * - IR_BRANCH_LT
+ * - IR_BRANCH_LE
  * - IR_CALL
  * - IR_RETURN
+ * Branches to the next basic block ('next') fall through instead, inverting
+ * the condition if needed.
  */
-static void control(FILE * fd, IrInstruction * instr)
+static void control(Output * out, IrInstruction * instr, IrBasicBlock * next)
 {
+    // Branch conditions (and their inverse).
+    const char * condition = NULL, * inverse = NULL;
+    IrBasicBlock * jump_true = instr->control.jump_true;
+    IrBasicBlock * jump_false = instr->control.jump_false;
+
     switch(instr->op)
     {
         case IR_BRANCHZ:
-            fprintf(fd, INDENT "cmp r%d, #0\n", instr->left->index);
-            fprintf(fd, INDENT "bne _bb_%d\n", instr->control.jump_true->index);
-            fprintf(fd, INDENT "b _bb_%d\n", instr->control.jump_false->index);
+            Output_format(out, INDENT "cmp r%d, #0\n", instr->left->index);
+            condition = "ne";
+            inverse = "eq";
             break;
-        
-        case IR_JUMP:
-            fprintf(fd, INDENT "b _bb_%d\n", instr->control.jump_true->index);
+
+        case IR_BRANCH_EQ:
+            compare(out, instr);
+            condition = "eq";
+            inverse = "ne";
             break;
 
-        case IR_CALL:
-            fprintf(fd, INDENT "bl %s\n", instr->control.callee->name);
+        case IR_BRANCH_LT:
+            compare(out, instr);
+            condition = "lt";
+            inverse = "ge";
             break;
+
+        case IR_BRANCH_LE:
+            compare(out, instr);
+            condition = "le";
+            inverse = "gt";
+            break;
+
+        case IR_JUMP:
+            if(jump_true != next)
+                Output_format(out, INDENT "b _bb_%d\n", jump_true->index);
+            return;
+
+        case IR_CALL:
+            Output_format(out, INDENT "bl %s\n", instr->control.callee->name);
+            return;
+    }
+
+    if(jump_true == jump_false)
+    {
+        if(jump_true != next)
+            Output_format(out, INDENT "b _bb_%d\n", jump_true->index);
+    }
+    else if(jump_true == next)
+    {
+        Output_format(out, INDENT "b%s _bb_%d\n", inverse, jump_false->index);
+    }
+    else
+    {
+        Output_format(out, INDENT "b%s _bb_%d\n", condition, jump_true->index);
+        if(jump_false != next)
+            Output_format(out, INDENT "b _bb_%d\n", jump_false->index);
     }
 }
 
 /*
  * Single basic block (including label)
  */
-static void basic_block(FILE * fd, IrFunction * function, IrBasicBlock * bb)
+static void basic_block(Output * out, IrFunction * function, IrBasicBlock * bb)
 {
-    fprintf(fd, "_bb_%d:\n", bb->index);
+    Output_format(out, "_bb_%d:\n", bb->index);
     for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
     {
         switch(instr->op)
@@ -294,54 +542,59 @@ static void basic_block(FILE * fd, IrFunction * function, IrBasicBlock * bb)
             case IR_NOT:
             case IR_FLIP:
             case IR_XOR:
-                arithmetic(fd, instr);
+                arithmetic(out, instr);
                 break;
 
             case IR_EQ:
             case IR_LT:
             case IR_LE:
-                comparison(fd, instr);
+                comparison(out, instr);
                 break;
 
             case IR_SIGN_EXTEND_8:
             case IR_SIGN_EXTEND_16:
-                sign_extend(fd, instr);
+                sign_extend(out, instr);
+                break;
 
             case IR_MOV:
-                move(fd, instr);
+                move(out, instr);
                 break;
 
             case IR_STORE8:
             case IR_STORE16:
             case IR_STORE32:
-                store(fd, instr);
+                store(out, instr);
                 break;
 
             case IR_LOAD8:
             case IR_LOAD16:
             case IR_LOAD32:
-                load(fd, instr);
+                load(out, instr);
                 break;
 
             case IR_LOADI:
-                loadi(fd, instr);
+                loadi(out, instr);
                 break;
 
             case IR_LOADSO:
-                loadso(fd, instr);
+                loadso(out, instr);
+                break;
 
             case IR_BRANCHZ:
             case IR_JUMP:
+            case IR_BRANCH_EQ:
+            case IR_BRANCH_LT:
+            case IR_BRANCH_LE:
             case IR_CALL:
-                control(fd, instr);
+                control(out, instr, instr->next ? NULL : bb->next);
                 break;
 
             case IR_RETURN:
-                function_exit(fd, function);
+                function_exit(out, function);
                 break;
 
             case IR_NOP:
-                fprintf(fd, INDENT "nop;\n");
+                // Placeholder at the start of each basic block.
                 break;
         }
     }
@@ -350,66 +603,71 @@ static void basic_block(FILE * fd, IrFunction * function, IrBasicBlock * bb)
 /*
  * Single function (including entry-label)
  */
-static void function(FILE * fd, IrFunction * function)
+static void function(Output * out, IrFunction * function)
 {
-    fprintf(fd, "\n");
-    fprintf(fd, "%s:\n", function->name);
+    Output_format(out, "\n");
+    Output_format(out, "%s:\n", function->name);
 
     // Function preamble:
     // Store all registers except r0, r1, r2, r3.
-    fprintf(fd, INDENT "push {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
+    Output_format(out, INDENT "push {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
 
     // Decrement the stack pointer.
     for(int shift=0;shift < 32;shift += 8)
     {
-        fprintf(fd, INDENT "sub sp, sp, #%u\n", function->stack_size & (0xFF << shift));
+        Output_format(out, INDENT "sub sp, sp, #%u\n", function->stack_size & (0xFF << shift));
     }
 
     for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next)
     {
-        basic_block(fd, function, bb);
+        basic_block(out, function, bb);
     }
 
     // Increment the stack pointer.
     for(int shift=0;shift < 32;shift += 8)
     {
-        fprintf(fd, INDENT "add sp, sp, #%u\n", function->stack_size & (0xFF << shift));
+        Output_format(out, INDENT "add sp, sp, #%u\n", function->stack_size & (0xFF << shift));
     }
 
     // Function postamble.
     // Pop all registers except r0, r1, r2, r3 off the stack and branch.
-    fprintf(fd, INDENT "pop {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
-    fprintf(fd, INDENT "bx lr\n");
+    Output_format(out, INDENT "pop {r4,r5,r6,r7,r8,r9,r10,r11,r12,lr}\n");
+    Output_format(out, INDENT "bx lr\n");
 }
 
 /*
  * _start function
  */
-static void _start(FILE * fd)
+static void _start(Output * out)
 {
-    fprintf(fd, "_start:\n");
-    fprintf(fd, INDENT "bl main\n");
+    Output_format(out, "_start:\n");
+    Output_format(out, INDENT "bl main\n");
 
     // Exit.
-    fprintf(fd, INDENT "mov r7, #1\n");
-    fprintf(fd, INDENT "svc #0\n");
+    Output_format(out, INDENT "mov r7, #1\n");
+    Output_format(out, INDENT "svc #0\n");
 }
 
 void assembly_gen(FILE * fd, IrFunction * program)
 {
-    fprintf(fd, HEADER);
-    fprintf(fd, INDENT ".global _start\n");
-    fprintf(fd, INDENT ".text\n\n");
+    // All output is buffered, and written to 'fd' in large blocks.
+    Output * out = Output_init(fd);
+
+    Output_format(out, HEADER);
+    Output_format(out, INDENT ".global _start\n");
+    Output_format(out, INDENT ".text\n\n");
 
     for(IrFunction * f = program;f != NULL;f = f->next)
     {
-        fprintf(fd, INDENT ".global %s\n", f->name);
+        Output_format(out, INDENT ".global %s\n", f->name);
     }
 
-    _start(fd);
+    _start(out);
 
     for(;program != NULL;program = program->next)
     {
-        function(fd, program);
+        function(out, program);
     }
+
+    Output_destroy(out);
 }
\ No newline at end of file
@@ -1,33 +1,108 @@
 #include "ast.h"
+#include "timing.h"
+#include "util.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#define AST_ARENA_CHUNK_SIZE (64 * 1024)
+#define AST_ARENA_CHUNK_ALIGNMENT 64
+#define AST_ARENA_ALIGNMENT 16
+
+/*
+ * The arena is a list of chunks (most recent first). Allocations are bumped from
+ * the most recent chunk, and a new chunk is added when it runs out of space.
+ * Chunks are cache-line aligned, and the header is padded to a full cache line.
+ * (So they are allocated by aligned_alloc(), and counted here, not by xmalloc().)
+ */
+typedef struct AstArenaChunk
+{
+    struct AstArenaChunk *prev;
+    size_t used, size;
+    _Alignas(AST_ARENA_CHUNK_ALIGNMENT) char data[];
+} AstArenaChunk;
+
+struct AstArena
+{
+    AstArenaChunk *chunks;
+};
+
+/*
+ * Create a new (empty) arena.
+ */
+AstArena *Ast_arena_init(void)
+{
+    return xcalloc(1, sizeof(AstArena));
+}
+
+/*
+ * Allocate 'size' bytes of zero-initialised memory from the arena.
+ */
+void *Ast_arena_alloc(AstArena *arena, size_t size)
+{
+    size = (size + AST_ARENA_ALIGNMENT - 1) & ~(size_t)(AST_ARENA_ALIGNMENT - 1);
+
+    AstArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->used + size > chunk->size)
+    {
+        // aligned_alloc requires the size to be a multiple of the alignment.
+        size_t chunk_size = size > AST_ARENA_CHUNK_SIZE ? size : AST_ARENA_CHUNK_SIZE;
+        chunk_size = (chunk_size + AST_ARENA_CHUNK_ALIGNMENT - 1) &
+                     ~(size_t)(AST_ARENA_CHUNK_ALIGNMENT - 1);
+        chunk =
+            aligned_alloc(AST_ARENA_CHUNK_ALIGNMENT, sizeof(AstArenaChunk) + chunk_size);
+        chunk->prev = arena->chunks;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        Timing_allocated(sizeof(AstArenaChunk) + chunk_size);
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return memset(ptr, 0, size);
+}
+
+/*
+ * Free all memory allocated from the arena, and the arena itself.
+ */
+void Ast_arena_destroy(AstArena *arena)
+{
+    for (AstArenaChunk *chunk = arena->chunks; chunk;)
+    {
+        AstArenaChunk *prev = chunk->prev;
+        Timing_freed(sizeof(AstArenaChunk) + chunk->size);
+        free(chunk);
+        chunk = prev;
+    }
+    xfree(arena);
+}
+
 /* Create new AST nodes
  *
  * These functions take an AST by value (presumably allocated automatically),
- * and copy it to a new ExprAstNode/DeclAstNode allocated dynamically.
+ * and copy it to a new ExprAstNode/DeclAstNode allocated from the arena.
  *
  * E.g.:
- * > Ast_create_expr_node((ExprAstNode){.primary.identifier=...});
+ * > Ast_create_expr_node(arena, (ExprAstNode){.primary.identifier=...});
  */
-ExprAstNode *Ast_create_expr_node(ExprAstNode ast_node)
+ExprAstNode *Ast_create_expr_node(AstArena *arena, ExprAstNode ast_node)
 {
-    ExprAstNode *node = calloc(1, sizeof(ExprAstNode));
+    ExprAstNode *node = Ast_arena_alloc(arena, sizeof(ExprAstNode));
 
     memcpy(node, &ast_node, sizeof(ast_node));
     return node;
 }
-DeclAstNode *Ast_create_decl_node(DeclAstNode ast_node)
+DeclAstNode *Ast_create_decl_node(AstArena *arena, DeclAstNode ast_node)
 {
-    DeclAstNode *node = calloc(1, sizeof(DeclAstNode));
+    DeclAstNode *node = Ast_arena_alloc(arena, sizeof(DeclAstNode));
 
     memcpy(node, &ast_node, sizeof(ast_node));
     return node;
 }
-StmtAstNode *Ast_create_stmt_node(StmtAstNode ast_node)
+StmtAstNode *Ast_create_stmt_node(AstArena *arena, StmtAstNode ast_node)
 {
-    StmtAstNode *node = calloc(1, sizeof(StmtAstNode));
+    StmtAstNode *node = Ast_arena_alloc(arena, sizeof(StmtAstNode));
 
     memcpy(node, &ast_node, sizeof(ast_node));
     return node;
@@ -5,6 +5,7 @@
 
 #include "token.h"
 #include "ctype.h"
+#include "util.h"
 
 #define TYPE_SIGNEDNESS (TYPE_SIGNED | TYPE_UNSIGNED)
 #define TYPE_SPECIFIERS (TYPE_VOID | TYPE_CHAR | TYPE_INT)
@@ -142,7 +143,7 @@ CTypeRank ctype_rank(CType *type)
 
 char *ctype_str(const CType *type)
 {
-    char *buf = calloc(250, sizeof(char));
+    char *buf = xcalloc(250, sizeof(char));
     int len = 0;
 
     while (1)
@@ -1,9 +1,13 @@
 #include "error.h"
+#include "util.h"
 #include <stdlib.h>
 #include <string.h>
 
+#define ERROR_INITIAL_CAPACITY 16
+
 void Error_report_error(ErrorReporter *, ErrorType, Position, const char *)
     __attribute__((weak));
+int Error_limit_reached(ErrorReporter *) __attribute__((weak));
 
 typedef struct ErrorReport
 {
@@ -12,87 +16,127 @@ typedef struct ErrorReport
     int line_position;
     char *msg;
 
-    struct ErrorReport *next;
+    // Order in which the error was reported (to keep the sort stable).
+    int sequence;
 } ErrorReport;
 
+/*
+ * Errors are appended to a vector as they are reported, and sorted once,
+ * when they are first retrieved by Error_get_errors.
+ */
 typedef struct ErrorReporter
 {
-    ErrorReport *head;
-    ErrorReport *iterate_position;
+    ErrorReport *errors;
+    int count;
+    int capacity;
+    _Bool sorted;
+
+    // Maximum number of errors to collect (0 for no limit).
+    int limit;
+
+    int iterate_position;
 } ErrorReporter;
 
 ErrorReporter *Error_init()
 {
-    return calloc(1, sizeof(ErrorReport));
+    return xcalloc(1, sizeof(ErrorReporter));
 }
 
 void Error_destroy(ErrorReporter *error_reporter)
 {
-    for (ErrorReport *e = error_reporter->head; e;)
+    for (int i = 0; i < error_reporter->count; i++)
     {
-        ErrorReport *next = e->next;
-        free(e);
-        e = next;
+        xfree(error_reporter->errors[i].msg);
     }
-    free(error_reporter);
+    xfree(error_reporter->errors);
+    xfree(error_reporter);
+}
+
+void Error_set_limit(ErrorReporter *error_reporter, int limit)
+{
+    error_reporter->limit = limit;
+}
+
+int Error_limit_reached(ErrorReporter *error_reporter)
+{
+    return error_reporter->limit && error_reporter->count >= error_reporter->limit;
 }
 
 void Error_report_error(ErrorReporter *error_reporter, ErrorType type, Position position,
                         const char *msg)
 {
-    // Find the right position in the list. Ordered as follows:
-    // 1. By line-number ascending.
-    // 2. By line-position ascending.
-    // 3. By type: SCANNER, PARSER, ANALYSIS.
-    ErrorReport **prev = &error_reporter->head;
-    for (; *prev; prev = &((*prev)->next))
-    {
+    // Drop any errors beyond the limit.
+    if (Error_limit_reached(error_reporter))
+        return;
 
-        if (((*prev)->line_number < position.line) ||
-            ((*prev)->line_position < position.position) || ((*prev)->type < type))
-        {
-            continue;
-        }
-        else
-        {
-            break;
-        }
+    if (error_reporter->count == error_reporter->capacity)
+    {
+        error_reporter->capacity = error_reporter->capacity
+                                       ? error_reporter->capacity * 2
+                                       : ERROR_INITIAL_CAPACITY;
+        error_reporter->errors = xrealloc(error_reporter->errors,
+                                          error_reporter->capacity * sizeof(ErrorReport));
     }
 
-    // Insert the new node.
-    ErrorReport *next = *prev;
-    *prev = calloc(1, sizeof(ErrorReport));
-    (*prev)->next = next;
-
     // Store error information.
-    (*prev)->line_number = position.line;
-    (*prev)->line_position = position.position;
-    (*prev)->type = type;
-    (*prev)->msg = malloc(strlen(msg));
-    strcpy((*prev)->msg, msg);
+    ErrorReport *error = &error_reporter->errors[error_reporter->count];
+    error->line_number = position.line;
+    error->line_position = position.position;
+    error->type = type;
+    error->msg = xmalloc(strlen(msg) + 1);
+    strcpy(error->msg, msg);
+    error->sequence = error_reporter->count++;
+
+    error_reporter->sorted = false;
+}
+
+/*
+ * Errors are ordered as follows:
+ * 1. By line-number ascending.
+ * 2. By line-position ascending.
+ * 3. By type: SCANNER, PARSER, ANALYSIS.
+ * 4. By the order in which they were reported.
+ */
+static int error_compare(const void *a, const void *b)
+{
+    const ErrorReport *left = a, *right = b;
+
+    if (left->line_number != right->line_number)
+        return left->line_number < right->line_number ? -1 : 1;
+    if (left->line_position != right->line_position)
+        return left->line_position < right->line_position ? -1 : 1;
+    if (left->type != right->type)
+        return left->type < right->type ? -1 : 1;
+    return left->sequence - right->sequence;
 }
 
 int Error_get_errors(ErrorReporter *error_reporter, ErrorType *type, int *line_number,
                      int *line_position, char **msg, _Bool beginning)
 {
     if (beginning)
-        error_reporter->iterate_position = error_reporter->head;
+    {
+        if (!error_reporter->sorted)
+        {
+            qsort(error_reporter->errors, error_reporter->count, sizeof(ErrorReport),
+                  error_compare);
+            error_reporter->sorted = true;
+        }
+        error_reporter->iterate_position = 0;
+    }
 
-    if (!error_reporter->iterate_position)
+    if (error_reporter->iterate_position == error_reporter->count)
         return 0;
 
-    ErrorReport *n = error_reporter->iterate_position;
+    ErrorReport *n = &error_reporter->errors[error_reporter->iterate_position++];
 
     *type = n->type;
     *line_number = n->line_number;
     *line_position = n->line_position;
     *msg = n->msg;
-
-    error_reporter->iterate_position = n->next;
     return 1;
 }
 
 int Error_has_errors(ErrorReporter *error_reporter)
 {
-    return error_reporter->head != NULL;
-}
\ No newline at end of file
+    return error_reporter->count != 0;
+}
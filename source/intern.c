@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "util.h"
+
+#define INTERN_INITIAL_CAPACITY 1024
+#define INTERN_STRINGS_CHUNK_SIZE (64 * 1024)
+
+/*
+ * Hash set entry. 'str' is NULL for empty slots.
+ */
+typedef struct InternEntry
+{
+    uint32_t hash;
+    int length;
+    const char *str;
+} InternEntry;
+
+/*
+ * Interned strings are copied into large chunks, rather than being allocated
+ * individually.
+ */
+typedef struct InternChunk
+{
+    struct InternChunk *prev;
+    int used, size;
+    char strings[];
+} InternChunk;
+
+/*
+ * The intern table is an open-addressing (linear probing) hash set, with a
+ * power-of-two capacity. It is grown when it becomes half full.
+ */
+static struct
+{
+    InternEntry *entries;
+    int capacity;
+    int count;
+
+    InternChunk *chunks;
+} table;
+
+/*
+ * FNV-1a hash.
+ */
+static uint32_t hash_string(const char *str, int length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static InternEntry *find_slot(InternEntry *entries, int capacity, const char *str,
+                              int length, uint32_t hash)
+{
+    for (uint32_t i = hash & (capacity - 1);; i = (i + 1) & (capacity - 1))
+    {
+        InternEntry *entry = &entries[i];
+        if (entry->str == NULL)
+            return entry;
+
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->str, str, length) == 0)
+            return entry;
+    }
+}
+
+static void grow_table()
+{
+    int capacity = table.capacity ? table.capacity * 2 : INTERN_INITIAL_CAPACITY;
+    InternEntry *entries = xcalloc(capacity, sizeof(InternEntry));
+
+    for (int i = 0; i < table.capacity; i++)
+    {
+        InternEntry *entry = &table.entries[i];
+        if (entry->str)
+            *find_slot(entries, capacity, entry->str, entry->length, entry->hash) = *entry;
+    }
+
+    xfree(table.entries);
+    table.entries = entries;
+    table.capacity = capacity;
+}
+
+static char *copy_string(const char *str, int length)
+{
+    InternChunk *chunk = table.chunks;
+    if (!chunk || chunk->used + length + 1 > chunk->size)
+    {
+        int size = INTERN_STRINGS_CHUNK_SIZE;
+        if (length + 1 > size)
+            size = length + 1;
+
+        chunk = xmalloc(sizeof(InternChunk) + size);
+        chunk->prev = table.chunks;
+        chunk->used = 0;
+        chunk->size = size;
+        table.chunks = chunk;
+    }
+
+    char *copy = chunk->strings + chunk->used;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    chunk->used += length + 1;
+    return copy;
+}
+
+/*
+ * Get the canonical string for the first 'length' characters of 'str'.
+ */
+const char *Intern_string(const char *str, int length)
+{
+    if (table.count * 2 >= table.capacity)
+        grow_table();
+
+    uint32_t hash = hash_string(str, length);
+    InternEntry *entry = find_slot(table.entries, table.capacity, str, length, hash);
+    if (entry->str == NULL)
+    {
+        *entry = (InternEntry){hash, length, copy_string(str, length)};
+        table.count++;
+    }
+    return entry->str;
+}
+
+/*
+ * Get the canonical string for the null-terminated string 'str'.
+ */
+const char *Intern_cstr(const char *str)
+{
+    return Intern_string(str, strlen(str));
+}
+
+/*
+ * Free all interned strings.
+ */
+void Intern_destroy(void)
+{
+    for (InternChunk *chunk = table.chunks; chunk;)
+    {
+        InternChunk *prev = chunk->prev;
+        xfree(chunk);
+        chunk = prev;
+    }
+    xfree(table.entries);
+
+    table.entries = NULL;
+    table.capacity = table.count = 0;
+    table.chunks = NULL;
+}
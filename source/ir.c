@@ -3,11 +3,27 @@
 #include <stdlib.h>
 
 #include "ir.h"
+#include "output.h"
 #include "regalloc.h"
+#include "util.h"
 #include "version.h"
 
 #define INDENT "    "
 
+#define IR_INSTR_CHUNK_MIN 32
+#define IR_INSTR_CHUNK_MAX 4096
+
+/*
+ * Pending instructions are allocated in chunks, rather than individually. Each
+ * chunk is twice the size of the previous one (up to IR_INSTR_CHUNK_MAX).
+ */
+struct IrInstructionChunk
+{
+    struct IrInstructionChunk *prev;
+    int used, size;
+    IrInstruction instrs[];
+};
+
 #define HEADER                                                                           \
     "// === ACC (" VERSION_STRING ") IR === \n//\n"                                                           \
     "// Date: " __DATE__ "\n"                                                            \
@@ -24,197 +40,289 @@
     "#define SIGN_EXTEND8(c) (c | (c & 0x80 ? 0xFFFFFF00 : 0))\n"                        \
     "#define SIGN_EXTEND16(c) (c | (c & 0x8000 ? 0xFFFF0000 : 0))\n\n"
 
-static void ir_register(FILE *fd, IrRegister *reg)
+static void ir_register(Output *out, IrRegister *reg)
 {
     switch (reg->type)
     {
     case REG_RESERVED:
-        fprintf(fd, "r%d", reg->index);
+        Output_format(out, "r%d", reg->index);
         break;
     case REG_ANY:
-        fprintf(fd, "t%d", reg->index);
+        Output_format(out, "t%d", reg->index);
         break;
     }
 }
 
-static void instruction_arithmetic(FILE *fd, IrInstruction *instr)
+static void instruction_arithmetic(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
-    ir_register(fd, instr->dest);
-    fprintf(fd, " = ");
+    // Division and comparisons are signed (as in the generated assembly).
+    const char *sign = "";
+    if (instr->op == IR_DIV || instr->op == IR_MOD || instr->op == IR_LT ||
+        instr->op == IR_LE)
+    {
+        sign = "(int32_t)";
+    }
+
+    Output_format(out, INDENT);
+    ir_register(out, instr->dest);
+    Output_format(out, " = ");
 
-    if (instr->right)
+    if (instr->right || instr->immediate)
     {
-        ir_register(fd, instr->left);
+        Output_str(out, sign);
+        ir_register(out, instr->left);
     }
     switch (instr->op)
     {
     case IR_ADD:
-        fprintf(fd, " + ");
+        Output_format(out, " + ");
         break;
     case IR_SUB:
-        fprintf(fd, " - ");
+        Output_format(out, " - ");
         break;
     case IR_MUL:
-        fprintf(fd, " * ");
+        Output_format(out, " * ");
         break;
     case IR_DIV:
-        fprintf(fd, " / ");
+        Output_format(out, " / ");
         break;
     case IR_MOD:
-        fprintf(fd, " %% ");
+        Output_format(out, " %% ");
         break;
     case IR_SLL:
-        fprintf(fd, " << ");
+        Output_format(out, " << ");
         break;
     case IR_SLR:
-        fprintf(fd, " >> ");
+        Output_format(out, " >> ");
         break;
     case IR_OR:
-        fprintf(fd, " | ");
+        Output_format(out, " | ");
         break;
     case IR_AND:
-        fprintf(fd, " & ");
+        Output_format(out, " & ");
         break;
     case IR_NOT:
-        fprintf(fd, " ! ");
+        Output_format(out, " ! ");
         break;
     case IR_FLIP:
-        fprintf(fd, " ~ ");
+        Output_format(out, " ~ ");
         break;
     case IR_XOR:
-        fprintf(fd, " ^ ");
+        Output_format(out, " ^ ");
         break;
     case IR_EQ:
-        fprintf(fd, " == ");
+        Output_format(out, " == ");
         break;
     case IR_LT:
-        fprintf(fd, " < ");
+        Output_format(out, " < ");
         break;
     case IR_LE:
-        fprintf(fd, " <= ");
+        Output_format(out, " <= ");
         break;
     }
 
-    if (instr->right)
+    if (instr->immediate)
+    {
+        Output_format(out, "%s%d", sign, instr->value);
+    }
+    else if (instr->right)
     {
-        ir_register(fd, instr->right);
+        Output_str(out, sign);
+        ir_register(out, instr->right);
     }
     else
     {
-        ir_register(fd, instr->left);
+        ir_register(out, instr->left);
     }
-    fprintf(fd, ";\n");
+    Output_format(out, ";\n");
 }
 
-static void instruction_sign_extend(FILE *fd, IrInstruction *instr)
+static void instruction_sign_extend(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
-    ir_register(fd, instr->dest);
+    Output_format(out, INDENT);
+    ir_register(out, instr->dest);
     if (instr->op == IR_SIGN_EXTEND_8)
     {
-        fprintf(fd, " = SIGN_EXTEND8(");
+        Output_format(out, " = SIGN_EXTEND8(");
     }
     else
     {
-        fprintf(fd, " = SIGN_EXTEND16(");
+        Output_format(out, " = SIGN_EXTEND16(");
     }
-    ir_register(fd, instr->left);
-    fprintf(fd, ");\n");
+    ir_register(out, instr->left);
+    Output_format(out, ");\n");
 }
 
-static void instruction_move(FILE *fd, IrInstruction *instr)
+static void instruction_move(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
-    ir_register(fd, instr->dest);
-    fprintf(fd, " = ");
-    ir_register(fd, instr->left);
-    fprintf(fd, ";\n");
+    Output_format(out, INDENT);
+    ir_register(out, instr->dest);
+    Output_format(out, " = ");
+    ir_register(out, instr->left);
+    Output_format(out, ";\n");
 }
 
-static void instruction_mem(FILE *fd, IrInstruction *instr)
+static void address_base(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
+    if (instr->left)
+        ir_register(out, instr->left);
+    else
+        Output_format(out, "(uint32_t)sp");
+}
+
+static void address(Output *out, IrInstruction *instr)
+{
+    if (instr->index)
+    {
+        Output_format(out, "(");
+        address_base(out, instr);
+        Output_format(out, " + (");
+        ir_register(out, instr->index);
+        Output_format(out, " << %d))", instr->shift);
+    }
+    else if (instr->immediate)
+    {
+        Output_format(out, "(");
+        address_base(out, instr);
+        Output_format(out, " + %d)", instr->value);
+    }
+    else
+    {
+        address_base(out, instr);
+    }
+}
+
+static void instruction_mem(Output *out, IrInstruction *instr)
+{
+    Output_format(out, INDENT);
     if (instr->op == IR_LOAD8 || instr->op == IR_LOAD16 || instr->op == IR_LOAD32)
     {
-        ir_register(fd, instr->dest);
+        ir_register(out, instr->dest);
         switch (instr->op)
         {
         case IR_LOAD8:
-            fprintf(fd, " = *((uint8_t*)");
+            Output_format(out, " = *((uint8_t*)");
             break;
         case IR_LOAD16:
-            fprintf(fd, " = *((uint16_t*)");
+            Output_format(out, " = *((uint16_t*)");
             break;
         case IR_LOAD32:
-            fprintf(fd, " = *((uint32_t*)");
+            Output_format(out, " = *((uint32_t*)");
             break;
         }
-        ir_register(fd, instr->left);
-        fprintf(fd, ")");
+        address(out, instr);
+        Output_format(out, ")");
     }
     else
     {
         switch (instr->op)
         {
         case IR_STORE8:
-            fprintf(fd, "*((uint8_t*)");
+            Output_format(out, "*((uint8_t*)");
             break;
         case IR_STORE16:
-            fprintf(fd, "*((uint16_t*)");
+            Output_format(out, "*((uint16_t*)");
             break;
         case IR_STORE32:
-            fprintf(fd, "*((uint32_t*)");
+            Output_format(out, "*((uint32_t*)");
             break;
         }
-        ir_register(fd, instr->left);
-        fprintf(fd, ") = ");
-        ir_register(fd, instr->right);
+        address(out, instr);
+        Output_format(out, ") = ");
+        ir_register(out, instr->right);
+    }
+    Output_format(out, ";\n");
+
+    if (instr->post_index)
+    {
+        Output_format(out, INDENT);
+        ir_register(out, instr->left);
+        Output_format(out, " += %d;\n", instr->value);
     }
-    fprintf(fd, ";\n");
 }
 
-static void instruction_loadi(FILE *fd, IrInstruction *instr)
+static void instruction_loadi(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
-    ir_register(fd, instr->dest);
-    fprintf(fd, " = %d;\n", instr->value);
+    Output_format(out, INDENT);
+    ir_register(out, instr->dest);
+    Output_format(out, " = %d;\n", instr->value);
 }
 
-static void instruction_loadso(FILE *fd, IrInstruction *instr)
+static void instruction_loadso(Output *out, IrInstruction *instr)
 {
-    fprintf(fd, INDENT);
-    ir_register(fd, instr->dest);
-    fprintf(fd, " = (uint32_t)sp + %d;\n", instr->value);
+    Output_format(out, INDENT);
+    ir_register(out, instr->dest);
+    Output_format(out, " = (uint32_t)sp + %d;\n", instr->value);
 }
 
-static void instruction_jump(FILE *fd, IrInstruction *instr)
+static void instruction_jump(Output *out, IrInstruction *instr)
 {
     if (instr->op == IR_JUMP)
     {
-        fprintf(fd, INDENT "goto bb_%d;\n", instr->control.jump_true->index);
+        Output_format(out, INDENT "goto bb_%d;\n", instr->control.jump_true->index);
     }
     else if (instr->op == IR_RETURN)
     {
-        fprintf(fd, INDENT "return;\n");
+        Output_format(out, INDENT "return;\n");
     }
     else if (instr->op == IR_BRANCHZ)
     {
-        fprintf(fd, INDENT "if(");
-        ir_register(fd, instr->left);
-        fprintf(fd, ")\n" INDENT "{\n");
-        fprintf(fd, INDENT INDENT "goto bb_%d;\n", instr->control.jump_true->index);
-        fprintf(fd, INDENT "} else {\n");
-        fprintf(fd, INDENT INDENT "goto bb_%d;\n", instr->control.jump_false->index);
-        fprintf(fd, INDENT "}\n");
+        Output_format(out, INDENT "if(");
+        ir_register(out, instr->left);
+        Output_format(out, ")\n" INDENT "{\n");
+        Output_format(out, INDENT INDENT "goto bb_%d;\n", instr->control.jump_true->index);
+        Output_format(out, INDENT "} else {\n");
+        Output_format(out, INDENT INDENT "goto bb_%d;\n", instr->control.jump_false->index);
+        Output_format(out, INDENT "}\n");
+    }
+    else if (instr->op == IR_BRANCH_EQ || instr->op == IR_BRANCH_LT ||
+             instr->op == IR_BRANCH_LE)
+    {
+        const char *op = instr->op == IR_BRANCH_EQ   ? "=="
+                         : instr->op == IR_BRANCH_LT ? "<"
+                                                     : "<=";
+        Output_format(out, INDENT "if((int32_t)");
+        ir_register(out, instr->left);
+        if (instr->immediate)
+        {
+            Output_format(out, " %s (int32_t)%d)\n", op, instr->value);
+        }
+        else
+        {
+            Output_format(out, " %s (int32_t)", op);
+            ir_register(out, instr->right);
+            Output_format(out, ")\n");
+        }
+        Output_format(out, INDENT "{\n");
+        Output_format(out, INDENT INDENT "goto bb_%d;\n", instr->control.jump_true->index);
+        Output_format(out, INDENT "} else {\n");
+        Output_format(out, INDENT INDENT "goto bb_%d;\n", instr->control.jump_false->index);
+        Output_format(out, INDENT "}\n");
     }
     else if (instr->op == IR_CALL)
     {
-        fprintf(fd, INDENT "_%s();\n", instr->control.callee->name);
+        Output_format(out, INDENT "_%s();\n", instr->control.callee->name);
+    }
+}
+
+static void instruction_phi(Output *out, IrInstruction *instr)
+{
+    // Phis are removed before the IR is output (as C), except when debugging.
+    Output_format(out, INDENT "// ");
+    ir_register(out, instr->dest);
+    Output_format(out, " = phi(");
+    ir_register(out, instr->left);
+    Output_format(out, " [bb_%d]", instr->control.jump_true->index);
+    if(instr->control.jump_false)
+    {
+        Output_format(out, ", ");
+        ir_register(out, instr->right);
+        Output_format(out, " [bb_%d]", instr->control.jump_false->index);
     }
+    Output_format(out, ");\n");
 }
 
-static void instruction(FILE *fd, IrInstruction *instr)
+static void instruction(Output *out, IrInstruction *instr)
 {
     switch (instr->op)
     {
@@ -233,16 +341,16 @@ static void instruction(FILE *fd, IrInstruction *instr)
     case IR_EQ:
     case IR_LT:
     case IR_LE:
-        instruction_arithmetic(fd, instr);
+        instruction_arithmetic(out, instr);
         break;
 
     case IR_SIGN_EXTEND_16:
     case IR_SIGN_EXTEND_8:
-        instruction_sign_extend(fd, instr);
+        instruction_sign_extend(out, instr);
         break;
 
     case IR_MOV:
-        instruction_move(fd, instr);
+        instruction_move(out, instr);
         break;
 
     case IR_STORE8:
@@ -251,67 +359,78 @@ static void instruction(FILE *fd, IrInstruction *instr)
     case IR_LOAD8:
     case IR_LOAD16:
     case IR_LOAD32:
-        instruction_mem(fd, instr);
+        instruction_mem(out, instr);
         break;
 
     case IR_LOADI:
-        instruction_loadi(fd, instr);
+        instruction_loadi(out, instr);
         break;
     
     case IR_LOADSO:
-        instruction_loadso(fd, instr);
+        instruction_loadso(out, instr);
         break;
 
     case IR_BRANCHZ:
     case IR_JUMP:
+    case IR_BRANCH_EQ:
+    case IR_BRANCH_LT:
+    case IR_BRANCH_LE:
     case IR_CALL:
     case IR_RETURN:
-        instruction_jump(fd, instr);
+        instruction_jump(out, instr);
+        break;
+    case IR_PHI:
+        instruction_phi(out, instr);
         break;
     case IR_NOP:
-        fprintf(fd, INDENT ";\n");
+        Output_format(out, INDENT ";\n");
     }
 }
 
-static void basic_block(FILE *fd, IrBasicBlock *bb, IrFunction * func)
+static void basic_block(Output *out, IrBasicBlock *bb, IrFunction * func)
 {
-    fprintf(fd, "bb_%d: //LiveEntry=", bb->index);
+    Output_format(out, "bb_%d: //LiveEntry=", bb->index);
 
     for(int i = 0;i < func->registers.count;i++)
     {
-        if(bb->live.entry[i/8] & (1 << (i % 8))) fprintf(fd, "t%d,", i);
+        if(bb->live.entry[i/8] & (1 << (i % 8))) Output_format(out, "t%d,", i);
     }
-    fprintf(fd, " //LiveExit=");
+    Output_format(out, " //LiveExit=");
     for(int i = 0;i < func->registers.count;i++)
     {
-        if(bb->live.exit[i/8] & (1 << (i % 8))) fprintf(fd, "t%d,", i);
+        if(bb->live.exit[i/8] & (1 << (i % 8))) Output_format(out, "t%d,", i);
     }
-    fprintf(fd, "\n");
+    if(bb->loop_depth) Output_format(out, " //LoopDepth=%d", bb->loop_depth);
+    Output_format(out, "\n");
 
     for (IrInstruction *instr = bb->head; instr != NULL; instr = instr->next)
     {
-        instruction(fd, instr);
+        instruction(out, instr);
     }
 }
 
-static void function(FILE *fd, IrFunction *func, int * registers)
+static void function(Output *out, IrFunction *func, int * registers)
 {
-    fprintf(fd, "void _%s(void)\n{\n", func->name);
-    fprintf(fd, INDENT "_Alignas(4) uint8_t sp[%d];\n", func->stack_size);
+    Output_format(out, "void _%s(void)\n{\n", func->name);
+    Output_format(out, INDENT "_Alignas(4) uint8_t sp[%d];\n", func->stack_size);
+    Output_format(out, INDENT "// Moves removed: %d\n", func->movs_removed);
+    Output_format(out, INDENT "// Redundant instructions removed: %d\n", func->redundant_removed);
+    Output_format(out, INDENT "// Invariants hoisted: %d\n", func->invariants_hoisted);
+    Output_format(out, INDENT "// Rematerialised: %d\n", func->rematerialised);
 
     // Declare all registers used within this function.
     if(registers)
     {
         for(int * reg = registers;*reg != -1;reg++)
         {
-            fprintf(fd, INDENT "uint32_t t%d;\n", *reg);
+            Output_format(out, INDENT "uint32_t t%d;\n", *reg);
         }
     }
     else
     {
         for (int i = 0;i < func->registers.count;i++)
         {
-            fprintf(fd, INDENT "uint32_t t%d; // Live[%d,%d]\n",
+            Output_format(out, INDENT "uint32_t t%d; // Live[%d,%d]\n",
                 func->registers.list[i]->index,
                 func->registers.list[i]->liveness.start,
                 func->registers.list[i]->liveness.finish
@@ -321,45 +440,156 @@ static void function(FILE *fd, IrFunction *func, int * registers)
 
     for (IrBasicBlock *bb = func->head; bb != NULL; bb = bb->next)
     {
-        basic_block(fd, bb, func);
+        basic_block(out, bb, func);
     }
 
-    fprintf(fd, "}\n");
+    Output_format(out, "}\n");
 }
 
 void Ir_to_str(FILE * fd, IrFunction * ir, int * registers)
 {
-    fprintf(fd, HEADER);
+    // All output is buffered, and written to 'fd' in large blocks.
+    Output *out = Output_init(fd);
+
+    Output_format(out, HEADER);
 
     // Declare all registers used within the program
     for (int i = 0; i < REGS_RESERVED; i++)
     {
-        fprintf(fd, "uint32_t r%d = 0;\n", i);
-        fprintf(fd, "uint32_t t%d = 0;\n", i);
+        Output_format(out, "uint32_t r%d = 0;\n", i);
+        Output_format(out, "uint32_t t%d = 0;\n", i);
     }
 
     // Forward declare all functions.
     for(IrFunction *func = ir;func != NULL;func = func->next)
     {
-        fprintf(fd, "void _%s();\n", func->name);
+        Output_format(out, "void _%s();\n", func->name);
     }
 
     // Print out all functions.
     for (IrFunction *func = ir;func != NULL;func = func->next)
     {
-        function(fd, func, registers);
+        function(out, func, registers);
     }
 
     // Add a main function/entry point.
-    fprintf(fd, "int main(int argc, char ** argv){\n");
-    fprintf(fd, INDENT "_main();\n");
-    fprintf(fd, INDENT "return r0;\n}\n");
+    Output_format(out, "int main(int argc, char ** argv){\n");
+    Output_format(out, INDENT "_main();\n");
+    Output_format(out, INDENT "return r0;\n}\n");
+
+    Output_destroy(out);
+}
+
+bool Ir_has_immediate(IrOpcode op)
+{
+    switch(op)
+    {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_SLL:
+    case IR_SLR:
+    case IR_OR:
+    case IR_AND:
+    case IR_XOR:
+    case IR_EQ:
+    case IR_LT:
+    case IR_LE:
+        return true;
+    }
+    return false;
+}
+
+bool Ir_is_terminator(IrInstruction * instr)
+{
+    switch(instr->op)
+    {
+    case IR_JUMP:
+    case IR_BRANCHZ:
+    case IR_BRANCH_EQ:
+    case IR_BRANCH_LT:
+    case IR_BRANCH_LE:
+    case IR_RETURN:
+        return true;
+    }
+    return false;
 }
 
-void Ir_emit_instr(IrBasicBlock * bb, IrInstruction instr)
+int Ir_successors(IrBasicBlock * bb, IrBasicBlock ** succ)
 {
-    IrInstruction * new_instr = calloc(1, sizeof(IrInstruction));
-    memcpy(new_instr, &instr, sizeof(IrInstruction));
+    IrInstruction * instr = bb->tail;
+    if(instr->op == IR_RETURN) return 0;
+    if(!Ir_is_terminator(instr))
+    {
+        succ[0] = bb->next;
+        return bb->next ? 1 : 0;
+    }
+
+    succ[0] = instr->control.jump_true;
+    if(instr->op == IR_JUMP || instr->control.jump_false == succ[0]) return 1;
+    succ[1] = instr->control.jump_false;
+    return 2;
+}
+
+// One past the highest basic block index in the program.
+static int block_count;
+
+int Ir_block_count(IrFunction * function)
+{
+    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next)
+    {
+        if(bb->index >= block_count) block_count = bb->index + 1;
+    }
+    return block_count;
+}
+
+int Ir_new_block_index(IrFunction * function)
+{
+    Ir_block_count(function);
+    return block_count++;
+}
+
+IrRegister * Ir_new_register(IrFunction * function)
+{
+    int index = function->registers.count++;
+
+    IrRegister * reg = xcalloc(1, sizeof(IrRegister));
+    reg->type = REG_ANY;
+    reg->index = index;
+    reg->liveness.start = -1;
+    reg->liveness.finish = 0;
+
+    if(index >= function->registers.list_size)
+    {
+        function->registers.list = xrealloc(function->registers.list,
+            sizeof(IrRegister *) * (function->registers.list_size += 32));
+    }
+    function->registers.list[index] = reg;
+    return reg;
+}
+
+IrInstruction * Ir_new_instr(IrFunction * function, IrInstruction instr)
+{
+    IrInstructionChunk * chunk = function->instrs.pending;
+    if(!chunk || chunk->used == chunk->size)
+    {
+        int size = chunk ? chunk->size * 2 : IR_INSTR_CHUNK_MIN;
+        if(size > IR_INSTR_CHUNK_MAX) size = IR_INSTR_CHUNK_MAX;
+
+        chunk = xmalloc(sizeof(IrInstructionChunk) + size * sizeof(IrInstruction));
+        chunk->used = 0;
+        chunk->size = size;
+        chunk->prev = function->instrs.pending;
+        function->instrs.pending = chunk;
+    }
+
+    IrInstruction * new_instr = &chunk->instrs[chunk->used++];
+    *new_instr = instr;
+    return new_instr;
+}
+
+void Ir_emit_instr(IrFunction * function, IrBasicBlock * bb, IrInstruction instr)
+{
+    IrInstruction * new_instr = Ir_new_instr(function, instr);
 
     if(bb->head)
     {
@@ -391,4 +621,61 @@ void Ir_emit_instr_before(IrInstruction * after, IrInstruction * instr)
         after->prev->next = instr;
     }
     after->prev = instr;
-}
\ No newline at end of file
+}
+
+void Ir_remove_instr(IrBasicBlock * bb, IrInstruction * instr)
+{
+    if(instr->prev) {
+        instr->prev->next = instr->next;
+    } else {
+        bb->head = instr->next;
+    }
+
+    if(instr->next) {
+        instr->next->prev = instr->prev;
+    } else {
+        bb->tail = instr->prev;
+    }
+    instr->next = instr->prev = NULL;
+}
+
+void Ir_compact(IrFunction * function)
+{
+    int count = 0;
+    for(IrBasicBlock * bb = function->head;bb;bb = bb->next)
+    {
+        for(IrInstruction * instr = bb->head;instr;instr = instr->next) count++;
+    }
+
+    // Copy every basic block's instructions into the new array, in order.
+    IrInstruction * array = xmalloc(count * sizeof(IrInstruction));
+    IrInstruction * ptr = array;
+    for(IrBasicBlock * bb = function->head;bb;bb = bb->next)
+    {
+        if(!bb->head) continue;
+
+        IrInstruction * first = ptr;
+        for(IrInstruction * instr = bb->head;instr;instr = instr->next, ptr++)
+        {
+            *ptr = *instr;
+            ptr->prev = ptr == first ? NULL : ptr - 1;
+            ptr->next = ptr + 1;
+        }
+        bb->head = first;
+        bb->tail = ptr - 1;
+        bb->tail->next = NULL;
+    }
+
+    // Release the old storage.
+    xfree(function->instrs.array);
+    for(IrInstructionChunk * chunk = function->instrs.pending;chunk;)
+    {
+        IrInstructionChunk * prev = chunk->prev;
+        xfree(chunk);
+        chunk = prev;
+    }
+
+    function->instrs.array = array;
+    function->instrs.count = count;
+    function->instrs.pending = NULL;
+}
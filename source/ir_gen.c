@@ -5,9 +5,11 @@
 #include "arch.h"
 #include "ir.h"
 #include "ir_gen.h"
+#include "util.h"
 
 #define EMIT(irgen, opcode, ...)                                                         \
-    Ir_emit_instr(irgen->current_basic_block, (IrInstruction){.op = opcode, __VA_ARGS__})
+    Ir_emit_instr(irgen->current_function, irgen->current_basic_block,                   \
+                  (IrInstruction){.op = opcode, __VA_ARGS__})
 #define UPDATE_CFG(from, to)                                                             \
     *(to->cfg_entry[0] ? to->cfg_entry + 1 : to->cfg_entry) = from
 
@@ -15,8 +17,6 @@ typedef struct IrGenerator
 {
     IrFunction *current_function;
     IrBasicBlock *current_basic_block;
-
-    int bb_counter;
 } IrGenerator;
 
 static IrRegister *get_reg_any(IrGenerator *);
@@ -42,6 +42,22 @@ static IrRegister * emit_arith(IrGenerator * irgen, IrOpcode op, IrRegister * le
     EMIT(irgen, op, .dest=dest, .left=left, .right=right);
     return dest;
 }
+static IrRegister * emit_arith_imm(IrGenerator * irgen, IrOpcode op, IrRegister * left, int value)
+{
+    IrRegister * dest = get_reg_any(irgen);
+    EMIT(irgen, op, .dest=dest, .left=left, .value=value, .immediate=true);
+    return dest;
+}
+static IrRegister * emit_scale(IrGenerator * irgen, IrRegister * offset, int scale)
+{
+    // Power-of-two (pointer) scales are shifts.
+    if(scale & (scale - 1))
+        return emit_arith(irgen, IR_MUL, offset, emit_loadi(irgen, scale));
+
+    int shift = 0;
+    while((1 << shift) < scale) shift++;
+    return shift ? emit_arith_imm(irgen, IR_SLL, offset, shift) : offset;
+}
 static void emit_jump(IrGenerator *irgen, IrBasicBlock *b)
 {
     UPDATE_CFG(irgen->current_basic_block, b);
@@ -54,23 +70,55 @@ static void emit_jumpz(IrGenerator *irgen, IrBasicBlock *tb, IrBasicBlock *fb,
     UPDATE_CFG(irgen->current_basic_block, fb);
     EMIT(irgen, IR_BRANCHZ, .left = cond, .control.jump_true = tb, .control.jump_false = fb);
 }
+// Check if an expression is a constant (literal), and get its value.
+static bool expr_constant(ExprAstNode *node, int *value)
+{
+    if (node->type != PRIMARY || !node->primary.constant)
+        return false;
+
+    *value = node->primary.constant->literal.const_value;
+    return true;
+}
+
+// Walk the address of a load/store (setting left, or the immediate offset).
+static IrInstruction walk_address(IrGenerator *irgen, ExprAstNode *node)
+{
+    // Stack objects (plus a constant offset) are addressed from the stack pointer.
+    int offset = 0;
+    ExprAstNode *base = node;
+    if (node->type == BINARY && node->binary.op == BINARY_ADD &&
+        node->binary.ptr_scale_right != 0 && expr_constant(node->binary.right, &offset))
+    {
+        offset *= node->binary.ptr_scale_right;
+        base = node->binary.left;
+    }
+
+    if (base->type == PRIMARY && base->primary.identifier && base->primary.symbol->ir.object)
+    {
+        int value = base->primary.symbol->ir.object->offset + offset;
+        return (IrInstruction){.value = value, .immediate = true};
+    }
+    return (IrInstruction){.left = walk_expr(irgen, node)};
+}
 static void emit_store(IrGenerator *irgen, ExprAstNode *lhs, IrRegister *rhs)
 {
     if (lhs->type == UNARY && lhs->unary.op == UNARY_DEREFERENCE)
     {
-        IrRegister *dest = walk_expr(irgen, lhs->unary.right);
+        IrInstruction store = walk_address(irgen, lhs->unary.right);
+        store.right = rhs;
         if (lhs->unary.ptr_type->basic.type_specifier & TYPE_CHAR)
         {
-            EMIT(irgen, IR_STORE8, .left = dest, .right = rhs);
+            store.op = IR_STORE8;
         }
         else if (lhs->unary.ptr_type->basic.type_specifier & TYPE_SHORT)
         {
-            EMIT(irgen, IR_STORE16, .left = dest, .right = rhs);
+            store.op = IR_STORE16;
         }
         else
         {
-            EMIT(irgen, IR_STORE32, .left = dest, .right = rhs);
+            store.op = IR_STORE32;
         }
+        Ir_emit_instr(irgen->current_function, irgen->current_basic_block, store);
     }
     else if (lhs->type == PRIMARY && lhs->primary.symbol->ir.regster)
     {
@@ -85,27 +133,30 @@ static void emit_store(IrGenerator *irgen, ExprAstNode *lhs, IrRegister *rhs)
 static IrRegister *emit_load(IrGenerator *irgen, ExprAstNode *src)
 {
     IrRegister *dest = get_reg_any(irgen);
+    IrInstruction load = walk_address(irgen, src->unary.right);
+    load.dest = dest;
 
     if (src->unary.ptr_type->basic.type_specifier & TYPE_CHAR)
     {
-        EMIT(irgen, IR_LOAD8, .dest = dest, .left = walk_expr(irgen, src->unary.right));
+        load.op = IR_LOAD8;
     }
     else if (src->unary.ptr_type->basic.type_specifier & TYPE_SHORT)
     {
-        EMIT(irgen, IR_LOAD16, .dest = dest, .left = walk_expr(irgen, src->unary.right));
+        load.op = IR_LOAD16;
     }
     else
     {
-        EMIT(irgen, IR_LOAD32, .dest = dest, .left = walk_expr(irgen, src->unary.right));
+        load.op = IR_LOAD32;
     }
+    Ir_emit_instr(irgen->current_function, irgen->current_basic_block, load);
     return dest;
 }
 
 static IrBasicBlock *new_bb(IrGenerator *irgen, IrFunction *function)
 {
-    IrBasicBlock *bb = calloc(1, sizeof(IrBasicBlock));
-    bb->index = irgen->bb_counter++;
-    Ir_emit_instr(bb, (IrInstruction){IR_NOP});
+    IrBasicBlock *bb = xcalloc(1, sizeof(IrBasicBlock));
+    bb->index = Ir_new_block_index(function);
+    Ir_emit_instr(function, bb, (IrInstruction){IR_NOP});
 
     if (function->head == NULL)
     {
@@ -119,9 +170,9 @@ static IrBasicBlock *new_bb(IrGenerator *irgen, IrFunction *function)
     return bb;
 }
 
-static IrFunction *new_function(IrGenerator *irgen, char *name)
+static IrFunction *new_function(IrGenerator *irgen, const char *name)
 {
-    IrFunction *function = calloc(1, sizeof(IrFunction));
+    IrFunction *function = xcalloc(1, sizeof(IrFunction));
     function->name = name;
 
     return function;
@@ -129,29 +180,12 @@ static IrFunction *new_function(IrGenerator *irgen, char *name)
 
 static IrRegister *get_reg_any(IrGenerator *irgen)
 {
-    int reg_idx = irgen->current_function->registers.count++;
-
-    IrRegister *reg = calloc(1, sizeof(IrRegister));
-    reg->type = REG_ANY;
-    reg->index = reg_idx;
-    reg->liveness.start = -1;
-    reg->liveness.finish = 0;
-
-    if(reg_idx >= irgen->current_function->registers.list_size)
-    {
-        irgen->current_function->registers.list = (IrRegister**)realloc(
-            irgen->current_function->registers.list, 
-            sizeof(IrRegister**) * (irgen->current_function->registers.list_size += 32)
-        );
-    }
-    irgen->current_function->registers.list[reg_idx] = reg;
-
-    return reg;
+    return Ir_new_register(irgen->current_function);
 }
 
 static IrRegister *get_reg_reserved(IrGenerator *irgen, int index)
 {
-    IrRegister *reg = calloc(1, sizeof(IrRegister));
+    IrRegister *reg = xcalloc(1, sizeof(IrRegister));
     reg->type = REG_RESERVED;
     reg->index = index;
 
@@ -169,7 +203,7 @@ static IrObject *stack_allocate(IrFunction *function, Symbol *symbol)
     // For now, just give everything on the stack 4 bytes.
     function->stack_size += (size + 3) & ~3;
 
-    IrObject *object = calloc(1, sizeof(IrObject));
+    IrObject *object = xcalloc(1, sizeof(IrObject));
     object->size = size;
     object->align = align;
     object->sign = sign;
@@ -185,17 +219,19 @@ static IrRegister *walk_expr_binary(IrGenerator *irgen, ExprAstNode *node)
     bool post_op_negate = false;
 
     IrRegister *left = walk_expr(irgen, node->binary.left);
-    IrRegister *right = walk_expr(irgen, node->binary.right);
+    IrRegister *right = NULL;
 
-    if (node->binary.ptr_scale_left != 0)
+    // Constant right operands are used as immediate values (where supported).
+    int value;
+    bool immediate = expr_constant(node->binary.right, &value);
+    if (immediate && node->binary.ptr_scale_right != 0)
     {
-        int scale = node->binary.ptr_scale_left;
-        left = emit_arith(irgen, IR_MUL, left, emit_loadi(irgen, scale));
+        value *= node->binary.ptr_scale_right;
     }
-    if (node->binary.ptr_scale_right != 0)
+
+    if (node->binary.ptr_scale_left != 0)
     {
-        int scale = node->binary.ptr_scale_right;
-        right = emit_arith(irgen, IR_MUL, right, emit_loadi(irgen, scale));
+        left = emit_scale(irgen, left, node->binary.ptr_scale_left);
     }
 
     switch (node->binary.op)
@@ -258,7 +294,21 @@ static IrRegister *walk_expr_binary(IrGenerator *irgen, ExprAstNode *node)
         abort();
         break;
     }
-    IrRegister * dest = emit_arith(irgen, op, left, right);
+
+    IrRegister * dest;
+    if (immediate && Ir_has_immediate(op))
+    {
+        dest = emit_arith_imm(irgen, op, left, value);
+    }
+    else
+    {
+        right = walk_expr(irgen, node->binary.right);
+        if (node->binary.ptr_scale_right != 0)
+        {
+            right = emit_scale(irgen, right, node->binary.ptr_scale_right);
+        }
+        dest = emit_arith(irgen, op, left, right);
+    }
 
     if (post_op_negate)
     {
@@ -294,13 +344,13 @@ static IrRegister *walk_expr_unary(IrGenerator *irgen, ExprAstNode *node)
         break;
     case UNARY_INC_OP: {
         int incr = node->unary.ptr_scale ? node->unary.ptr_scale : 1;
-        IrRegister * dest = emit_arith(irgen, IR_ADD, right, emit_loadi(irgen, incr));
+        IrRegister * dest = emit_arith_imm(irgen, IR_ADD, right, incr);
         emit_store(irgen, node->unary.right, dest);
         return dest;
     }
     case UNARY_DEC_OP: {
         int incr = node->unary.ptr_scale ? node->unary.ptr_scale : 1;
-        IrRegister * dest = emit_arith(irgen, IR_SUB, right, emit_loadi(irgen, incr));
+        IrRegister * dest = emit_arith_imm(irgen, IR_SUB, right, incr);
         emit_store(irgen, node->unary.right, dest);
         return dest;
     }
@@ -376,14 +426,14 @@ static IrRegister *walk_expr_postfix(IrGenerator *irgen, ExprAstNode *node)
     if (node->postfix.op == POSTFIX_INC_OP)
     {
         int increment = node->postfix.ptr_scale ? node->postfix.ptr_scale : 1;
-        EMIT(irgen, IR_ADD, .dest = left, .left = left,
-             .right = emit_loadi(irgen, increment));
+        EMIT(irgen, IR_ADD, .dest = left, .left = left, .value = increment,
+             .immediate = true);
     }
     else if (node->postfix.op == POSTFIX_DEC_OP)
     {
         int increment = node->postfix.ptr_scale ? node->postfix.ptr_scale : 1;
-        EMIT(irgen, IR_SUB, .dest = left, .left = left,
-             .right = emit_loadi(irgen, increment));
+        EMIT(irgen, IR_SUB, .dest = left, .left = left, .value = increment,
+             .immediate = true);
     }
 
     emit_store(irgen, node->postfix.left, left);
@@ -411,13 +461,13 @@ static IrRegister *walk_expr_cast(IrGenerator *irgen, ExprAstNode *node)
     // Truncate.
     if (node->cast.to->basic.type_specifier & TYPE_CHAR)
     {
-        EMIT(irgen, IR_AND, .dest = right, .left = emit_loadi(irgen, 0xFF),
-             .right = right);
+        EMIT(irgen, IR_AND, .dest = right, .left = right, .value = 0xFF,
+             .immediate = true);
     }
     else if (node->cast.to->basic.type_specifier & TYPE_SHORT)
     {
-        EMIT(irgen, IR_AND, .dest = right, .left = emit_loadi(irgen, 0xFFFF),
-             .right = right);
+        EMIT(irgen, IR_AND, .dest = right, .left = right, .value = 0xFFFF,
+             .immediate = true);
     }
 
     return right;
@@ -480,7 +530,7 @@ static void walk_decl_function(IrGenerator *irgen, DeclAstNode *node)
 {
     IrFunction *func = node->symbol->ir.function;
 
-    func->registers.list = calloc(sizeof(IrRegister**), 32);
+    func->registers.list = xcalloc(sizeof(IrRegister**), 32);
     func->registers.list_size = 32;
 
     // node->symbol->ir.function = func;
@@ -499,7 +549,12 @@ static void walk_decl_function(IrGenerator *irgen, DeclAstNode *node)
     }
     walk_stmt(irgen, node->body);
 
-    EMIT(irgen, IR_RETURN);
+    // Return at the end of the function body, unless it has already.
+    if (irgen->current_basic_block->tail->op != IR_RETURN)
+        EMIT(irgen, IR_RETURN);
+
+    // Store the function's instructions contiguously.
+    Ir_compact(func);
 }
 
 static void walk_decl_object(IrGenerator *irgen, DeclAstNode *node)
@@ -586,23 +641,26 @@ static void walk_stmt_if(IrGenerator *irgen, StmtAstNode *node)
     IrRegister *expr_reg = walk_expr(irgen, node->if_statement.expr);
 
     IrBasicBlock *true_bb = new_bb(irgen, irgen->current_function);
-    IrBasicBlock *end_bb = new_bb(irgen, irgen->current_function);
-
+    IrBasicBlock *else_bb = NULL;
     if (node->if_statement.else_arm)
     {
-        IrBasicBlock *else_bb = new_bb(irgen, irgen->current_function);
-        emit_jumpz(irgen, true_bb, else_bb, expr_reg);
-
-        irgen->current_basic_block = end_bb;
-        walk_stmt(irgen, node->if_statement.else_arm);
-    }
-    else
-    {
-        emit_jumpz(irgen, true_bb, end_bb, expr_reg);
+        else_bb = new_bb(irgen, irgen->current_function);
     }
+    IrBasicBlock *end_bb = new_bb(irgen, irgen->current_function);
+
+    // Every basic block ends with an explicit jump (blocks may be reordered).
+    emit_jumpz(irgen, true_bb, else_bb ? else_bb : end_bb, expr_reg);
 
     irgen->current_basic_block = true_bb;
     walk_stmt(irgen, node->if_statement.if_arm);
+    emit_jump(irgen, end_bb);
+
+    if (else_bb)
+    {
+        irgen->current_basic_block = else_bb;
+        walk_stmt(irgen, node->if_statement.else_arm);
+        emit_jump(irgen, end_bb);
+    }
 
     irgen->current_basic_block = end_bb;
 }
@@ -646,7 +704,7 @@ IrFunction *Ir_generate(DeclAstNode *ast_root, SymbolTable * tab)
     {
         if(!CTYPE_IS_FUNCTION(f->type) || f->symbol->ir.function) continue;
 
-        IrFunction * function = new_function(&irgen, f->identifier->lexeme);
+        IrFunction * function = new_function(&irgen, f->identifier->name);
         f->symbol->ir.function = function;
         function->next = head;
         head = function;
@@ -3,13 +3,15 @@
 
 #include "ir.h"
 #include "liveness.h"
+#include "timing.h"
+#include "util.h"
 
 #define MAX(a, b) ((a) < (b) ? (b) : (a))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 static uint8_t *register_set_init(int sz)
 {
-    return calloc(sz / 8 + 1, sizeof(uint8_t));
+    return xcalloc(sz / 8 + 1, sizeof(uint8_t));
 }
 
 // Mark a register 'index' within a set
@@ -51,9 +53,11 @@ static _Bool register_set_union(uint8_t *set_A, uint8_t *set_B, int sz)
 
 // 'Use' a register. This adds a register to the 'entry' set in a BB.
 // This also updates the liveness start position.
+// Reserved registers (r0, r1, ...) are numbered separately from REG_ANY registers,
+// so they are not tracked - their indexes would alias REG_ANY registers.
 static void reg_define(IrBasicBlock *bb, IrRegister *reg, int position)
 {
-    if (!reg)
+    if (!reg || reg->type != REG_ANY)
         return;
 
     register_set_unmark(bb->live.entry, reg->index);
@@ -65,7 +69,7 @@ static void reg_define(IrBasicBlock *bb, IrRegister *reg, int position)
 // This also updates the liveness finish position.
 static void reg_use(IrBasicBlock *bb, IrRegister *reg, int position)
 {
-    if (!reg)
+    if (!reg || reg->type != REG_ANY)
         return;
 
     register_set_mark(bb->live.entry, reg->index);
@@ -83,6 +87,7 @@ static int basic_block(IrBasicBlock *bb, int sz)
         reg_define(bb, instr->dest, instr->live_position);
         reg_use(bb, instr->left, instr->live_position);
         reg_use(bb, instr->right, instr->live_position);
+        reg_use(bb, instr->index, instr->live_position);
 
         if (instr == bb->head)
             break;
@@ -146,11 +151,11 @@ static void function_end(IrFunction *function)
 // While basic block entry and exit sets are changing
 //     For every basic block: b
 //         For every instruction in reverse order: instr
-//             For instr register left, right, dest: reg
+//             For instr register left, right, index, dest: reg
 //                 Set reg.start = min(reg.start, instr.idx)
 //                 Set reg.finish = max(reg.finish, instr.idx)
 //             Remove instr.dest from b.entry
-//             Add instr.left and instr.right to b.entry
+//             Add instr.left, instr.right and instr.index to b.entry
 //
 //         For all preceeding BBs: pb
 //             Set pb.exit = union(pb.exit, pb.entry)
@@ -162,6 +167,7 @@ static void function_end(IrFunction *function)
 //             Set reg.finish = max(reg.finish, b.finish)
 static void function(IrFunction *function)
 {
+    Timing_start("dataflow");
     function_begin(function);
 
     int changed = 1;
@@ -173,8 +179,11 @@ static void function(IrFunction *function)
             changed += basic_block(bb, function->registers.count);
         }
     }
+    Timing_stop();
 
+    Timing_start("intervals");
     function_end(function);
+    Timing_stop();
 }
 
 void Liveness_analysis(IrFunction *program)
@@ -0,0 +1,2413 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ir.h"
+#include "optimise.h"
+#include "util.h"
+
+#define IS_VIRTUAL(reg) ((reg) && (reg)->type == REG_ANY)
+
+// Register 'index' has not been seen in any basic block (yet).
+#define BLOCK_NONE -1
+
+// Register 'index' appears in more than one basic block (or is read before it is
+// defined, in its only basic block).
+#define BLOCK_MANY -2
+
+/*
+ * Forward copy propagation within a single basic block.
+ *
+ * 'copies' maps a register index to the register it is currently a copy of, and
+ * 'active' lists the indexes with an entry in 'copies'.
+ */
+static void propagate_basic_block(IrBasicBlock *bb, IrRegister **copies, int *active)
+{
+    int active_count = 0;
+
+    for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+    {
+        // Replace any reads of copied registers with the original.
+        if (IS_VIRTUAL(instr->left) && copies[instr->left->index])
+            instr->left = copies[instr->left->index];
+        if (IS_VIRTUAL(instr->right) && copies[instr->right->index])
+            instr->right = copies[instr->right->index];
+        if (IS_VIRTUAL(instr->index) && copies[instr->index->index])
+            instr->index = copies[instr->index->index];
+
+        if (!IS_VIRTUAL(instr->dest))
+            continue;
+
+        // The destination is redefined: forget any copies of, or from it.
+        for (int i = 0; i < active_count;)
+        {
+            int index = active[i];
+            if (index == instr->dest->index || copies[index] == instr->dest)
+            {
+                copies[index] = NULL;
+                active[i] = active[--active_count];
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        if (instr->op == IR_MOV && IS_VIRTUAL(instr->left) && instr->left != instr->dest)
+        {
+            copies[instr->dest->index] = instr->left;
+            active[active_count++] = instr->dest->index;
+        }
+    }
+
+    for (int i = 0; i < active_count; i++)
+        copies[active[i]] = NULL;
+}
+
+/*
+ * Find the basic block that each register is local to (BLOCK_MANY if it is not).
+ *
+ * A register is local if it only appears in a single basic block, and is defined
+ * there before it is read, so it cannot be live on entry to (or exit from) any block.
+ */
+static void find_local_registers(IrFunction *function, int *blocks)
+{
+    for (int i = 0; i < function->registers.count; i++)
+        blocks[i] = BLOCK_NONE;
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            IrRegister *regs[] = {instr->left, instr->right, instr->index, instr->dest};
+            for (int i = 0; i < 4; i++)
+            {
+                if (!IS_VIRTUAL(regs[i]))
+                    continue;
+
+                int *block = &blocks[regs[i]->index];
+                if (*block == BLOCK_NONE)
+                    *block = regs[i] == instr->dest ? bb->index : BLOCK_MANY;
+                else if (*block != bb->index)
+                    *block = BLOCK_MANY;
+            }
+        }
+    }
+}
+
+/*
+ * Remove instructions with opcode 'op' (which must have no side effects) whose
+ * REG_ANY destination is not read before it is redefined. Returns the number of
+ * instructions removed.
+ */
+static int remove_dead_definitions(IrFunction *function, IrBasicBlock *bb, int *blocks,
+                                   bool *live, IrOpcode op)
+{
+    int removed = 0;
+
+    // Only local registers are known to be dead on exit from the basic block.
+    for (int i = 0; i < function->registers.count; i++)
+        live[i] = blocks[i] != bb->index;
+
+    for (IrInstruction *instr = bb->tail; instr;)
+    {
+        IrInstruction *prev = instr->prev;
+
+        if (IS_VIRTUAL(instr->dest) && !live[instr->dest->index] && instr->op == op)
+        {
+            Ir_remove_instr(bb, instr);
+            removed++;
+        }
+        else
+        {
+            if (IS_VIRTUAL(instr->dest))
+                live[instr->dest->index] = false;
+            if (IS_VIRTUAL(instr->left))
+                live[instr->left->index] = true;
+            if (IS_VIRTUAL(instr->right))
+                live[instr->right->index] = true;
+            if (IS_VIRTUAL(instr->index))
+                live[instr->index->index] = true;
+        }
+        instr = prev;
+    }
+    return removed;
+}
+
+/*
+ * Drop registers that no longer appear in any instruction, and renumber the rest,
+ * keeping the liveness register sets as small as possible.
+ */
+static void renumber_registers(IrFunction *function, int *blocks)
+{
+    find_local_registers(function, blocks);
+
+    int count = 0;
+    for (int i = 0; i < function->registers.count; i++)
+    {
+        IrRegister *reg = function->registers.list[i];
+        if (blocks[i] == BLOCK_NONE)
+        {
+            xfree(reg);
+            continue;
+        }
+        reg->index = count;
+        function->registers.list[count++] = reg;
+    }
+    function->registers.count = count;
+}
+
+static void copy_propagation(IrFunction *function)
+{
+    int count = function->registers.count;
+    IrRegister **copies = xcalloc(count + 1, sizeof(IrRegister *));
+    int *active = xcalloc(count + 1, sizeof(int));
+    int *blocks = xcalloc(count + 1, sizeof(int));
+    bool *live = xcalloc(count + 1, sizeof(bool));
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        propagate_basic_block(bb, copies, active);
+    }
+
+    find_local_registers(function, blocks);
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        function->movs_removed +=
+            remove_dead_definitions(function, bb, blocks, live, IR_MOV);
+    }
+
+    renumber_registers(function, blocks);
+    Ir_compact(function);
+
+    xfree(copies);
+    xfree(active);
+    xfree(blocks);
+    xfree(live);
+}
+
+/*
+ * Constants known within the current basic block. 'block' records the basic block
+ * in which 'value' was set for each register, so the set is emptied on entry to
+ * each block without clearing it.
+ */
+typedef struct Constants
+{
+    int *block;
+    int *value;
+} Constants;
+
+static bool constant_get(Constants *constants, IrBasicBlock *bb, IrRegister *reg,
+                         int *value)
+{
+    if (!IS_VIRTUAL(reg) || constants->block[reg->index] != bb->index)
+        return false;
+
+    *value = constants->value[reg->index];
+    return true;
+}
+
+static void make_loadi(IrInstruction *instr, int value)
+{
+    instr->op = IR_LOADI;
+    instr->value = value;
+    instr->immediate = false;
+    instr->left = instr->right = NULL;
+}
+
+static void make_mov(IrInstruction *instr, IrRegister *src)
+{
+    instr->op = IR_MOV;
+    instr->immediate = false;
+    instr->left = src;
+    instr->right = NULL;
+}
+
+/*
+ * Use the immediate form of an instruction, for a constant operand.
+ */
+static void make_immediate(IrInstruction *instr, bool left_known, int left,
+                           bool right_known, int right)
+{
+    bool commutative = instr->op == IR_ADD || instr->op == IR_OR || instr->op == IR_AND ||
+                       instr->op == IR_XOR || instr->op == IR_EQ;
+
+    if (!Ir_has_immediate(instr->op) || instr->immediate)
+        return;
+
+    if (right_known)
+    {
+        instr->value = right;
+    }
+    else if (left_known && commutative)
+    {
+        instr->left = instr->right;
+        instr->value = left;
+    }
+    else
+    {
+        return;
+    }
+    instr->right = NULL;
+    instr->immediate = true;
+}
+
+/*
+ * Evaluate a binary operation on two constants, as the generated code would.
+ * Returns false if it cannot be evaluated at compile time.
+ */
+static bool fold_binary(IrOpcode op, int left, int right, int *result)
+{
+    uint32_t l = left, r = right;
+
+    switch (op)
+    {
+    case IR_ADD:
+        *result = l + r;
+        return true;
+    case IR_SUB:
+        *result = l - r;
+        return true;
+    case IR_MUL:
+        *result = l * r;
+        return true;
+    case IR_DIV:
+    case IR_MOD:
+        // Leave division by zero (and overflow) until runtime.
+        if (right == 0 || (left == INT_MIN && right == -1))
+            return false;
+        *result = op == IR_DIV ? left / right : left % right;
+        return true;
+    case IR_SLL:
+    case IR_SLR:
+        if (r > 31)
+            return false;
+        *result = op == IR_SLL ? l << r : l >> r;
+        return true;
+    case IR_OR:
+        *result = l | r;
+        return true;
+    case IR_AND:
+        *result = l & r;
+        return true;
+    case IR_XOR:
+        *result = l ^ r;
+        return true;
+    case IR_EQ:
+        *result = left == right;
+        return true;
+    case IR_LT:
+        *result = left < right;
+        return true;
+    case IR_LE:
+        *result = left <= right;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Evaluate a unary operation on a constant.
+ */
+static bool fold_unary(IrOpcode op, int left, int *result)
+{
+    switch (op)
+    {
+    case IR_NOT:
+        *result = !left;
+        return true;
+    case IR_FLIP:
+        *result = ~left;
+        return true;
+    case IR_SIGN_EXTEND_8:
+        *result = (int8_t)left;
+        return true;
+    case IR_SIGN_EXTEND_16:
+        *result = (int16_t)left;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Simplify a binary operation with one constant operand, or with the same register
+ * for both operands. Returns true if the instruction was rewritten.
+ */
+static bool simplify_binary(IrInstruction *instr, bool left_known, int left,
+                            bool right_known, int right)
+{
+    IrRegister *other = left_known ? instr->right : instr->left;
+    int constant = left_known ? left : right;
+    bool commutative = instr->op == IR_ADD || instr->op == IR_MUL || instr->op == IR_OR ||
+                       instr->op == IR_AND || instr->op == IR_XOR;
+
+    if (instr->left == instr->right)
+    {
+        switch (instr->op)
+        {
+        case IR_SUB:
+        case IR_XOR:
+        case IR_LT:
+            make_loadi(instr, 0);
+            return true;
+        case IR_EQ:
+        case IR_LE:
+            make_loadi(instr, 1);
+            return true;
+        case IR_AND:
+        case IR_OR:
+            make_mov(instr, instr->left);
+            return true;
+        }
+        return false;
+    }
+
+    // Only a constant right operand is an identity for non-commutative operations.
+    if (!right_known && !commutative)
+    {
+        if (instr->op == IR_SLL || instr->op == IR_SLR)
+        {
+            // 0 << x, 0 >> x
+            if (left == 0)
+            {
+                make_loadi(instr, 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    switch (instr->op)
+    {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SLL:
+    case IR_SLR:
+        if (constant == 0)
+        {
+            make_mov(instr, other);
+            return true;
+        }
+        if (instr->op == IR_OR && constant == -1)
+        {
+            make_loadi(instr, -1);
+            return true;
+        }
+        break;
+    case IR_MUL:
+    case IR_DIV:
+        if (constant == 1)
+        {
+            make_mov(instr, other);
+            return true;
+        }
+        if (instr->op == IR_MUL && constant == 0)
+        {
+            make_loadi(instr, 0);
+            return true;
+        }
+        if (instr->op == IR_MUL && ((uint32_t)constant & ((uint32_t)constant - 1)) == 0)
+        {
+            // Strength reduction: x * 2^n = x << n
+            int shift = 0;
+            while (((uint32_t)1 << shift) != (uint32_t)constant)
+                shift++;
+            make_mov(instr, other);
+            instr->op = IR_SLL;
+            instr->immediate = true;
+            instr->value = shift;
+            return true;
+        }
+        break;
+    case IR_MOD:
+        if (constant == 1 || constant == -1)
+        {
+            make_loadi(instr, 0);
+            return true;
+        }
+        break;
+    case IR_AND:
+        if (constant == -1)
+        {
+            make_mov(instr, other);
+            return true;
+        }
+        if (constant == 0)
+        {
+            make_loadi(instr, 0);
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+/*
+ * Remove the CFG edge from basic block 'from' to 'to'.
+ */
+static void cfg_remove_edge(IrBasicBlock *from, IrBasicBlock *to)
+{
+    if (to->cfg_entry[0] == from)
+    {
+        to->cfg_entry[0] = to->cfg_entry[1];
+        to->cfg_entry[1] = NULL;
+    }
+    else if (to->cfg_entry[1] == from)
+    {
+        to->cfg_entry[1] = NULL;
+    }
+}
+
+/*
+ * Fold a single instruction, using (and updating) the known constants.
+ */
+static void fold_instruction(Constants *constants, IrBasicBlock *bb, IrInstruction *instr)
+{
+    int left, right, result;
+    bool left_known = constant_get(constants, bb, instr->left, &left);
+    bool right_known = constant_get(constants, bb, instr->right, &right);
+
+    if (instr->immediate)
+    {
+        right = instr->value;
+        right_known = true;
+    }
+
+    switch (instr->op)
+    {
+    case IR_MOV:
+        if (left_known)
+            make_loadi(instr, left);
+        break;
+
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_SLL:
+    case IR_SLR:
+    case IR_OR:
+    case IR_AND:
+    case IR_XOR:
+    case IR_EQ:
+    case IR_LT:
+    case IR_LE:
+        if (left_known && right_known)
+        {
+            if (fold_binary(instr->op, left, right, &result))
+                make_loadi(instr, result);
+        }
+        else if (left_known || right_known || instr->left == instr->right)
+        {
+            if (!simplify_binary(instr, left_known, left, right_known, right))
+                make_immediate(instr, left_known, left, right_known, right);
+        }
+        break;
+
+    case IR_NOT:
+    case IR_FLIP:
+    case IR_SIGN_EXTEND_8:
+    case IR_SIGN_EXTEND_16:
+        if (left_known && fold_unary(instr->op, left, &result))
+            make_loadi(instr, result);
+        break;
+
+    case IR_BRANCHZ:
+        if (left_known)
+        {
+            // The branch always goes the same way.
+            IrBasicBlock *taken = left ? instr->control.jump_true : instr->control.jump_false;
+            IrBasicBlock *untaken = left ? instr->control.jump_false : instr->control.jump_true;
+            if (taken != untaken)
+                cfg_remove_edge(bb, untaken);
+
+            instr->op = IR_JUMP;
+            instr->left = NULL;
+            instr->control.jump_true = taken;
+            instr->control.jump_false = NULL;
+        }
+        break;
+    }
+
+    // Record the (possibly new) value of the destination register.
+    if (IS_VIRTUAL(instr->dest))
+    {
+        int index = instr->dest->index;
+        constants->block[index] = instr->op == IR_LOADI ? bb->index : -1;
+        constants->value[index] = instr->value;
+    }
+}
+
+static void constant_folding(IrFunction *function)
+{
+    int count = function->registers.count;
+    Constants constants = {
+        .block = xmalloc((count + 1) * sizeof(int)),
+        .value = xcalloc(count + 1, sizeof(int)),
+    };
+    int *blocks = xcalloc(count + 1, sizeof(int));
+    bool *live = xcalloc(count + 1, sizeof(bool));
+
+    for (int i = 0; i < count; i++)
+        constants.block[i] = -1;
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            fold_instruction(&constants, bb, instr);
+        }
+    }
+
+    // Remove the constants which are no longer used.
+    find_local_registers(function, blocks);
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        remove_dead_definitions(function, bb, blocks, live, IR_LOADI);
+    }
+
+    renumber_registers(function, blocks);
+    Ir_compact(function);
+
+    xfree(constants.block);
+    xfree(constants.value);
+    xfree(blocks);
+    xfree(live);
+}
+
+/*
+ * Register definitions, for folding an instruction into the only instruction
+ * reading its result.
+ *
+ * 'occurrences' counts the reads and writes of each register, 'defined' counts the
+ * writes, and 'defs' records the (last) instruction defining each register.
+ */
+typedef struct Definitions
+{
+    int *blocks;
+    int *occurrences;
+    int *defined;
+    IrInstruction **defs;
+} Definitions;
+
+static Definitions find_definitions(IrFunction *function)
+{
+    int count = function->registers.count;
+    Definitions definitions = {
+        .blocks = xcalloc(count + 1, sizeof(int)),
+        .occurrences = xcalloc(count + 1, sizeof(int)),
+        .defined = xcalloc(count + 1, sizeof(int)),
+        .defs = xcalloc(count + 1, sizeof(IrInstruction *)),
+    };
+
+    find_local_registers(function, definitions.blocks);
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            IrRegister *regs[] = {instr->left, instr->right, instr->index, instr->dest};
+            for (int i = 0; i < 4; i++)
+            {
+                if (IS_VIRTUAL(regs[i]))
+                    definitions.occurrences[regs[i]->index]++;
+            }
+            if (IS_VIRTUAL(instr->dest))
+            {
+                definitions.defined[instr->dest->index]++;
+                definitions.defs[instr->dest->index] = instr;
+            }
+            if (instr->post_index && IS_VIRTUAL(instr->left))
+                definitions.defined[instr->left->index]++;
+        }
+    }
+    return definitions;
+}
+
+/*
+ * Drop the registers no longer used after folding, and free the definitions.
+ */
+static void finish_definitions(IrFunction *function, Definitions *definitions)
+{
+    renumber_registers(function, definitions->blocks);
+    Ir_compact(function);
+
+    xfree(definitions->blocks);
+    xfree(definitions->occurrences);
+    xfree(definitions->defined);
+    xfree(definitions->defs);
+}
+
+/*
+ * Get the definition of 'reg', if it is local to basic block 'bb', and is only
+ * defined and read once (by the instruction being folded).
+ */
+static IrInstruction *single_definition(Definitions *definitions, IrBasicBlock *bb,
+                                        IrRegister *reg)
+{
+    if (!IS_VIRTUAL(reg) || definitions->blocks[reg->index] != bb->index ||
+        definitions->occurrences[reg->index] != 2)
+        return NULL;
+    return definitions->defs[reg->index];
+}
+
+/*
+ * Get the definition of 'reg', if it is local to basic block 'bb', and only
+ * defined once (it may be read any number of times).
+ */
+static IrInstruction *local_definition(Definitions *definitions, IrBasicBlock *bb,
+                                       IrRegister *reg)
+{
+    if (!IS_VIRTUAL(reg) || definitions->blocks[reg->index] != bb->index ||
+        definitions->defined[reg->index] != 1)
+        return NULL;
+    return definitions->defs[reg->index];
+}
+
+/*
+ * Drop a read of 'reg' (folded into another instruction). The address calculation
+ * defining it is removed once it is no longer read, dropping its own operands.
+ */
+static void release_register(Definitions *definitions, IrBasicBlock *bb, IrRegister *reg)
+{
+    if (!IS_VIRTUAL(reg) || --definitions->occurrences[reg->index] != 1)
+        return;
+
+    IrInstruction *def = local_definition(definitions, bb, reg);
+    if (!def || (def->op != IR_ADD && def->op != IR_SUB && def->op != IR_SLL))
+        return;
+    definitions->occurrences[reg->index]--;
+    Ir_remove_instr(bb, def);
+    release_register(definitions, bb, def->left);
+    release_register(definitions, bb, def->right);
+}
+
+static bool writes_register(IrInstruction *instr, IrRegister *reg)
+{
+    return instr->dest == reg || (instr->post_index && instr->left == reg);
+}
+
+static bool reads_register(IrInstruction *instr, IrRegister *reg)
+{
+    return instr->left == reg || instr->right == reg || instr->index == reg;
+}
+
+/*
+ * Check if 'reg' is redefined after instruction 'from', and before 'to'.
+ */
+static bool redefined_between(IrInstruction *from, IrInstruction *to, IrRegister *reg)
+{
+    for (IrInstruction *instr = from->next; instr != to; instr = instr->next)
+    {
+        if (writes_register(instr, reg))
+            return true;
+    }
+    return false;
+}
+
+static bool is_scaled_index(IrInstruction *instr)
+{
+    return instr && instr->op == IR_SLL && instr->immediate && instr->value > 0 &&
+           instr->value < 32 && IS_VIRTUAL(instr->left);
+}
+
+/*
+ * Fold the address calculation of a load or store into the instruction:
+ *  - t = a + #n; LOAD d, t => LOAD d, [a + n]
+ *  - t = a + b; LOAD d, t => LOAD d, [a + b]
+ *  - s = b << #n; t = a + s; LOAD d, t => LOAD d, [a + (b << n)]
+ * The address may be shared by several loads and stores in the basic block (E.g.
+ * after value numbering), and is removed once they have all been folded.
+ */
+static void fold_address(Definitions *definitions, IrBasicBlock *bb, IrInstruction *instr)
+{
+    IrInstruction *add = local_definition(definitions, bb, instr->left);
+    if (!add || instr->immediate || instr->index)
+        return;
+    IrRegister *address = instr->left;
+
+    if (add->immediate && (add->op == IR_ADD || add->op == IR_SUB))
+    {
+        if (!IS_VIRTUAL(add->left) || redefined_between(add, instr, add->left))
+            return;
+        instr->left = add->left;
+        instr->immediate = true;
+        instr->value = add->op == IR_ADD ? add->value : (int)(0u - (uint32_t)add->value);
+        definitions->occurrences[add->left->index]++;
+        release_register(definitions, bb, address);
+        return;
+    }
+
+    if (add->op != IR_ADD || add->immediate || !IS_VIRTUAL(add->left) ||
+        !IS_VIRTUAL(add->right) || redefined_between(add, instr, add->left) ||
+        redefined_between(add, instr, add->right))
+        return;
+
+    IrRegister *base = add->left, *index = add->right;
+    IrInstruction *shift = local_definition(definitions, bb, index);
+    if (!is_scaled_index(shift))
+    {
+        // Addition is commutative, so either operand may be the scaled index.
+        shift = local_definition(definitions, bb, base);
+        base = add->right;
+        index = add->left;
+    }
+
+    instr->shift = 0;
+    if (is_scaled_index(shift) && !redefined_between(shift, instr, shift->left))
+    {
+        index = shift->left;
+        instr->shift = shift->value;
+    }
+    else
+    {
+        base = add->left;
+        index = add->right;
+    }
+
+    instr->left = base;
+    instr->index = index;
+    definitions->occurrences[base->index]++;
+    definitions->occurrences[index->index]++;
+    release_register(definitions, bb, address);
+}
+
+/*
+ * Address stack objects directly from the stack pointer, wherever the base
+ * register is only defined by an IR_LOADSO (which may be shared by several loads
+ * and stores, after value numbering):
+ *  - t = sp + n; LOAD d, [t + m] => LOAD d, [sp + (n + m)]
+ *  - t = sp + 0; LOAD d, [t + (b << n)] => LOAD d, [sp + (b << n)]
+ */
+static void fold_stack_address(Definitions *definitions, IrInstruction *instr)
+{
+    if (!IS_VIRTUAL(instr->left) || definitions->defined[instr->left->index] != 1)
+        return;
+    IrInstruction *loadso = definitions->defs[instr->left->index];
+    if (loadso->op != IR_LOADSO || (instr->index && loadso->value != 0))
+        return;
+
+    if (!instr->index)
+    {
+        instr->value = (instr->immediate ? instr->value : 0) + loadso->value;
+        instr->immediate = true;
+    }
+    definitions->occurrences[instr->left->index]--;
+    instr->left = NULL;
+}
+
+/*
+ * Increment the address register of a load or store after the access (post-indexed
+ * addressing), where it is incremented next anyway (E.g. a pointer induction
+ * variable, copied back after SSA form):
+ *  - LOAD d, [p]; q = p + #n; p = q => LOAD d, [p], #n
+ */
+static void fold_post_index(Definitions *definitions, IrBasicBlock *bb,
+                            IrInstruction *instr)
+{
+    IrRegister *reg = instr->left;
+    if (!IS_VIRTUAL(reg) || instr->index || instr->immediate || instr->post_index ||
+        instr->dest == reg || instr->right == reg)
+        return;
+
+    IrInstruction *add = instr->next;
+    while (add && !reads_register(add, reg) && !writes_register(add, reg))
+        add = add->next;
+    if (!add || (add->op != IR_ADD && add->op != IR_SUB) || !add->immediate ||
+        !IS_VIRTUAL(add->dest) || definitions->defined[add->dest->index] != 1 ||
+        definitions->occurrences[add->dest->index] != 2)
+        return;
+
+    IrInstruction *mov = add->next;
+    while (mov && !reads_register(mov, reg) && !writes_register(mov, reg) &&
+           !reads_register(mov, add->dest))
+        mov = mov->next;
+    if (!mov || mov->op != IR_MOV || mov->dest != reg || mov->left != add->dest)
+        return;
+
+    // Halfword transfers have a smaller offset range.
+    int value = add->op == IR_ADD ? add->value : -add->value;
+    int limit = instr->op == IR_LOAD16 || instr->op == IR_STORE16 ? 255 : 4095;
+    if (value < -limit || value > limit)
+        return;
+
+    instr->post_index = true;
+    instr->value = value;
+    definitions->occurrences[reg->index] -= 2;
+    definitions->occurrences[add->dest->index] = 0;
+    Ir_remove_instr(bb, add);
+    Ir_remove_instr(bb, mov);
+}
+
+static void addressing_modes(IrFunction *function)
+{
+    Definitions definitions = find_definitions(function);
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            switch (instr->op)
+            {
+            case IR_LOAD8:
+            case IR_LOAD16:
+            case IR_LOAD32:
+            case IR_STORE8:
+            case IR_STORE16:
+            case IR_STORE32:
+                fold_address(&definitions, bb, instr);
+                fold_stack_address(&definitions, instr);
+                fold_post_index(&definitions, bb, instr);
+                break;
+            }
+        }
+    }
+
+    // Remove the IR_LOADSOs no longer used.
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr;)
+        {
+            IrInstruction *next = instr->next;
+            if (instr->op == IR_LOADSO && definitions.occurrences[instr->dest->index] == 1)
+                Ir_remove_instr(bb, instr);
+            instr = next;
+        }
+    }
+
+    finish_definitions(function, &definitions);
+}
+
+/*
+ * Fuse the logical not, or comparison, deciding a conditional branch into the
+ * branch, if its result is only used there:
+ *  - c = !a; BRANCHZ c, T, F => BRANCHZ a, F, T
+ *  - c = a < b; BRANCHZ c, T, F => BRANCH_LT a, b, T, F
+ */
+static void fuse_branch(Definitions *definitions, IrBasicBlock *bb, IrInstruction *branch)
+{
+    IrInstruction *def;
+    while ((def = single_definition(definitions, bb, branch->left)) && def->op == IR_NOT &&
+           IS_VIRTUAL(def->left) && !redefined_between(def, branch, def->left))
+    {
+        IrBasicBlock *jump_true = branch->control.jump_true;
+        branch->control.jump_true = branch->control.jump_false;
+        branch->control.jump_false = jump_true;
+        branch->left = def->left;
+        Ir_remove_instr(bb, def);
+    }
+
+    if (!def || (def->op != IR_EQ && def->op != IR_LT && def->op != IR_LE))
+        return;
+    if (!IS_VIRTUAL(def->left) || redefined_between(def, branch, def->left))
+        return;
+    if (def->right && (!IS_VIRTUAL(def->right) || redefined_between(def, branch, def->right)))
+        return;
+
+    switch (def->op)
+    {
+    case IR_EQ:
+        branch->op = IR_BRANCH_EQ;
+        break;
+    case IR_LT:
+        branch->op = IR_BRANCH_LT;
+        break;
+    case IR_LE:
+        branch->op = IR_BRANCH_LE;
+        break;
+    }
+    branch->left = def->left;
+    branch->right = def->right;
+    branch->value = def->value;
+    branch->immediate = def->immediate;
+    Ir_remove_instr(bb, def);
+}
+
+static void branch_fusion(IrFunction *function)
+{
+    Definitions definitions = find_definitions(function);
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        if (bb->tail->op == IR_BRANCHZ)
+            fuse_branch(&definitions, bb, bb->tail);
+    }
+
+    finish_definitions(function, &definitions);
+}
+
+/*
+ * Remove the instructions after the first terminator in basic block 'bb' (E.g.
+ * following a return statement), which can never be executed.
+ */
+static void remove_after_terminator(IrBasicBlock *bb)
+{
+    for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+    {
+        if (!Ir_is_terminator(instr))
+            continue;
+        while (bb->tail != instr)
+            Ir_remove_instr(bb, bb->tail);
+        return;
+    }
+}
+
+/*
+ * Remove (and free) the basic blocks not reachable from the entry block.
+ */
+static void remove_unreachable_blocks(IrFunction *function)
+{
+    int count = 0, size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        count++;
+        if (bb->index >= size)
+            size = bb->index + 1;
+    }
+
+    // Depth-first search from the entry block.
+    IrBasicBlock **stack = xmalloc(count * sizeof(IrBasicBlock *));
+    bool *reachable = xcalloc(size, sizeof(bool));
+    int top = 0;
+    stack[top++] = function->head;
+    reachable[function->head->index] = true;
+    while (top)
+    {
+        IrBasicBlock *succ[2], *bb = stack[--top];
+        for (int i = Ir_successors(bb, succ) - 1; i >= 0; i--)
+        {
+            if (reachable[succ[i]->index])
+                continue;
+            reachable[succ[i]->index] = true;
+            stack[top++] = succ[i];
+        }
+    }
+
+    IrBasicBlock *tail = function->head;
+    for (IrBasicBlock *bb = function->head->next; bb;)
+    {
+        IrBasicBlock *next = bb->next;
+        if (reachable[bb->index])
+        {
+            tail->next = bb;
+            tail = bb;
+        }
+        else
+        {
+            xfree(bb);
+        }
+        bb = next;
+    }
+    tail->next = NULL;
+    function->tail = tail;
+
+    xfree(stack);
+    xfree(reachable);
+}
+
+/*
+ * Rebuild the CFG edges (IrBasicBlock.cfg_entry) from the successors of each
+ * basic block.
+ */
+static void rebuild_cfg(IrFunction *function)
+{
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        bb->cfg_entry[0] = bb->cfg_entry[1] = NULL;
+
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        IrBasicBlock *succ[2];
+        for (int i = Ir_successors(bb, succ) - 1; i >= 0; i--)
+        {
+            // Each basic block has at most two predecessors (see ir_gen.c).
+            IrBasicBlock **entry = succ[i]->cfg_entry;
+            if (entry[0] != bb && entry[1] != bb)
+                *(entry[0] ? entry + 1 : entry) = bb;
+        }
+    }
+}
+
+/*
+ * Find the registers live on exit from basic block 'bb' (live on entry to any of
+ * its successors), given 'live_entry' for each block position.
+ */
+static void live_exit(IrBasicBlock *bb, bool *live, bool *live_entry, int *position,
+                      int regs)
+{
+    IrBasicBlock *succ[2];
+    for (int r = 0; r < regs; r++)
+        live[r] = false;
+    for (int i = Ir_successors(bb, succ) - 1; i >= 0; i--)
+    {
+        bool *entry = live_entry + position[succ[i]->index] * regs;
+        for (int r = 0; r < regs; r++)
+            live[r] |= entry[r];
+    }
+}
+
+/*
+ * Remove instructions whose REG_ANY destination is never read (on any path
+ * through the function), other than calls. Registers live on entry to each basic
+ * block are found by iterative dataflow analysis. Returns the number of
+ * instructions removed.
+ */
+static int remove_dead_instructions(IrFunction *function)
+{
+    int regs = function->registers.count, count = 0, size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        count++;
+        if (bb->index >= size)
+            size = bb->index + 1;
+    }
+
+    // 'gen' marks the registers read before they are written in each basic block,
+    // and 'kill' those written.
+    IrBasicBlock **blocks = xmalloc(count * sizeof(IrBasicBlock *));
+    int *position = xmalloc(size * sizeof(int));
+    bool *gen = xcalloc(count * regs + 1, sizeof(bool));
+    bool *kill = xcalloc(count * regs + 1, sizeof(bool));
+    bool *live_entry = xcalloc(count * regs + 1, sizeof(bool));
+    bool *live = xcalloc(regs + 1, sizeof(bool));
+
+    count = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        bool *bb_gen = gen + count * regs, *bb_kill = kill + count * regs;
+        for (IrInstruction *instr = bb->tail; instr; instr = instr->prev)
+        {
+            if (IS_VIRTUAL(instr->dest))
+            {
+                bb_gen[instr->dest->index] = false;
+                bb_kill[instr->dest->index] = true;
+            }
+            IrRegister *uses[] = {instr->left, instr->right, instr->index};
+            for (int i = 0; i < 3; i++)
+            {
+                if (IS_VIRTUAL(uses[i]))
+                    bb_gen[uses[i]->index] = true;
+            }
+        }
+        position[bb->index] = count;
+        blocks[count++] = bb;
+    }
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int i = count - 1; i >= 0; i--)
+        {
+            live_exit(blocks[i], live, live_entry, position, regs);
+            bool *entry = live_entry + i * regs;
+            for (int r = 0; r < regs; r++)
+            {
+                bool value = gen[i * regs + r] || (live[r] && !kill[i * regs + r]);
+                changed |= value != entry[r];
+                entry[r] = value;
+            }
+        }
+    }
+
+    int removed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        live_exit(blocks[i], live, live_entry, position, regs);
+        for (IrInstruction *instr = blocks[i]->tail; instr;)
+        {
+            IrInstruction *prev = instr->prev;
+            if (IS_VIRTUAL(instr->dest) && !live[instr->dest->index] &&
+                instr->op != IR_CALL)
+            {
+                Ir_remove_instr(blocks[i], instr);
+                removed++;
+            }
+            else
+            {
+                if (IS_VIRTUAL(instr->dest))
+                    live[instr->dest->index] = false;
+                IrRegister *uses[] = {instr->left, instr->right, instr->index};
+                for (int u = 0; u < 3; u++)
+                {
+                    if (IS_VIRTUAL(uses[u]))
+                        live[uses[u]->index] = true;
+                }
+            }
+            instr = prev;
+        }
+    }
+
+    xfree(blocks);
+    xfree(position);
+    xfree(gen);
+    xfree(kill);
+    xfree(live_entry);
+    xfree(live);
+    return removed;
+}
+
+static void dead_code(IrFunction *function)
+{
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        remove_after_terminator(bb);
+    remove_unreachable_blocks(function);
+    rebuild_cfg(function);
+
+    // Removing an instruction may leave the definitions of its operands unused.
+    while (remove_dead_instructions(function))
+        ;
+
+    int *blocks = xcalloc(function->registers.count + 1, sizeof(int));
+    renumber_registers(function, blocks);
+    Ir_compact(function);
+    xfree(blocks);
+}
+
+/*
+ * Value numbering state (for a function in SSA form).
+ *
+ * Each register is numbered by the register first holding its value ('values', by
+ * register index; NULL if the register is its own value, and possibly a chain
+ * where a register was replaced before its value was numbered). The instructions
+ * computing each value are kept in a hash table, scoped to the dominator subtree
+ * of their basic block: 'entries' is a stack, popped on leaving each block, and
+ * each bucket is a chain through the stack.
+ *
+ * Loads are only equivalent with the same memory state ('memory'), which changes
+ * after each store or call, and on entry to join points (where stores on another
+ * path may reach). A word stored is entered as a load of the same address
+ * ('forwards'), so the load is replaced with the register stored.
+ */
+typedef struct ValueTable
+{
+    IrRegister **values;
+
+    int *buckets;
+    unsigned int mask;
+    struct
+    {
+        IrInstruction *instr;
+        int memory;
+        unsigned int hash;
+        int next;
+    } *entries;
+    int entry_count;
+    IrInstruction *forwards;
+
+    IrBasicBlock **first_child, **next_sibling;
+    int *memory_exit;
+    int memory, memory_count;
+} ValueTable;
+
+static IrRegister *value_of(ValueTable *table, IrRegister *reg)
+{
+    while (IS_VIRTUAL(reg) && table->values[reg->index])
+        reg = table->values[reg->index];
+    return reg;
+}
+
+static bool is_load(IrOpcode op)
+{
+    return op == IR_LOAD8 || op == IR_LOAD16 || op == IR_LOAD32;
+}
+
+/*
+ * Check if an instruction computes a value from its operands alone (and memory,
+ * for loads), so it can be replaced with an earlier instruction computing the same.
+ */
+static bool is_pure(IrInstruction *instr)
+{
+    if (!IS_VIRTUAL(instr->dest))
+        return false;
+
+    switch (instr->op)
+    {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_SLL:
+    case IR_SLR:
+    case IR_OR:
+    case IR_AND:
+    case IR_NOT:
+    case IR_FLIP:
+    case IR_XOR:
+    case IR_EQ:
+    case IR_LT:
+    case IR_LE:
+    case IR_SIGN_EXTEND_8:
+    case IR_SIGN_EXTEND_16:
+    case IR_LOAD8:
+    case IR_LOAD16:
+    case IR_LOAD32:
+    case IR_LOADI:
+    case IR_LOADSO:
+    case IR_PHI:
+        return true;
+    }
+    return false;
+}
+
+static bool has_value(IrInstruction *instr)
+{
+    return instr->immediate || instr->op == IR_LOADI || instr->op == IR_LOADSO;
+}
+
+static int register_order(IrRegister *reg)
+{
+    return reg ? reg->index * 2 + (reg->type == REG_ANY) : -1;
+}
+
+static unsigned int value_hash(IrInstruction *instr, int memory)
+{
+    unsigned int hash = instr->op;
+    hash = hash * 31 + register_order(instr->left);
+    hash = hash * 31 + register_order(instr->right);
+    hash = hash * 31 + register_order(instr->index);
+    hash = hash * 31 + (has_value(instr) ? instr->value : 0);
+    hash = hash * 31 + (instr->index ? instr->shift : 0);
+    hash = hash * 31 + memory;
+    if (instr->op == IR_PHI)
+        hash = hash * 31 + instr->control.jump_true->index;
+    return hash * 2654435761u;
+}
+
+static bool same_value(IrInstruction *a, IrInstruction *b)
+{
+    if (a->op != b->op || a->left != b->left || a->right != b->right ||
+        a->index != b->index || a->immediate != b->immediate)
+        return false;
+    if (has_value(a) && a->value != b->value)
+        return false;
+    if (a->index && a->shift != b->shift)
+        return false;
+    if (a->op == IR_PHI && (a->control.jump_true != b->control.jump_true ||
+                            a->control.jump_false != b->control.jump_false))
+        return false;
+    return true;
+}
+
+/*
+ * Get the value selected by a phi with a single distinct operand (ignoring the phi
+ * itself, around a loop), or NULL.
+ */
+static IrRegister *trivial_phi(IrInstruction *phi)
+{
+    if (!phi->control.jump_false || phi->right == phi->left || phi->right == phi->dest)
+        return phi->left;
+    if (phi->left == phi->dest)
+        return phi->right;
+    return NULL;
+}
+
+/*
+ * Find an earlier (dominating) instruction computing the same value as 'instr', or
+ * add 'instr' to the table.
+ */
+static IrInstruction *value_lookup(ValueTable *table, IrInstruction *instr)
+{
+    int memory = is_load(instr->op) ? table->memory : 0;
+    unsigned int hash = value_hash(instr, memory);
+    int *bucket = &table->buckets[hash & table->mask];
+
+    for (int e = *bucket; e >= 0; e = table->entries[e].next)
+    {
+        if (table->entries[e].hash == hash && table->entries[e].memory == memory &&
+            same_value(table->entries[e].instr, instr))
+            return table->entries[e].instr;
+    }
+
+    int e = table->entry_count++;
+    table->entries[e].instr = instr;
+    table->entries[e].memory = memory;
+    table->entries[e].hash = hash;
+    table->entries[e].next = *bucket;
+    *bucket = e;
+    return NULL;
+}
+
+/*
+ * Number the values computed in basic block 'bb', removing instructions which
+ * recompute a value (or copy a register), then the blocks it dominates.
+ */
+static void value_number_block(IrFunction *function, ValueTable *table, IrBasicBlock *bb)
+{
+    int entry_count = table->entry_count;
+
+    // Stores on another path may reach a join point.
+    if (bb->cfg_entry[1] || !bb->cfg_entry[0])
+        table->memory = ++table->memory_count;
+    else
+        table->memory = table->memory_exit[bb->cfg_entry[0]->index];
+
+    for (IrInstruction *instr = bb->head; instr;)
+    {
+        IrInstruction *next = instr->next;
+        instr->left = value_of(table, instr->left);
+        instr->right = value_of(table, instr->right);
+        instr->index = value_of(table, instr->index);
+
+        IrRegister *value = NULL;
+        if (instr->op == IR_MOV && IS_VIRTUAL(instr->dest) && IS_VIRTUAL(instr->left))
+        {
+            value = instr->left;
+            function->movs_removed++;
+        }
+        else if (instr->op == IR_PHI && (value = trivial_phi(instr)))
+        {
+            function->redundant_removed++;
+        }
+        else if (is_pure(instr))
+        {
+            // Commutative operations are numbered with their operands in order.
+            bool commutative = instr->op == IR_ADD || instr->op == IR_MUL ||
+                               instr->op == IR_OR || instr->op == IR_AND ||
+                               instr->op == IR_XOR || instr->op == IR_EQ;
+            if (commutative && instr->right &&
+                register_order(instr->left) > register_order(instr->right))
+            {
+                IrRegister *left = instr->left;
+                instr->left = instr->right;
+                instr->right = left;
+            }
+
+            IrInstruction *earlier = value_lookup(table, instr);
+            if (earlier)
+            {
+                value = earlier->dest;
+                function->redundant_removed++;
+            }
+        }
+        else if (instr->op == IR_STORE8 || instr->op == IR_STORE16 ||
+                 instr->op == IR_STORE32 || instr->op == IR_CALL)
+        {
+            table->memory = ++table->memory_count;
+            if (instr->op == IR_STORE32 && IS_VIRTUAL(instr->right))
+            {
+                IrInstruction *load = &table->forwards[table->entry_count];
+                *load = *instr;
+                load->op = IR_LOAD32;
+                load->dest = instr->right;
+                load->right = NULL;
+                value_lookup(table, load);
+            }
+        }
+
+        // (A copy of itself is never removed, so 'values' has no cycles.)
+        if (value && value != instr->dest)
+        {
+            table->values[instr->dest->index] = value;
+            Ir_remove_instr(bb, instr);
+        }
+        instr = next;
+    }
+    table->memory_exit[bb->index] = table->memory;
+
+    for (IrBasicBlock *child = table->first_child[bb->index]; child;
+         child = table->next_sibling[child->index])
+    {
+        value_number_block(function, table, child);
+    }
+
+    // Leave the scope of this block.
+    while (table->entry_count > entry_count)
+    {
+        table->entry_count--;
+        table->buckets[table->entries[table->entry_count].hash & table->mask] =
+            table->entries[table->entry_count].next;
+    }
+}
+
+static void value_numbering(IrFunction *function)
+{
+    int count = function->registers.count, instrs = 0, size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        if (bb->index >= size)
+            size = bb->index + 1;
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+            instrs++;
+    }
+
+    unsigned int buckets = 16;
+    while (buckets < 2 * (unsigned int)instrs)
+        buckets *= 2;
+    ValueTable table = {
+        .values = xcalloc(count + 1, sizeof(IrRegister *)),
+        .buckets = xmalloc(buckets * sizeof(int)),
+        .mask = buckets - 1,
+        .entries = xmalloc((instrs + 1) * sizeof(table.entries[0])),
+        .forwards = xmalloc((instrs + 1) * sizeof(IrInstruction)),
+        .first_child = xcalloc(size, sizeof(IrBasicBlock *)),
+        .next_sibling = xcalloc(size, sizeof(IrBasicBlock *)),
+        .memory_exit = xcalloc(size, sizeof(int)),
+    };
+    for (unsigned int i = 0; i < buckets; i++)
+        table.buckets[i] = -1;
+
+    // Build the dominator tree (in reverse, so children are walked in block order).
+    IrBasicBlock **blocks = xmalloc(size * sizeof(IrBasicBlock *));
+    int block_count = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        blocks[block_count++] = bb;
+    for (int i = block_count - 1; i > 0; i--)
+    {
+        IrBasicBlock *bb = blocks[i];
+        if (!bb->idom)
+            continue;
+        table.next_sibling[bb->index] = table.first_child[bb->idom->index];
+        table.first_child[bb->idom->index] = bb;
+    }
+    value_number_block(function, &table, function->head);
+
+    // Uses not dominated by the instruction removed (E.g. phi operands around a
+    // loop) still refer to its result. Replacing them may leave more trivial phis.
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        {
+            for (IrInstruction *instr = bb->head; instr;)
+            {
+                IrInstruction *next = instr->next;
+                instr->left = value_of(&table, instr->left);
+                instr->right = value_of(&table, instr->right);
+                instr->index = value_of(&table, instr->index);
+
+                IrRegister *value = instr->op == IR_PHI ? trivial_phi(instr) : NULL;
+                if (value && value != instr->dest)
+                {
+                    table.values[instr->dest->index] = value;
+                    Ir_remove_instr(bb, instr);
+                    function->redundant_removed++;
+                    changed = true;
+                }
+                instr = next;
+            }
+        }
+    }
+
+    int *local = xcalloc(count + 1, sizeof(int));
+    renumber_registers(function, local);
+    Ir_compact(function);
+
+    xfree(local);
+    xfree(blocks);
+    xfree(table.values);
+    xfree(table.buckets);
+    xfree(table.entries);
+    xfree(table.forwards);
+    xfree(table.first_child);
+    xfree(table.next_sibling);
+    xfree(table.memory_exit);
+}
+
+/*
+ * A natural loop: the basic blocks from which 'latch' is reachable without passing
+ * through 'header' (which dominates the latch), and the header itself ('body', by
+ * basic block index).
+ */
+typedef struct Loop
+{
+    IrBasicBlock *header, *latch, *preheader;
+    bool *body;
+    int size;
+} Loop;
+
+static bool dominates(IrBasicBlock *a, IrBasicBlock *b)
+{
+    for (; b; b = b->idom)
+    {
+        if (b == a)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Get the preheader of a loop: the predecessor entering the header, if that only
+ * jumps to the header, or else a new basic block inserted between them.
+ */
+static IrBasicBlock *loop_preheader(IrFunction *function, Loop *loop)
+{
+    IrBasicBlock *header = loop->header, *succ[2];
+    int p = header->cfg_entry[0] == loop->latch ? 1 : 0;
+    IrBasicBlock *pred = header->cfg_entry[p];
+    if (!pred)
+        return NULL;
+    if (Ir_successors(pred, succ) == 1)
+        return pred;
+
+    IrBasicBlock *preheader = xcalloc(1, sizeof(IrBasicBlock));
+    preheader->index = Ir_new_block_index(function);
+    preheader->idom = pred;
+    preheader->cfg_entry[0] = pred;
+    Ir_emit_instr(function, preheader, (IrInstruction){.op = IR_NOP});
+    Ir_emit_instr(function, preheader,
+                  (IrInstruction){.op = IR_JUMP, .control.jump_true = header});
+    header->cfg_entry[p] = preheader;
+    header->idom = preheader;
+
+    if (pred->tail->control.jump_true == header)
+        pred->tail->control.jump_true = preheader;
+    if (pred->tail->control.jump_false == header)
+        pred->tail->control.jump_false = preheader;
+    for (IrInstruction *phi = header->head; phi; phi = phi->next)
+    {
+        if (phi->op != IR_PHI)
+            continue;
+        if (phi->control.jump_true == pred)
+            phi->control.jump_true = preheader;
+        if (phi->control.jump_false == pred)
+            phi->control.jump_false = preheader;
+    }
+
+    preheader->next = pred->next;
+    pred->next = preheader;
+    if (function->tail == pred)
+        function->tail = preheader;
+    return preheader;
+}
+
+/*
+ * Find the natural loop of each back edge (from a block to a successor dominating
+ * it), with a preheader, and set the loop depth of each basic block. Returns the
+ * number of loops, innermost (smallest) first.
+ */
+static int find_loops(IrFunction *function, Loop **loops)
+{
+    int count = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        count++;
+
+    // Each block has at most two successors, so two back edges.
+    *loops = xcalloc(2 * count, sizeof(Loop));
+    int loop_count = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        IrBasicBlock *succ[2];
+        for (int i = Ir_successors(bb, succ) - 1; i >= 0; i--)
+        {
+            if (dominates(succ[i], bb))
+                (*loops)[loop_count++] = (Loop){.header = succ[i], .latch = bb};
+        }
+    }
+    for (int l = 0; l < loop_count; l++)
+        (*loops)[l].preheader = loop_preheader(function, &(*loops)[l]);
+
+    int size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        if (bb->index >= size)
+            size = bb->index + 1;
+    }
+
+    // Inserting a preheader adds one block for each loop. Each block is pushed by
+    // at most two successors.
+    IrBasicBlock **stack = xmalloc((2 * (count + loop_count) + 1) * sizeof(IrBasicBlock *));
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        bb->loop_depth = 0;
+    for (int l = 0; l < loop_count; l++)
+    {
+        Loop *loop = &(*loops)[l];
+        loop->body = xcalloc(size, sizeof(bool));
+        loop->body[loop->header->index] = true;
+        loop->header->loop_depth++;
+        loop->size = 1;
+
+        int top = 0;
+        stack[top++] = loop->latch;
+        while (top > 0)
+        {
+            IrBasicBlock *bb = stack[--top];
+            if (loop->body[bb->index])
+                continue;
+            loop->body[bb->index] = true;
+            bb->loop_depth++;
+            loop->size++;
+            for (int p = 0; p < 2; p++)
+            {
+                if (bb->cfg_entry[p])
+                    stack[top++] = bb->cfg_entry[p];
+            }
+        }
+    }
+    xfree(stack);
+
+    // Sort innermost first, so instructions hoisted out of an inner loop may then
+    // be hoisted out of the enclosing loop.
+    for (int i = 1; i < loop_count; i++)
+    {
+        Loop loop = (*loops)[i];
+        int j = i;
+        for (; j > 0 && (*loops)[j - 1].size > loop.size; j--)
+            (*loops)[j] = (*loops)[j - 1];
+        (*loops)[j] = loop;
+    }
+    return loop_count;
+}
+
+/*
+ * Check if an instruction may be executed before the loop containing it, even if
+ * it would not have been (E.g. in a loop which runs no iterations). Loads may
+ * fault, or see a store in the loop, and division by zero traps.
+ */
+static bool is_hoistable(IrInstruction *instr)
+{
+    if (!is_pure(instr) || is_load(instr->op) || instr->op == IR_PHI)
+        return false;
+    if (instr->op == IR_DIV || instr->op == IR_MOD)
+        return instr->immediate && instr->value != 0;
+    return true;
+}
+
+/*
+ * Hoist the instructions in a loop whose operands are all defined outside of it
+ * into the preheader. Returns the number of instructions hoisted.
+ */
+static int hoist_invariants(Loop *loop, IrFunction *function, IrBasicBlock **def_block)
+{
+    int hoisted = 0;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        {
+            if (!loop->body[bb->index])
+                continue;
+            for (IrInstruction *instr = bb->head; instr;)
+            {
+                IrInstruction *next = instr->next;
+                bool invariant = is_hoistable(instr);
+                IrRegister *uses[] = {instr->left, instr->right, instr->index};
+                for (int i = 0; i < 3 && invariant; i++)
+                {
+                    // Reserved registers (E.g. arguments) may change in the loop.
+                    if (uses[i] && (!IS_VIRTUAL(uses[i]) ||
+                                    loop->body[def_block[uses[i]->index]->index]))
+                        invariant = false;
+                }
+
+                if (invariant)
+                {
+                    Ir_remove_instr(bb, instr);
+                    Ir_emit_instr_before(loop->preheader->tail, instr);
+                    def_block[instr->dest->index] = loop->preheader;
+                    hoisted++;
+                    changed = true;
+                }
+                instr = next;
+            }
+        }
+    }
+    return hoisted;
+}
+
+static void loop_invariant_code_motion(IrFunction *function)
+{
+    Loop *loops;
+    int loop_count = find_loops(function, &loops);
+
+    IrBasicBlock **def_block = xcalloc(function->registers.count + 1, sizeof(IrBasicBlock *));
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            if (IS_VIRTUAL(instr->dest))
+                def_block[instr->dest->index] = bb;
+        }
+    }
+
+    for (int l = 0; l < loop_count; l++)
+    {
+        if (loops[l].preheader)
+            function->invariants_hoisted += hoist_invariants(&loops[l], function, def_block);
+        xfree(loops[l].body);
+    }
+
+    xfree(def_block);
+    xfree(loops);
+}
+
+/*
+ * Induction variable state (for a function in SSA form): the instruction and basic
+ * block defining each register, and the number of instructions reading it.
+ * Registers added by the pass are counted too, so the arrays have room for them.
+ */
+typedef struct Induction
+{
+    IrInstruction **defs;
+    IrBasicBlock **def_block;
+    int *uses;
+} Induction;
+
+/*
+ * A basic induction variable: i = PHI(init, i + step), where 'phi' selects 'init'
+ * on entry from the preheader, and the result of 'increment' from the latch.
+ */
+typedef struct BasicInduction
+{
+    IrInstruction *phi, *increment;
+    IrRegister *init;
+    int step;
+} BasicInduction;
+
+/*
+ * Addresses base + ((i + offset) << shift), for the basic induction variable
+ * 'var' and a loop-invariant base, are replaced with an offset from 'pointer'
+ * (p = PHI(base + (init << shift), p + (step << shift))), whose initial value is
+ * 'start'.
+ */
+typedef struct DerivedInduction
+{
+    int var;
+    IrRegister *base;
+    int shift;
+    bool reduce;
+    IrRegister *pointer, *start;
+} DerivedInduction;
+
+typedef struct DerivedAccess
+{
+    IrInstruction *mem;
+    int derived, offset;
+} DerivedAccess;
+
+static IrInstruction *iv_definition(Induction *iv, IrRegister *reg)
+{
+    return IS_VIRTUAL(reg) ? iv->defs[reg->index] : NULL;
+}
+
+static bool is_memory(IrOpcode op)
+{
+    return is_load(op) || op == IR_STORE8 || op == IR_STORE16 || op == IR_STORE32;
+}
+
+static bool is_invariant(Induction *iv, Loop *loop, IrRegister *reg)
+{
+    return IS_VIRTUAL(reg) && iv->def_block[reg->index] &&
+           !loop->body[iv->def_block[reg->index]->index];
+}
+
+/*
+ * Record a new (or moved) instruction's definition and reads.
+ */
+static void iv_add(Induction *iv, IrBasicBlock *bb, IrInstruction *instr)
+{
+    IrRegister *uses[] = {instr->left, instr->right, instr->index};
+    for (int i = 0; i < 3; i++)
+    {
+        if (IS_VIRTUAL(uses[i]))
+            iv->uses[uses[i]->index]++;
+    }
+    if (IS_VIRTUAL(instr->dest))
+    {
+        iv->defs[instr->dest->index] = instr;
+        iv->def_block[instr->dest->index] = bb;
+    }
+}
+
+static IrRegister *iv_emit(IrFunction *function, Induction *iv, IrBasicBlock *bb,
+                           IrInstruction *before, IrInstruction instr)
+{
+    instr.dest = Ir_new_register(function);
+    IrInstruction *new = Ir_new_instr(function, instr);
+    Ir_emit_instr_before(before, new);
+    iv_add(iv, bb, new);
+    return new->dest;
+}
+
+/*
+ * Check if a phi in the loop header is a basic induction variable.
+ */
+static bool basic_induction(Induction *iv, Loop *loop, IrInstruction *phi,
+                            BasicInduction *basic)
+{
+    if (phi->op != IR_PHI || !phi->control.jump_false)
+        return false;
+    bool entry_left = phi->control.jump_true == loop->preheader;
+    if (!entry_left && phi->control.jump_false != loop->preheader)
+        return false;
+
+    IrInstruction *increment = iv_definition(iv, entry_left ? phi->right : phi->left);
+    if (!increment || !loop->body[iv->def_block[increment->dest->index]->index] ||
+        (increment->op != IR_ADD && increment->op != IR_SUB) || !increment->immediate ||
+        increment->left != phi->dest || increment->value == 0)
+        return false;
+
+    *basic = (BasicInduction){
+        .phi = phi,
+        .increment = increment,
+        .init = entry_left ? phi->left : phi->right,
+        .step = increment->op == IR_ADD ? increment->value : -increment->value,
+    };
+    return true;
+}
+
+/*
+ * Match the address of a load or store against base + ((i + offset) << shift),
+ * for one of the basic induction variables 'basics'. Returns the index of the
+ * variable, or -1.
+ */
+static int derived_address(Induction *iv, Loop *loop, BasicInduction *basics, int count,
+                           IrInstruction *mem, IrRegister **base, int *offset, int *shift)
+{
+    IrInstruction *add = iv_definition(iv, mem->left);
+    if (mem->index || mem->post_index || !add || add->op != IR_ADD || add->immediate)
+        return -1;
+
+    // Addition is commutative, so either operand may be the base.
+    for (int side = 0; side < 2; side++)
+    {
+        *base = side ? add->right : add->left;
+        IrRegister *var = side ? add->left : add->right;
+        if (!is_invariant(iv, loop, *base))
+            continue;
+
+        IrInstruction *def = iv_definition(iv, var);
+        *shift = 0;
+        if (def && def->op == IR_SLL && def->immediate && def->value > 0 && def->value < 31)
+        {
+            *shift = def->value;
+            var = def->left;
+            def = iv_definition(iv, var);
+        }
+        *offset = 0;
+        if (def && def->immediate && (def->op == IR_ADD || def->op == IR_SUB))
+        {
+            *offset = def->op == IR_ADD ? def->value : -def->value;
+            var = def->left;
+        }
+
+        for (int b = 0; b < count; b++)
+        {
+            if (basics[b].phi->dest == var)
+                return b;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Find the exit test of a loop comparing a basic induction variable, counting up
+ * from a constant, with a constant (c = i < n, or i <= n; BRANCHZ c in the header,
+ * leaving the loop if false), and the value of the variable on leaving the loop
+ * ('end'). Returns NULL if there is none, or the value may overflow.
+ */
+static IrInstruction *exit_test(Induction *iv, Loop *loop, BasicInduction *basic,
+                                int shift, int64_t *end)
+{
+    IrInstruction *branch = loop->header->tail;
+    if (branch->op != IR_BRANCHZ || !loop->body[branch->control.jump_true->index] ||
+        loop->body[branch->control.jump_false->index])
+        return NULL;
+
+    IrInstruction *cmp = iv_definition(iv, branch->left);
+    IrInstruction *init = iv_definition(iv, basic->init);
+    if (!cmp || (cmp->op != IR_LT && cmp->op != IR_LE) || cmp->left != basic->phi->dest ||
+        iv->uses[cmp->dest->index] != 1 || !init || init->op != IR_LOADI || basic->step < 0)
+        return NULL;
+
+    IrInstruction *limit = cmp->immediate ? cmp : iv_definition(iv, cmp->right);
+    if (!limit || (limit != cmp && limit->op != IR_LOADI))
+        return NULL;
+
+    // The variable leaves the loop at the first value in its sequence reaching the
+    // limit, so the test can be for (in)equality.
+    int64_t first = init->value, last = (int64_t)limit->value + (cmp->op == IR_LE);
+    int64_t trips = last > first ? (last - first + basic->step - 1) / basic->step : 0;
+    *end = first + trips * basic->step;
+    if (*end > INT32_MAX || ((*end - first) << shift) > INT32_MAX)
+        return NULL;
+    return cmp;
+}
+
+/*
+ * Check if every read of 'reg' (other than by 'skip', or 'skip_other') is in the
+ * loop, and only calculates the address of loads and stores (through offsets and
+ * scaling, or adding a loop-invariant base).
+ */
+static bool only_addresses(Induction *iv, IrFunction *function, Loop *loop,
+                           IrRegister *reg, IrInstruction *skip, IrInstruction *skip_other)
+{
+    int reads = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr && loop->body[bb->index];
+             instr = instr->next)
+        {
+            if (!reads_register(instr, reg))
+                continue;
+            reads++;
+            if (instr == skip || instr == skip_other)
+                continue;
+            if (is_memory(instr->op) && instr->right != reg && instr->index != reg)
+                continue;
+
+            bool offset = (instr->op == IR_ADD || instr->op == IR_SUB || instr->op == IR_SLL) &&
+                          instr->immediate;
+            bool base = instr->op == IR_ADD && !instr->immediate &&
+                        is_invariant(iv, loop, instr->left == reg ? instr->right : instr->left);
+            if (!(offset || base) ||
+                !only_addresses(iv, function, loop, instr->dest, NULL, NULL))
+                return false;
+        }
+    }
+    return reads == iv->uses[reg->index];
+}
+
+/*
+ * Remove the pure instructions whose result is no longer read (E.g. address
+ * calculations replaced by an induction variable).
+ */
+static void remove_unused(Induction *iv, IrFunction *function)
+{
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        {
+            for (IrInstruction *instr = bb->head; instr;)
+            {
+                IrInstruction *next = instr->next;
+                if (is_pure(instr) && !iv->uses[instr->dest->index])
+                {
+                    IrRegister *uses[] = {instr->left, instr->right, instr->index};
+                    for (int i = 0; i < 3; i++)
+                    {
+                        if (IS_VIRTUAL(uses[i]))
+                            iv->uses[uses[i]->index]--;
+                    }
+                    Ir_remove_instr(bb, instr);
+                    changed = true;
+                }
+                instr = next;
+            }
+        }
+    }
+}
+
+/*
+ * Add the pointer induction variable replacing a derived address.
+ */
+static void reduce_induction(IrFunction *function, Induction *iv, Loop *loop,
+                             BasicInduction *basic, DerivedInduction *derived)
+{
+    IrBasicBlock *preheader = loop->preheader;
+    IrInstruction *init = iv_definition(iv, basic->init);
+    IrInstruction *base = iv_definition(iv, derived->base);
+    int shift = derived->shift;
+
+    // start = base + (init << shift), folding constants.
+    if (init && init->op == IR_LOADI && base && base->op == IR_LOADSO)
+    {
+        int offset = base->value + (int)((uint32_t)init->value << shift);
+        derived->start = iv_emit(function, iv, preheader, preheader->tail,
+                                 (IrInstruction){.op = IR_LOADSO, .value = offset});
+    }
+    else if (init && init->op == IR_LOADI)
+    {
+        derived->start = iv_emit(function, iv, preheader, preheader->tail,
+                                 (IrInstruction){.op = IR_ADD,
+                                                 .left = derived->base,
+                                                 .value = (int)((uint32_t)init->value << shift),
+                                                 .immediate = true});
+    }
+    else
+    {
+        IrRegister *scaled = basic->init;
+        if (shift)
+            scaled = iv_emit(function, iv, preheader, preheader->tail,
+                             (IrInstruction){.op = IR_SLL,
+                                             .left = basic->init,
+                                             .value = shift,
+                                             .immediate = true});
+        derived->start = iv_emit(function, iv, preheader, preheader->tail,
+                                 (IrInstruction){.op = IR_ADD,
+                                                 .left = derived->base,
+                                                 .right = scaled});
+    }
+
+    // p = PHI(start, next), next = p + (step << shift), alongside the basic variable.
+    IrInstruction *phi = Ir_new_instr(function, *basic->phi);
+    phi->dest = derived->pointer = Ir_new_register(function);
+    IrInstruction *increment = Ir_new_instr(function, (IrInstruction){
+        .op = IR_ADD,
+        .dest = Ir_new_register(function),
+        .left = derived->pointer,
+        .value = (int)((uint32_t)basic->step << shift),
+        .immediate = true,
+    });
+    if (phi->control.jump_true == preheader)
+    {
+        phi->left = derived->start;
+        phi->right = increment->dest;
+    }
+    else
+    {
+        phi->left = increment->dest;
+        phi->right = derived->start;
+    }
+
+    Ir_emit_instr_after(basic->phi, phi);
+    Ir_emit_instr_after(basic->increment, increment);
+    iv_add(iv, loop->header, phi);
+    iv_add(iv, iv->def_block[basic->increment->dest->index], increment);
+}
+
+/*
+ * Replace the exit test on a basic induction variable with a test on a pointer
+ * derived from it, and remove the variable, if it is no longer used otherwise.
+ */
+static void replace_exit_test(IrFunction *function, Induction *iv, Loop *loop,
+                              BasicInduction *basic, DerivedInduction *derived)
+{
+    int64_t end;
+    IrInstruction *cmp = exit_test(iv, loop, basic, derived->shift, &end);
+    IrInstruction *increment = basic->increment;
+    if (!cmp || iv->uses[basic->phi->dest->index] != 2 ||
+        iv->uses[increment->dest->index] != 1)
+        return;
+
+    IrInstruction *init = iv_definition(iv, basic->init);
+    IrInstruction *start = iv_definition(iv, derived->start);
+    int distance = (int)((end - init->value) << derived->shift);
+    IrInstruction last_instr = {
+        .op = IR_ADD,
+        .left = derived->start,
+        .value = distance,
+        .immediate = true,
+    };
+    if (start->op == IR_LOADSO)
+        last_instr = (IrInstruction){.op = IR_LOADSO, .value = start->value + distance};
+    IrRegister *last = iv_emit(function, iv, loop->preheader, loop->preheader->tail,
+                               last_instr);
+
+    // c = i < n => c = (p == last), with the branch targets swapped.
+    if (IS_VIRTUAL(cmp->right))
+        iv->uses[cmp->right->index]--;
+    cmp->op = IR_EQ;
+    cmp->left = derived->pointer;
+    cmp->right = last;
+    cmp->immediate = false;
+    iv->uses[derived->pointer->index]++;
+    iv->uses[last->index]++;
+
+    IrInstruction *branch = loop->header->tail;
+    IrBasicBlock *jump_true = branch->control.jump_true;
+    branch->control.jump_true = branch->control.jump_false;
+    branch->control.jump_false = jump_true;
+
+    iv->uses[basic->init->index]--;
+    Ir_remove_instr(loop->header, basic->phi);
+    Ir_remove_instr(iv->def_block[increment->dest->index], increment);
+}
+
+static void reduce_loop(IrFunction *function, Induction *iv, Loop *loop)
+{
+    int count = 0, accesses = 0;
+    for (IrInstruction *instr = loop->header->head; instr; instr = instr->next)
+        count += instr->op == IR_PHI;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr && loop->body[bb->index];
+             instr = instr->next)
+            accesses += is_memory(instr->op);
+    }
+    if (!count || !accesses)
+        return;
+
+    BasicInduction *basics = xmalloc(count * sizeof(BasicInduction));
+    count = 0;
+    for (IrInstruction *instr = loop->header->head; instr; instr = instr->next)
+    {
+        if (basic_induction(iv, loop, instr, &basics[count]))
+            count++;
+    }
+
+    // A basic variable may be removed, once its addresses are replaced with a
+    // pointer, if it is otherwise only used to increment it and test for the exit.
+    bool *removable = xcalloc(count + 1, sizeof(bool));
+    for (int b = 0; b < count; b++)
+    {
+        int64_t end;
+        IrInstruction *cmp = exit_test(iv, loop, &basics[b], 0, &end);
+        removable[b] = cmp &&
+                       only_addresses(iv, function, loop, basics[b].phi->dest,
+                                      basics[b].increment, cmp) &&
+                       only_addresses(iv, function, loop, basics[b].increment->dest,
+                                      basics[b].phi, NULL);
+    }
+
+    // Group the derived addresses by variable, base and scale.
+    DerivedInduction *derived = xcalloc(accesses, sizeof(DerivedInduction));
+    DerivedAccess *access = xmalloc(accesses * sizeof(DerivedAccess));
+    int derived_count = 0, access_count = 0;
+    for (IrBasicBlock *bb = function->head; bb && count; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr && loop->body[bb->index];
+             instr = instr->next)
+        {
+            IrRegister *base;
+            int offset, shift, var = -1;
+            if (is_memory(instr->op))
+                var = derived_address(iv, loop, basics, count, instr, &base, &offset, &shift);
+            if (var < 0)
+                continue;
+
+            int d = 0;
+            while (d < derived_count && (derived[d].var != var || derived[d].base != base ||
+                                         derived[d].shift != shift))
+                d++;
+            if (d == derived_count)
+                derived[derived_count++] = (DerivedInduction){var, base, shift};
+
+            // A pointer is worth adding if it replaces calculating an offset index,
+            // or the variable may then be removed.
+            derived[d].reduce |= offset != 0 || removable[var];
+            access[access_count++] = (DerivedAccess){instr, d, offset};
+        }
+    }
+
+    for (int d = 0; d < derived_count; d++)
+    {
+        if (derived[d].reduce)
+            reduce_induction(function, iv, loop, &basics[derived[d].var], &derived[d]);
+    }
+    for (int a = 0; a < access_count; a++)
+    {
+        DerivedInduction *pointer = &derived[access[a].derived];
+        IrInstruction *mem = access[a].mem;
+        if (!pointer->reduce)
+            continue;
+
+        iv->uses[mem->left->index]--;
+        iv->uses[pointer->pointer->index]++;
+        mem->left = pointer->pointer;
+        mem->value = (mem->immediate ? mem->value : 0) +
+                     (int)((uint32_t)access[a].offset << pointer->shift);
+        mem->immediate = mem->value != 0;
+    }
+    remove_unused(iv, function);
+
+    for (int b = 0; b < count; b++)
+    {
+        for (int d = 0; d < derived_count; d++)
+        {
+            if (derived[d].reduce && derived[d].var == b)
+            {
+                replace_exit_test(function, iv, loop, &basics[b], &derived[d]);
+                break;
+            }
+        }
+    }
+    remove_unused(iv, function);
+
+    xfree(basics);
+    xfree(removable);
+    xfree(derived);
+    xfree(access);
+}
+
+static void induction_variables(IrFunction *function)
+{
+    Loop *loops;
+    int loop_count = find_loops(function, &loops);
+
+    // Each pointer adds at most five registers, and replaces at least one address.
+    int size = function->registers.count + 1;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+            size += 5;
+    }
+    Induction iv = {
+        .defs = xcalloc(size, sizeof(IrInstruction *)),
+        .def_block = xcalloc(size, sizeof(IrBasicBlock *)),
+        .uses = xcalloc(size, sizeof(int)),
+    };
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+            iv_add(&iv, bb, instr);
+    }
+
+    for (int l = 0; l < loop_count; l++)
+    {
+        if (loops[l].preheader)
+            reduce_loop(function, &iv, &loops[l]);
+        xfree(loops[l].body);
+    }
+
+    int *local = xcalloc(function->registers.count + 1, sizeof(int));
+    renumber_registers(function, local);
+    Ir_compact(function);
+
+    xfree(local);
+    xfree(iv.defs);
+    xfree(iv.def_block);
+    xfree(iv.uses);
+    xfree(loops);
+}
+
+static bool is_exit(IrBasicBlock *bb)
+{
+    return bb->tail->op == IR_RETURN;
+}
+
+/*
+ * Choose the block to place after 'bb' (if not already placed), so that it is
+ * reached by falling through: the jump target, or the branch arm which stays in a
+ * loop (IrBasicBlock.loop_depth), or else does not leave the function (preferring
+ * the true arm - E.g. the loop body).
+ */
+static IrBasicBlock *layout_successor(IrBasicBlock *bb, bool *placed)
+{
+    IrInstruction *instr = bb->tail;
+    IrBasicBlock *first = instr->control.jump_true, *second = NULL;
+
+    if (instr->op == IR_RETURN)
+        return NULL;
+    if (instr->op != IR_JUMP)
+    {
+        second = instr->control.jump_false;
+        if (second->loop_depth > first->loop_depth ||
+            (second->loop_depth == first->loop_depth && is_exit(first) && !is_exit(second)))
+        {
+            second = first;
+            first = instr->control.jump_false;
+        }
+    }
+
+    if (!placed[first->index])
+        return first;
+    if (second && !placed[second->index])
+        return second;
+    return NULL;
+}
+
+/*
+ * Order the basic blocks as chains of fallthrough successors, starting from the
+ * entry block, with the blocks leaving the function last.
+ */
+static void block_layout(IrFunction *function)
+{
+    int count = 0, size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        // Blocks which fall through must stay in place.
+        if (!Ir_is_terminator(bb->tail))
+            return;
+        count++;
+        if (bb->index >= size)
+            size = bb->index + 1;
+    }
+
+    IrBasicBlock **blocks = xmalloc(count * sizeof(IrBasicBlock *));
+    bool *placed = xcalloc(size, sizeof(bool));
+    count = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        blocks[count++] = bb;
+
+    IrBasicBlock *tail = NULL;
+    for (int exits = 0; exits < 2; exits++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            // Start a new chain from each block not yet placed (the entry block first).
+            if (i > 0 && is_exit(blocks[i]) != exits)
+                continue;
+
+            for (IrBasicBlock *bb = blocks[i]; bb && !placed[bb->index];
+                 bb = layout_successor(bb, placed))
+            {
+                placed[bb->index] = true;
+                if (tail)
+                    tail->next = bb;
+                tail = bb;
+            }
+        }
+    }
+    tail->next = NULL;
+    function->tail = tail;
+    Ir_compact(function);
+
+    xfree(blocks);
+    xfree(placed);
+}
+
+void Optimise_constant_folding(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        constant_folding(function);
+    }
+}
+
+void Optimise_copy_propagation(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        copy_propagation(function);
+    }
+}
+
+void Optimise_addressing_modes(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        addressing_modes(function);
+    }
+}
+
+void Optimise_branch_fusion(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        branch_fusion(function);
+    }
+}
+
+void Optimise_dead_code(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        dead_code(function);
+    }
+}
+
+void Optimise_value_numbering(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        value_numbering(function);
+    }
+}
+
+void Optimise_loop_invariant_code_motion(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        loop_invariant_code_motion(function);
+    }
+}
+
+void Optimise_induction_variables(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        induction_variables(function);
+    }
+}
+
+void Optimise_block_layout(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        block_layout(function);
+    }
+}
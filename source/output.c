@@ -0,0 +1,143 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "util.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Longest formatted integer ("-2147483648").
+#define OUTPUT_INT_MAX_LEN 11
+
+struct Output
+{
+    FILE *fd;
+    int used;
+    char buffer[OUTPUT_BUFFER_SIZE];
+};
+
+/*
+ * Append 'len' bytes to the buffer, flushing as often as needed.
+ */
+static void append(Output *out, const char *str, int len)
+{
+    while (out->used + len > OUTPUT_BUFFER_SIZE)
+    {
+        int space = OUTPUT_BUFFER_SIZE - out->used;
+        memcpy(out->buffer + out->used, str, space);
+        out->used += space;
+        str += space;
+        len -= space;
+        Output_flush(out);
+    }
+    memcpy(out->buffer + out->used, str, len);
+    out->used += len;
+}
+
+/*
+ * Format an integer directly into the buffer.
+ */
+static void append_int(Output *out, long value)
+{
+    if (out->used + OUTPUT_INT_MAX_LEN > OUTPUT_BUFFER_SIZE)
+        Output_flush(out);
+
+    char digits[OUTPUT_INT_MAX_LEN];
+    int len = 0;
+    unsigned long magnitude = value < 0 ? -(unsigned long)value : value;
+    do
+    {
+        digits[len++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    char *ptr = out->buffer + out->used;
+    if (value < 0)
+        *ptr++ = '-';
+    while (len)
+        *ptr++ = digits[--len];
+    out->used = ptr - out->buffer;
+}
+
+/*
+ * Create a new output buffer, writing to 'fd'.
+ */
+Output *Output_init(FILE *fd)
+{
+    Output *out = xmalloc(sizeof(Output));
+    out->fd = fd;
+    out->used = 0;
+    return out;
+}
+
+/*
+ * Flush and destroy the output buffer.
+ */
+void Output_destroy(Output *out)
+{
+    Output_flush(out);
+    xfree(out);
+}
+
+/*
+ * Write the buffer contents to the underlying file.
+ */
+void Output_flush(Output *out)
+{
+    fwrite(out->buffer, 1, out->used, out->fd);
+    out->used = 0;
+}
+
+/*
+ * Append a null-terminated string.
+ */
+void Output_str(Output *out, const char *str)
+{
+    append(out, str, strlen(str));
+}
+
+/*
+ * Append formatted output.
+ */
+void Output_format(Output *out, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    while (*fmt)
+    {
+        // Copy the literal text up to the next conversion in one go.
+        const char *conversion = strchr(fmt, '%');
+        if (!conversion)
+        {
+            Output_str(out, fmt);
+            break;
+        }
+        append(out, fmt, conversion - fmt);
+        if (!conversion[1])
+            break;
+
+        switch (conversion[1])
+        {
+        case 'd':
+            append_int(out, va_arg(args, int));
+            break;
+        case 'u':
+            append_int(out, va_arg(args, unsigned int));
+            break;
+        case 's':
+            Output_str(out, va_arg(args, const char *));
+            break;
+        case 'c':
+            append(out, &(char){va_arg(args, int)}, 1);
+            break;
+        case '%':
+            append(out, "%", 1);
+            break;
+        }
+        fmt = conversion + 2;
+    }
+
+    va_end(args);
+}
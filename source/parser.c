@@ -27,6 +27,8 @@ typedef struct Parser_t
 
     jmp_buf panic_jmp;
 
+    // Arena from which the AST is allocated.
+    AstArena *arena;
 } Parser;
 
 /*
@@ -42,35 +44,44 @@ typedef struct Parser_t
 #define THROW_ERROR(parser) longjmp(parser->panic_jmp, 1)
 
 #define EXPR_BINARY(p, ...)                                                              \
-    Ast_create_expr_node((ExprAstNode){BINARY, p, .binary = {__VA_ARGS__}})
+    Ast_create_expr_node(parser->arena, (ExprAstNode){BINARY, p, .binary = {__VA_ARGS__}})
 #define EXPR_UNARY(p, ...)                                                               \
-    Ast_create_expr_node((ExprAstNode){UNARY, p, .unary = {__VA_ARGS__}})
+    Ast_create_expr_node(parser->arena, (ExprAstNode){UNARY, p, .unary = {__VA_ARGS__}})
 #define EXPR_PRIMARY(p, ...)                                                             \
-    Ast_create_expr_node((ExprAstNode){PRIMARY, p, .primary = {__VA_ARGS__}})
+    Ast_create_expr_node(                                                                \
+        parser->arena, (ExprAstNode){PRIMARY, p, .primary = {__VA_ARGS__}})
 #define EXPR_POSTFIX(p, ...)                                                             \
-    Ast_create_expr_node((ExprAstNode){POSTFIX, p, .postfix = {__VA_ARGS__}})
+    Ast_create_expr_node(                                                                \
+        parser->arena, (ExprAstNode){POSTFIX, p, .postfix = {__VA_ARGS__}})
 #define EXPR_CAST(p, ...)                                                                \
-    Ast_create_expr_node((ExprAstNode){CAST, p, .cast = {__VA_ARGS__}})
+    Ast_create_expr_node(parser->arena, (ExprAstNode){CAST, p, .cast = {__VA_ARGS__}})
 #define EXPR_TERTIARY(p, ...)                                                            \
-    Ast_create_expr_node((ExprAstNode){TERTIARY, p, .tertiary = {__VA_ARGS__}})
+    Ast_create_expr_node(                                                                \
+        parser->arena, (ExprAstNode){TERTIARY, p, .tertiary = {__VA_ARGS__}})
 #define EXPR_ASSIGN(p, ...)                                                              \
-    Ast_create_expr_node((ExprAstNode){ASSIGN, p, .assign = {__VA_ARGS__}})
+    Ast_create_expr_node(parser->arena, (ExprAstNode){ASSIGN, p, .assign = {__VA_ARGS__}})
 #define STMT_EXPR(p, ...)                                                                \
-    Ast_create_stmt_node((StmtAstNode){.type = EXPR, p, .expr = {__VA_ARGS__}})
+    Ast_create_stmt_node(                                                                \
+        parser->arena, (StmtAstNode){.type = EXPR, p, .expr = {__VA_ARGS__}})
 #define STMT_DECL(p, ...)                                                                \
-    Ast_create_stmt_node((StmtAstNode){.type = DECL, p, .decl = {__VA_ARGS__}})
+    Ast_create_stmt_node(                                                                \
+        parser->arena, (StmtAstNode){.type = DECL, p, .decl = {__VA_ARGS__}})
 #define STMT_BLOCK(p, ...)                                                               \
-    Ast_create_stmt_node((StmtAstNode){.type = BLOCK, p, .block = {__VA_ARGS__}})
+    Ast_create_stmt_node(                                                                \
+        parser->arena, (StmtAstNode){.type = BLOCK, p, .block = {__VA_ARGS__}})
 #define STMT_WHILE(p, ...)                                                               \
     Ast_create_stmt_node(                                                                \
-        (StmtAstNode){.type = WHILE_LOOP, p, .while_loop = {__VA_ARGS__}})
+        parser->arena, (StmtAstNode){.type = WHILE_LOOP, p, .while_loop = {__VA_ARGS__}})
 #define STMT_RETURN(p, ...)                                                              \
     Ast_create_stmt_node(                                                                \
+        parser->arena,                                                                   \
         (StmtAstNode){.type = RETURN_JUMP, p, .return_jump = {__VA_ARGS__}})
 #define STMT_IF(p, ...)                                                                  \
     Ast_create_stmt_node(                                                                \
+        parser->arena,                                                                   \
         (StmtAstNode){.type = IF_STATEMENT, p, .if_statement = {__VA_ARGS__}})
-#define DECL(...) Ast_create_decl_node((DeclAstNode){__VA_ARGS__})
+#define DECL(...) Ast_create_decl_node(parser->arena, (DeclAstNode){__VA_ARGS__})
+#define NEW(type) ((type *)Ast_arena_alloc(parser->arena, sizeof(type)))
 
 #define consume(t) consume_token(parser, t)
 #define peek() peek_token(parser)
@@ -178,7 +189,7 @@ static ArgumentListItem *argument_expression_list(Parser *parser)
     if (peek()->type == RIGHT_PAREN)
         return NULL;
 
-    ArgumentListItem *arg = calloc(1, sizeof(ArgumentListItem));
+    ArgumentListItem *arg = NEW(ArgumentListItem);
     arg->argument = Parser_expression(parser);
     arg->next = match(COMMA) ? argument_expression_list(parser) : NULL;
     return arg;
@@ -671,7 +682,7 @@ static CType *declaration_specifiers(Parser *parser)
      * alignment_specifier declaration_specifiers
      * alignment_specifier
      */
-    CType *type = calloc(1, sizeof(CType));
+    CType *type = NEW(CType);
 
     Position pos = peek()->pos;
 
@@ -746,7 +757,7 @@ end:
 }
 static ParameterListItem *parameter_declaration(Parser *parser)
 {
-    ParameterListItem *param = calloc(1, sizeof(ParameterListItem));
+    ParameterListItem *param = NEW(ParameterListItem);
 
     CType *primitive_type = declaration_specifiers(parser);
     DeclAstNode *tmp_node = declarator(parser, primitive_type);
@@ -796,7 +807,7 @@ static ParameterListItem *parameter_type_list(Parser *parser)
 
     do
     {
-        *curr = calloc(1, sizeof(ParameterListItem));
+        *curr = NEW(ParameterListItem);
 
         (*curr)->type = declaration_specifiers(parser);
 
@@ -826,7 +837,7 @@ static CType *direct_declarator_end(Parser *parser, CType *ctype)
      */
     if (match(LEFT_SQUARE))
     {
-        CType *next = calloc(1, sizeof(CType));
+        CType *next = NEW(CType);
         next->type = TYPE_ARRAY;
         next->derived.array_size = consume(CONSTANT)->literal.const_value;
         consume(RIGHT_SQUARE);
@@ -836,7 +847,7 @@ static CType *direct_declarator_end(Parser *parser, CType *ctype)
     }
     else if (match(LEFT_PAREN))
     {
-        CType *next = calloc(1, sizeof(CType));
+        CType *next = NEW(CType);
         next->type = TYPE_FUNCTION;
 
         if (match(RIGHT_PAREN))
@@ -889,7 +900,7 @@ static DeclAstNode *declarator(Parser *parser, CType *ctype)
     /* '*' direct_declarator | direct_declarator */
     while (match(STAR))
     {
-        CType *pointer = calloc(1, sizeof(CType));
+        CType *pointer = NEW(CType);
         pointer->type = TYPE_POINTER;
         ctype_set_derived(pointer, ctype);
         ctype = pointer;
@@ -1028,9 +1039,10 @@ static CType *type_name(Parser *parser)
 
 Parser *Parser_init(Scanner *scanner, ErrorReporter *error_reporter)
 {
-    Parser *parser = calloc(1, sizeof(Parser));
+    Parser *parser = xcalloc(1, sizeof(Parser));
     parser->scanner = scanner;
     parser->error_reporter = error_reporter;
+    parser->arena = Ast_arena_init();
 
     parser->next_token[0] = Scanner_get_next(parser->scanner);
     parser->next_token[1] = Scanner_get_next(parser->scanner);
@@ -1041,14 +1053,17 @@ Parser *Parser_init(Scanner *scanner, ErrorReporter *error_reporter)
 
 void Parser_destroy(Parser *parser)
 {
-    free(parser);
+    Ast_arena_destroy(parser->arena);
+    xfree(parser);
 }
 
 DeclAstNode *Parser_translation_unit(Parser *parser)
 {
     /* translation_unit declaration | declaration */
     DeclAstNode *head = NULL, **curr = &head;
-    while ((peek())->type != END_OF_FILE)
+
+    // Stop parsing once the error limit is reached.
+    while ((peek())->type != END_OF_FILE && !Error_limit_reached(parser->error_reporter))
     {
         if (CATCH_ERROR(parser))
         {
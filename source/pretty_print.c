@@ -9,6 +9,9 @@
 #define pp_printf(buf, ...)                                                              \
     buf->start += snprintf(buf->start, buf->end - buf->start, __VA_ARGS__);
 
+// printf arguments for a token lexeme (use with "%.*s").
+#define LEXEME(token) (token)->lexeme.length, (token)->lexeme.start
+
 typedef struct StringBuffer_t
 {
     char *start;
@@ -109,11 +112,11 @@ static void pp_primary(ExprAstNode *node, StringBuffer *buf)
 
     if (node->primary.identifier)
     {
-        pp_printf(buf, "%s", node->primary.identifier->lexeme);
+        pp_printf(buf, "%.*s", LEXEME(node->primary.identifier));
     }
     else if (node->primary.constant)
     {
-        pp_printf(buf, "%s", node->primary.constant->lexeme);
+        pp_printf(buf, "%.*s", LEXEME(node->primary.constant));
     }
 }
 
@@ -277,7 +280,7 @@ static void pp_decl(DeclAstNode *node, StringBuffer *buf)
     pp_type(node->type, buf);
     if (node->identifier)
     {
-        pp_printf(buf, ", %s", node->identifier->lexeme);
+        pp_printf(buf, ", %.*s", LEXEME(node->identifier));
     }
 
     if (node->type->type == TYPE_FUNCTION && node->body)
@@ -447,7 +450,7 @@ static void pp_type_function(CType *type, StringBuffer *buf)
 
         if (p->name)
         {
-            pp_printf(buf, ":%s", p->name->lexeme);
+            pp_printf(buf, ":%.*s", LEXEME(p->name));
         }
         else
         {
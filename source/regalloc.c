@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -6,283 +7,1030 @@
 
 #include "regalloc.h"
 #include "ir.h"
+#include "timing.h"
+#include "util.h"
 
-// Linear Scan Register allocation
+// Second-chance binpacking register allocation
 //
-// For each live interval: i
-//   Expire_old_intervals(i)
-//   if len(free_registers) > 0:
-//     i.register = free_registers.pop()
-//     active += i
-//   else:
-//     Allocate_register(i)
+// Instructions are visited in order (basic blocks in layout order). Each value (REG_ANY
+// register) is held in a register, or in memory (its stack slot), and may move between
+// them at any instruction - the value's live interval is split wherever register
+// pressure requires it.
 //
-// Allocate_register(live interval: i)
-//   j = latest endpoint register in active
-//   if i < j:
-//     i.stack = stack_allocate()
-//   else:
-//     j.stack = stack_allocate()
-//     i = j
+// For each basic block: b
+//   Start with the registers held at the end of a preceding block (dropping values
+//   not live on entry to b)
+//   For each instruction: i
+//     For each value used by i, in memory: v
+//       if Allocate_register(v):
+//         load v into the register (its second chance)
+//       else:
+//         load v into a spill register, for i only
+//     Free the registers of values not used after i
+//     For the value defined by i: d
+//       if not Allocate_register(d):
+//         store d after i
+//
+// Allocate_register(value: v)
+//   if a register is free:
+//     return register
+//   j = value held in a register (not used by i) with the greatest next use distance
+//       / spill density
+//   if j is used after v:
+//     store j, if changed since it was loaded
+//     return j.register
+//
+// The distance to the next use of each value is found by a backwards dataflow
+// analysis, with a large distance added for leaving a loop - so values used after
+// a loop are spilled, before values used inside it. The distance is divided by the
+// value's spill density: the number of loads and stores needed, each weighted by
+// 10^(loop depth), per instruction the value is live for. So the value spilled is
+// the one used furthest ahead, relative to how often it is used. Loop headers also
+// start without the values not used within the loop.
+//
+// Finally, where a basic block is entered with values in other locations than it
+// starts with, loads, stores and moves are inserted on the CFG edge.
+
+// Added to the length of each live interval, when comparing spill costs.
+#define SPILL_LENGTH_BIAS 25
+
+// Added to the distance to the next use of a value, for each loop exited.
+#define LOOP_EXIT_DISTANCE 1000
+
+// Distance to the next use of a value not used again.
+#define NO_USE (INT_MAX / 4)
+
+// Location of a value not held in a register.
+#define IN_MEMORY -1
+
+// Registers held at one point in a function.
+typedef struct RegisterState
+{
+    // Value held in each register (or NULL).
+    IrRegister ** held;
+
+    // The value held has changed since it was stored to its stack slot.
+    _Bool * dirty;
+} RegisterState;
 
-typedef struct FreeStack
+// Where code is inserted: before an instruction, or at the end of a basic block.
+typedef struct Cursor
 {
-    int head;
-    int *stack;
-} FreeStack;
+    IrBasicBlock * bb;
+    IrInstruction * before;
+} Cursor;
 
-typedef struct ActiveSet
+typedef struct Allocator
 {
+    IrFunction * function;
+
+    // Registers available for allocation.
     int count;
-    int max;
-    IrRegister ** set;
-} ActiveSet;
+    IrRegister ** regs;
+
+    // Registers reserved for values used or defined in memory.
+    IrRegister * spill_src;
+    IrRegister * spill_dest_left;
+    IrRegister * spill_dest_right;
+
+    RegisterState state;
+
+    // Register state at the start and end of each basic block (by block index).
+    int block_count;
+    RegisterState * start;
+    RegisterState * end;
+    _Bool * visited;
+
+    // Distance to the next use of each value from the start of each basic block
+    // (by block index, then register index).
+    int ** next_use;
 
-static void stack_push(FreeStack * stack, int index)
+    // By register index: the stack slot of each value (or -1), the position of its
+    // last use within the current basic block, and if it has been rematerialised.
+    int * slot;
+    int * last_use;
+    _Bool * rematerialised;
+
+    // By register index: the values defined within the current loop.
+    _Bool * defined;
+
+    // Values live on exit from the current basic block.
+    uint8_t * live_exit;
+} Allocator;
+
+static _Bool is_value(IrRegister * reg)
 {
-    stack->stack[stack->head++] = index;
+    return reg && reg->type == REG_ANY;
 }
 
-static _Bool stack_pop(FreeStack * stack, int * index)
+static _Bool is_live(uint8_t * set, IrRegister * reg)
 {
-    if(stack->head == 0) return false;
-    *index = stack->stack[--stack->head];
-    return true;
+    return set[reg->index / 8] & 1 << reg->index % 8;
 }
 
-static void active_add(ActiveSet * active, IrRegister * reg)
+// Cost of spilling a register, per instruction it is live for. The length is
+// biased, so short intervals (E.g. a load, used once) are not always kept in
+// registers over longer intervals used much more often.
+static float spill_density(IrRegister * reg)
 {
-    assert(active->count < active->max);
+    return reg->spill_cost / (reg->liveness.finish - reg->liveness.start + SPILL_LENGTH_BIAS);
+}
 
-    for(int i = 0;;i++)
+// Returns true if regA, next used distA ahead, should be evicted before regB, next
+// used distB ahead. Values not used again go first; otherwise the distance to the
+// next use is divided by the spill density, so a value used often (or in a deep
+// loop) keeps its register over one used little more rarely. Ties spill the
+// register live for longest (freeing its register for longest).
+static _Bool evict_before(IrRegister * regA, int distA, IrRegister * regB, int distB)
+{
+    if(distA != distB && (distA == NO_USE || distB == NO_USE)) return distA == NO_USE;
+    if(distA != NO_USE)
     {
-        if(active->set[i] == NULL)
-        {
-            active->set[i] = reg;
-            active->count++;
-            return;
-        }
+        float costA = distA * spill_density(regB);
+        float costB = distB * spill_density(regA);
+        if(costA != costB) return costA > costB;
     }
+    return regA->liveness.finish > regB->liveness.finish;
 }
 
-static void active_remove(ActiveSet * active, IrRegister * reg)
+// Find REG_ANY registers defined once, by an instruction with no register
+// operands (IR_LOADI, IR_LOADSO). If spilled, these are recomputed before each
+// use rather than stored to the stack.
+static void regalloc_find_remat(IrFunction * function)
 {
-    assert(active->count > 0);
+    int * defs = xcalloc(function->registers.count + 1, sizeof(int));
 
-    for(int i = 0;i < active->max;i++)
+    for(int i = 0;i < function->registers.count;i++)
     {
-        if(active->set[i] == reg)
+        function->registers.list[i]->remat = NULL;
+    }
+    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next)
+    {
+        for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
         {
-            active->set[i] = NULL;
-            active->count--;
-            return;
+            // Post-indexed loads and stores also write the address register.
+            if(instr->post_index && instr->left->type == REG_ANY)
+                defs[instr->left->index]++;
+
+            if(!instr->dest || instr->dest->type != REG_ANY) continue;
+            defs[instr->dest->index]++;
+
+            if(instr->op == IR_LOADI || instr->op == IR_LOADSO)
+                instr->dest->remat = instr;
         }
     }
-    assert(false && "Register not in active set");
+    for(int i = 0;i < function->registers.count;i++)
+    {
+        IrRegister * reg = function->registers.list[i];
+        if(reg->type != REG_ANY || defs[reg->index] != 1) reg->remat = NULL;
+    }
+    xfree(defs);
 }
 
-static IrRegister * active_get(ActiveSet * active)
+// Estimate the cost of spilling each register. Rematerialised registers need no
+// store after their definition.
+static void regalloc_spill_costs(IrFunction * function)
 {
-    int soonest = -1;
-    IrRegister * reg = NULL;
-
-    for(int i = 0;i < active->max;i++)
+    for(int i = 0;i < function->registers.count;i++)
     {
-        if(active->set[i] && active->set[i]->liveness.finish < soonest)
+        function->registers.list[i]->spill_cost = 0;
+    }
+    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next)
+    {
+        float weight = 1;
+        for(int i = 0;i < bb->loop_depth;i++) weight *= 10;
+
+        for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
         {
-            soonest = active->set[i]->liveness.finish;
-            reg = active->set[i];
+            if(instr->dest && instr->dest->type == REG_ANY && instr->dest->remat != instr)
+                instr->dest->spill_cost += weight;
+
+            if(instr->left && instr->left->type == REG_ANY)
+                instr->left->spill_cost += instr->post_index ? 2 * weight : weight;
+            if(instr->right && instr->right->type == REG_ANY)
+                instr->right->spill_cost += weight;
+            if(instr->index && instr->index->type == REG_ANY)
+                instr->index->spill_cost += weight;
         }
     }
-    return reg;
 }
 
-// Sort the list of registers within an IrFunction
-// by increasing live start index.
-static void registers_sort(IrRegister ** list, int count)
+/*
+ * Insert an instruction at the cursor.
+ *
+ * Spill code is allocated from the function's pending instructions, and merged
+ * into the instruction array by Ir_compact() once allocation is complete.
+ */
+static void emit(IrFunction * function, Cursor * at, IrInstruction instr)
+{
+    if(!at->before)
+    {
+        Ir_emit_instr(function, at->bb, instr);
+        return;
+    }
+    IrInstruction * new_instr = Ir_new_instr(function, instr);
+    Ir_emit_instr_before(at->before, new_instr);
+    if(at->bb->head == at->before) at->bb->head = new_instr;
+}
+
+// Stack slot of a value, allocated when it is first needed.
+static int stack_slot(Allocator * alloc, IrRegister * value)
+{
+    if(alloc->slot[value->index] == -1)
+    {
+        alloc->slot[value->index] = alloc->function->stack_size;
+        alloc->function->stack_size += 4;
+    }
+    return alloc->slot[value->index];
+}
+
+/*
+ * Emit spill code from src -> stack slot of 'value'
+ */
+static void emit_spill_store(Allocator * alloc, Cursor * at, IrRegister * value, IrRegister * src)
+{
+    // Stack slots are addressed directly from the stack pointer ([sp, #slot]).
+    emit(alloc->function, at, (IrInstruction){
+        .op = IR_STORE32,
+        .right = src,
+        .value = stack_slot(alloc, value),
+        .immediate = true
+    });
+}
+
+/*
+ * Emit spill code from stack slot of 'value' -> dest, or recompute the value from
+ * its definition, if it is rematerialised.
+ */
+static void emit_spill_load(Allocator * alloc, Cursor * at, IrRegister * value, IrRegister * dest)
+{
+    if(value->remat)
+    {
+        if(!alloc->rematerialised[value->index]) alloc->function->rematerialised++;
+        alloc->rematerialised[value->index] = true;
+
+        emit(alloc->function, at, (IrInstruction){
+            .op = value->remat->op,
+            .dest = dest,
+            .value = value->remat->value
+        });
+        return;
+    }
+    emit(alloc->function, at, (IrInstruction){
+        .op = IR_LOAD32,
+        .dest = dest,
+        .value = stack_slot(alloc, value),
+        .immediate = true
+    });
+}
+
+// Distance from the end of a basic block to the next use of a value.
+static int exit_distance(Allocator * alloc, IrBasicBlock * bb, int value)
 {
-    for(int i = 1;i < count;i++)
+    IrBasicBlock * succ[2];
+    int count = Ir_successors(bb, succ), distance = NO_USE;
+    for(int i = 0;i < count;i++)
     {
-        IrRegister * focus = list[i];
+        int next = alloc->next_use[succ[i]->index][value];
+        if(succ[i]->loop_depth < bb->loop_depth)
+            next += LOOP_EXIT_DISTANCE * (bb->loop_depth - succ[i]->loop_depth);
 
-        for(IrRegister ** ptr = &list[i-1];;ptr--)
+        if(next < distance) distance = next;
+    }
+    return distance;
+}
+
+// Find the distance to the next use of each value, from the start of each basic
+// block: iterated until no distance changes (distances only ever decrease).
+static void next_use_analysis(Allocator * alloc, IrBasicBlock ** order, int blocks)
+{
+    int values = alloc->function->registers.count + 1;
+    int * entry = xmalloc(values * sizeof(int));
+
+    alloc->next_use = xcalloc(alloc->block_count, sizeof(int *));
+    for(int i = 0;i < alloc->block_count;i++)
+    {
+        alloc->next_use[i] = xmalloc(values * sizeof(int));
+        for(int v = 0;v < values;v++) alloc->next_use[i][v] = NO_USE;
+    }
+
+    for(_Bool changed = true;changed;)
+    {
+        changed = false;
+        for(int i = blocks - 1;i >= 0;i--)
         {
-            if((*ptr)->liveness.start > focus->liveness.start)
+            IrBasicBlock * bb = order[i];
+
+            int length = 0;
+            for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next) length++;
+            for(int v = 0;v < values;v++)
             {
-                *(ptr + 1) = *ptr;
-                *ptr = focus;
+                int distance = exit_distance(alloc, bb, v) + length;
+                entry[v] = distance < NO_USE ? distance : NO_USE;
             }
 
-            if(ptr == list) break;
+            // Walk backwards, so the first use (or definition) of each value is last.
+            int position = length - 1;
+            for(IrInstruction * instr = bb->tail;instr != NULL;instr = instr->prev, position--)
+            {
+                if(is_value(instr->dest)) entry[instr->dest->index] = NO_USE;
+
+                IrRegister * uses[] = {instr->left, instr->right, instr->index};
+                for(int u = 0;u < 3;u++)
+                {
+                    if(is_value(uses[u])) entry[uses[u]->index] = position;
+                }
+            }
+
+            if(memcmp(entry, alloc->next_use[bb->index], values * sizeof(int)))
+            {
+                memcpy(alloc->next_use[bb->index], entry, values * sizeof(int));
+                changed = true;
+            }
         }
     }
+    xfree(entry);
+}
+
+// Distance to the next use of a value, from an instruction (or NO_USE, if it is
+// redefined first).
+static int next_use(Allocator * alloc, IrBasicBlock * bb, IrInstruction * instr, IrRegister * value)
+{
+    int distance = 0;
+    for(;instr != NULL;instr = instr->next, distance++)
+    {
+        if(instr->left == value || instr->right == value || instr->index == value) return distance;
+        if(instr->dest == value) return NO_USE;
+    }
+    distance += exit_distance(alloc, bb, value->index);
+    return distance < NO_USE ? distance : NO_USE;
+}
+
+static int state_find(RegisterState * state, int count, IrRegister * value)
+{
+    for(int reg = 0;reg < count;reg++)
+    {
+        if(state->held[reg] == value) return reg;
+    }
+    return IN_MEMORY;
+}
+
+static void state_copy(RegisterState * dest, RegisterState * src, int count)
+{
+    memcpy(dest->held, src->held, count * sizeof(IrRegister *));
+    memcpy(dest->dirty, src->dirty, count * sizeof(_Bool));
+}
+
+// A value is dead after an instruction if it is not used again in the basic block,
+// and not live on exit.
+static _Bool dead_after(Allocator * alloc, IrRegister * value, int position)
+{
+    return alloc->last_use[value->index] <= position && !is_live(alloc->live_exit, value);
+}
+
+static void free_dead(Allocator * alloc, int position)
+{
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        IrRegister * value = alloc->state.held[reg];
+        if(value && dead_after(alloc, value, position)) alloc->state.held[reg] = NULL;
+    }
 }
 
-static void regalloc_expire_active(ActiveSet * active, FreeStack * free, int index)
+// Move a value out of its register (storing it, if it has changed).
+static void evict(Allocator * alloc, Cursor * at, int reg)
 {
-    for(int i = 0;i < active->max;i++)
+    if(alloc->state.dirty[reg])
+        emit_spill_store(alloc, at, alloc->state.held[reg], alloc->regs[reg]);
+    alloc->state.held[reg] = NULL;
+}
+
+// Number of loads and stores needed for a value kept in memory, from an instruction
+// until 'distance' after it (counting one use for a value live past the block).
+static int memory_cost(Allocator * alloc, IrBasicBlock * bb, IrInstruction * instr, IrRegister * value, int distance)
+{
+    int cost = 0, position = 0;
+    for(;instr != NULL && position < distance;instr = instr->next, position++)
     {
-        if(active->set[i] == NULL) continue;
+        if(instr->left == value || instr->right == value || instr->index == value) cost++;
+        if(instr->dest == value) return cost;
+    }
+    if(!instr && position < distance && is_live(bb->live.exit, value)) cost++;
+    return cost;
+}
 
-        IrRegister * reg = active->set[i];
+// Find a register for a value used (or defined) by the instruction at the cursor: a
+// free register, or the register of the value chosen by evict_before() (excluding
+// 'locked' registers), if spilling it is no more costly than keeping the value in
+// memory until then. Returns IN_MEMORY if there is none.
+static int allocate(Allocator * alloc, Cursor * at, IrRegister * value, _Bool define, unsigned int locked)
+{
+    int victim = IN_MEMORY, victim_distance = 0;
+    IrInstruction * next_instr = at->before->next;
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        IrRegister * held = alloc->state.held[reg];
+        if(!held) return reg;
+        if(locked & 1u << reg) continue;
 
-        if(reg->liveness.finish < index)
+        int next = next_use(alloc, at->bb, next_instr, held);
+        if(victim == IN_MEMORY || evict_before(held, next, alloc->state.held[victim], victim_distance))
         {
-            active_remove(active, reg);
-            stack_push(free, reg->index);
+            victim = reg;
+            victim_distance = next;
         }
     }
+    if(victim == IN_MEMORY) return IN_MEMORY;
+
+    // The spilled value is reloaded at its next use (outside the loop, if it is next
+    // used after leaving it).
+    int spill = alloc->state.dirty[victim] + (victim_distance < LOOP_EXIT_DISTANCE);
+    int keep = memory_cost(alloc, at->bb, next_instr, value, victim_distance);
+    if(define && !value->remat) keep++;
+
+    if(keep == 0 || spill > keep) return IN_MEMORY;
+
+    evict(alloc, at, victim);
+    return victim;
 }
 
-static int regalloc_spill(IrFunction * function)
+// Instructions assembled to a single A32 instruction, which reads every operand
+// before writing the destination - so the destination can be given the register of
+// an operand dying there. Others (E.g. IR_MOD) write the destination first.
+static _Bool reads_before_write(IrInstruction * instr)
 {
-    int spill = function->stack_size;
-    function->stack_size += 4;
-    return spill;
-}
+    switch(instr->op)
+    {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_SLL:
+        case IR_SLR:
+        case IR_OR:
+        case IR_AND:
+        case IR_XOR:
+            return true;
 
+        case IR_LOAD8:
+        case IR_LOAD16:
+        case IR_LOAD32:
+            return !instr->post_index;
+
+        default:
+            return false;
+    }
+}
 
-static void regalloc_alloc(IrFunction * function, int * free_regs)
+static void allocate_instr(Allocator * alloc, IrBasicBlock * bb, IrInstruction * instr)
 {
-    int free_registers_count = 0;
-    for(;free_regs[free_registers_count] != -1;free_registers_count++);
+    RegisterState * state = &alloc->state;
+    int position = instr->live_position;
+    Cursor at = {bb, instr};
 
-    FreeStack free = {
-        .head = 0,
-        .stack = calloc(free_registers_count, sizeof(int))
-    };
-    for(int i = 0;i < free_registers_count;i++)
+    if(instr->op == IR_MOV && is_value(instr->dest) && is_value(instr->left))
     {
-        stack_push(&free, free_regs[i]);
+        int reg = state_find(state, alloc->count, instr->left);
+
+        // A copy of a value which dies here takes over its register.
+        if(reg != IN_MEMORY && dead_after(alloc, instr->left, position) &&
+           state_find(state, alloc->count, instr->dest) == IN_MEMORY)
+        {
+            state->held[reg] = instr->dest;
+            state->dirty[reg] = true;
+            Ir_remove_instr(bb, instr);
+            alloc->function->movs_removed++;
+            return;
+        }
+
+        // A copy of a rematerialised value (in memory) can recompute it directly.
+        if(reg == IN_MEMORY && instr->left->remat)
+        {
+            instr->op = instr->left->remat->op;
+            instr->value = instr->left->remat->value;
+            instr->left = NULL;
+        }
     }
 
-    ActiveSet active = {
-        .count = 0,
-        .max = free_registers_count,
-        .set = calloc(free_registers_count, sizeof(IrRegister **))
-    };
+    IrRegister ** operands[] = {&instr->left, &instr->right, &instr->index};
+    IrRegister * spill_regs[] = {alloc->spill_dest_left, alloc->spill_dest_right, alloc->spill_src};
+    IrRegister * values[3] = {NULL};
 
-    registers_sort(function->registers.list, function->registers.count);
+    // Values used by this instruction stay in their registers.
+    unsigned int locked = 0;
+    for(int i = 0;i < 3;i++)
+    {
+        if(!is_value(*operands[i])) continue;
+        values[i] = *operands[i];
 
-    for(int i = 0;i < function->registers.count;i++)
+        int reg = state_find(state, alloc->count, values[i]);
+        if(reg != IN_MEMORY) locked |= 1u << reg;
+    }
+
+    for(int i = 0;i < 3;i++)
     {
-        IrRegister * reg = function->registers.list[i];
-        regalloc_expire_active(&active, &free, reg->liveness.start);
+        if(!values[i]) continue;
+
+        // The same value may be used twice.
+        if(i > 0 && values[i] == values[0]) *operands[i] = *operands[0];
+        else if(i > 1 && values[i] == values[1]) *operands[i] = *operands[1];
+        if(*operands[i] != values[i]) continue;
+
+        int reg = state_find(state, alloc->count, values[i]);
+        if(reg == IN_MEMORY)
+        {
+            reg = allocate(alloc, &at, values[i], false, locked);
+            if(reg != IN_MEMORY)
+            {
+                state->held[reg] = values[i];
+                state->dirty[reg] = false;
+                locked |= 1u << reg;
+            }
+            emit_spill_load(alloc, &at, values[i], reg == IN_MEMORY ? spill_regs[i] : alloc->regs[reg]);
+
+            // Post-indexed loads and stores also write the (incremented) address.
+            if(reg == IN_MEMORY && i == 0 && instr->post_index)
+            {
+                Cursor after = {bb, instr->next};
+                emit_spill_store(alloc, &after, values[i], spill_regs[i]);
+            }
+        }
+        if(reg != IN_MEMORY && i == 0 && instr->post_index) state->dirty[reg] = true;
+
+        *operands[i] = reg == IN_MEMORY ? spill_regs[i] : alloc->regs[reg];
+    }
+
+    if(reads_before_write(instr)) free_dead(alloc, position);
 
-        // Try to allocate a free register.
-        if(stack_pop(&free, &reg->index) == true)
+    IrRegister * dest = instr->dest;
+    if(is_value(dest))
+    {
+        int reg = state_find(state, alloc->count, dest);
+        if(reg == IN_MEMORY) reg = allocate(alloc, &at, dest, true, locked);
+
+        if(reg != IN_MEMORY)
+        {
+            state->held[reg] = dest;
+            state->dirty[reg] = !dest->remat;
+            instr->dest = alloc->regs[reg];
+        }
+        else if(dest->remat)
+        {
+            // Recomputed at each use instead.
+            Ir_remove_instr(bb, instr);
+        }
+        else
         {
-            active_add(&active, reg);
-            continue;
+            // The index is read before the destination is written, so they can
+            // share a spill register.
+            instr->dest = alloc->spill_src;
+            if(!dead_after(alloc, dest, position))
+            {
+                Cursor after = {bb, instr->next};
+                emit_spill_store(alloc, &after, dest, alloc->spill_src);
+            }
         }
+    }
+    free_dead(alloc, position);
+}
 
-        // We've run out of free registers. Find the next available register.
-        IrRegister * replace = active_get(&active);
+static _Bool is_predecessor(IrBasicBlock * bb, IrBasicBlock * pred)
+{
+    return pred && (bb->cfg_entry[0] == pred || bb->cfg_entry[1] == pred);
+}
+
+static int predecessors(IrBasicBlock * bb)
+{
+    if(bb->cfg_entry[0] && bb->cfg_entry[1] && bb->cfg_entry[0] != bb->cfg_entry[1]) return 2;
+    return bb->cfg_entry[0] || bb->cfg_entry[1] ? 1 : 0;
+}
+
+// Most values live at once within a basic block, found walking backwards from its
+// exit (a value defined and not used still needs a register, at its definition).
+static int block_pressure(Allocator * alloc, IrBasicBlock * bb, uint8_t * live)
+{
+    int bytes = alloc->function->registers.count / 8 + 1, count = 0;
+    memcpy(live, bb->live.exit, bytes);
+    for(int i = 0;i < bytes;i++)
+    {
+        for(uint8_t bits = live[i];bits;bits &= bits - 1) count++;
+    }
 
-        if(replace && replace->liveness.finish < reg->liveness.finish)
+    int pressure = count;
+    for(IrInstruction * instr = bb->tail;instr != NULL;instr = instr->prev)
+    {
+        if(is_value(instr->dest) && is_live(live, instr->dest))
+        {
+            live[instr->dest->index / 8] &= ~(1 << instr->dest->index % 8);
+            count--;
+        }
+        else if(is_value(instr->dest) && count + 1 > pressure)
         {
-            reg->index = replace->index;
-            
-            replace->type = REG_SPILL;
-            replace->spill = regalloc_spill(function);
-
-            active_remove(&active, replace);
-            active_add(&active, reg);
-        } else {
-            reg->type = REG_SPILL;
-            reg->spill = regalloc_spill(function);
+            pressure = count + 1;
         }
+
+        IrRegister * uses[] = {instr->left, instr->right, instr->index};
+        for(int u = 0;u < 3;u++)
+        {
+            if(!is_value(uses[u]) || is_live(live, uses[u])) continue;
+            live[uses[u]->index / 8] |= 1 << uses[u]->index % 8;
+            count++;
+        }
+        if(count > pressure) pressure = count;
     }
+    return pressure;
 }
 
-/*
- * Emit spill code from spill_regs[1] -> stack@spill_loc
- */
-static void emit_spill_store(IrInstruction * after, int spill_loc, IrRegister ** spill_regs)
+// Find the values defined within the loop with a header, from the blocks reaching
+// its back edges without passing through the header. Blocks already allocated are
+// left out (their operands are now allocated registers, not values): on edges from
+// them, resolve_edge() stores anything they changed.
+// Returns the most values live at once within the loop.
+static int loop_definitions(Allocator * alloc, IrBasicBlock * header, _Bool * defined)
 {
-    IrInstruction * loadso = calloc(1, sizeof(IrInstruction));
-    loadso->op = IR_LOADSO;
-    loadso->value = spill_loc;
-    loadso->dest = spill_regs[0];
-    Ir_emit_instr_after(after, loadso);
+    _Bool * in_loop = xcalloc(alloc->block_count, sizeof(_Bool));
+    IrBasicBlock ** stack = xcalloc(alloc->block_count, sizeof(IrBasicBlock *));
+    int top = 0;
+
+    in_loop[header->index] = true;
+    stack[top++] = header;
+    while(top > 0)
+    {
+        IrBasicBlock * bb = stack[--top];
+        for(int i = 0;i < 2;i++)
+        {
+            IrBasicBlock * pred = bb->cfg_entry[i];
+            if(!pred || in_loop[pred->index] || alloc->visited[pred->index]) continue;
+
+            in_loop[pred->index] = true;
+            stack[top++] = pred;
+        }
+    }
+
+    memset(defined, 0, (alloc->function->registers.count + 1) * sizeof(_Bool));
+    uint8_t * live = xmalloc(alloc->function->registers.count / 8 + 1);
+    int pressure = 0;
+    for(IrBasicBlock * bb = alloc->function->head;bb != NULL;bb = bb->next)
+    {
+        if(!in_loop[bb->index]) continue;
+        for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
+        {
+            if(is_value(instr->dest)) defined[instr->dest->index] = true;
+            if(instr->post_index && is_value(instr->left)) defined[instr->left->index] = true;
+        }
 
-    IrInstruction * store32 = calloc(1, sizeof(IrInstruction));
-    store32->op = IR_STORE32;
-    store32->left = spill_regs[0];
-    store32->right = spill_regs[1];
-    Ir_emit_instr_after(loadso, store32);
+        int block = block_pressure(alloc, bb, live);
+        if(block > pressure) pressure = block;
+    }
+    xfree(live);
+    xfree(stack);
+    xfree(in_loop);
+    return pressure;
 }
 
-/*
- * Emit spill code code from stack@spill_loc -> dest_reg
- */
-static void emit_spill_load(IrInstruction * before, int spill_loc, IrRegister * dest, IrRegister ** spill_regs)
+static void allocate_block(Allocator * alloc, IrBasicBlock * bb, IrBasicBlock * prev)
 {
-    IrInstruction * loadso = calloc(1, sizeof(IrInstruction));
-    loadso->op = IR_LOADSO;
-    loadso->value = spill_loc;
-    loadso->dest = spill_regs[0];
-    Ir_emit_instr_before(before, loadso);
+    RegisterState * state = &alloc->state;
+
+    // Start with the registers held at the end of the previous basic block, or
+    // else a predecessor already allocated.
+    IrBasicBlock * source = prev;
+    for(int i = 0;i < 2 && !is_predecessor(bb, source);i++)
+    {
+        IrBasicBlock * pred = bb->cfg_entry[i];
+        if(pred && alloc->visited[pred->index]) source = pred;
+    }
+
+    if(source)
+    {
+        state_copy(state, &alloc->end[source->index], alloc->count);
+    }
+    else
+    {
+        memset(state->held, 0, alloc->count * sizeof(IrRegister *));
+    }
+
+    // A loop header (entered from a block not yet allocated) starts without the
+    // values not used within the loop. Values changed within the loop start dirty,
+    // so they are not stored on each back edge. If the loop needs more registers
+    // than there are, values not changed within it are stored before entering it,
+    // rather than each time they are spilled; otherwise, they keep their state.
+    _Bool header = false, pressure = false;
+    for(int i = 0;i < 2;i++)
+    {
+        if(bb->cfg_entry[i] && !alloc->visited[bb->cfg_entry[i]->index]) header = true;
+    }
+    if(header) pressure = loop_definitions(alloc, bb, alloc->defined) > alloc->count;
+
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        IrRegister * value = state->held[reg];
+        if(!value) continue;
+
+        if(!is_live(bb->live.entry, value) ||
+           (header && alloc->next_use[bb->index][value->index] >= LOOP_EXIT_DISTANCE))
+            state->held[reg] = NULL;
+        else if(header && alloc->defined[value->index])
+            state->dirty[reg] = !value->remat;
+        else if(header && pressure)
+            state->dirty[reg] = false;
+    }
+    state_copy(&alloc->start[bb->index], state, alloc->count);
 
-    IrInstruction * load32 = calloc(1, sizeof(IrInstruction));
-    load32->op = IR_LOAD32;
-    load32->dest = dest;
-    load32->left = spill_regs[0];
-    Ir_emit_instr_before(before, load32);
+    // Find the last use of each value within the block.
+    for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
+    {
+        IrRegister * uses[] = {instr->left, instr->right, instr->index};
+        for(int i = 0;i < 3;i++)
+        {
+            if(is_value(uses[i])) alloc->last_use[uses[i]->index] = instr->live_position;
+        }
+    }
+    alloc->live_exit = bb->live.exit;
+
+    for(IrInstruction * instr = bb->head;instr != NULL;)
+    {
+        IrInstruction * next = instr->next;
+        allocate_instr(alloc, bb, instr);
+        instr = next;
+    }
+
+    state_copy(&alloc->end[bb->index], state, alloc->count);
+    alloc->visited[bb->index] = true;
 }
 
-static void regalloc_fixup(IrFunction * function, int * fixup_regs)
+// Insert a basic block on the CFG edge from pred to succ, for resolution code.
+static IrBasicBlock * split_edge(Allocator * alloc, IrBasicBlock * pred, IrBasicBlock * succ)
 {
-    // Create the spill register set.
-    IrRegister * spill_regs[REGS_SPILL];
-    for(int i = 0;i < REGS_SPILL;i++)
+    IrFunction * function = alloc->function;
+
+    IrBasicBlock * split = xcalloc(1, sizeof(IrBasicBlock));
+    split->index = Ir_new_block_index(function);
+    split->live.entry = split->live.exit = succ->live.entry;
+    split->loop_depth = pred->loop_depth < succ->loop_depth ? pred->loop_depth : succ->loop_depth;
+    Ir_emit_instr(function, split, (IrInstruction){.op = IR_NOP});
+    Ir_emit_instr(function, split, (IrInstruction){.op = IR_JUMP, .control.jump_true = succ});
+
+    split->cfg_entry[0] = pred;
+    for(int i = 0;i < 2;i++)
     {
-        spill_regs[i] = calloc(1, sizeof(IrRegister));
-        spill_regs[i]->type = REG_ANY;
-        spill_regs[i]->index = fixup_regs[i];
+        if(succ->cfg_entry[i] == pred) succ->cfg_entry[i] = split;
     }
-    IrRegister * spill_src = spill_regs[1];
-    IrRegister * spill_dest_left = spill_regs[2];
-    IrRegister * spill_dest_right = spill_regs[3];
+    if(pred->tail->control.jump_true == succ) pred->tail->control.jump_true = split;
+    if(pred->tail->control.jump_false == succ) pred->tail->control.jump_false = split;
 
-    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next)
+    // Keep falling through to the successor, if the predecessor did. Otherwise, the
+    // block is placed last.
+    if(pred->next == succ)
     {
-        for(IrInstruction * instr = bb->head;instr != NULL;)
+        split->next = succ;
+        pred->next = split;
+    }
+    else
+    {
+        function->tail->next = split;
+        function->tail = split;
+    }
+    return split;
+}
+
+// A value held in a register is stored on an edge, if it has changed and the
+// successor starts with it in memory (or in a register, unchanged).
+static _Bool needs_store(Allocator * alloc, RegisterState * from, RegisterState * to, int reg, IrBasicBlock * succ)
+{
+    IrRegister * value = from->held[reg];
+    if(!value || !from->dirty[reg] || !is_live(succ->live.entry, value)) return false;
+
+    int to_reg = state_find(to, alloc->count, value);
+    return to_reg == IN_MEMORY || !to->dirty[to_reg];
+}
+
+// Move values to the locations the successor starts with: first storing values
+// leaving registers, then moving values between registers, then loading values.
+static void resolve_edge(Allocator * alloc, IrBasicBlock * pred, IrBasicBlock * succ, int succ_count)
+{
+    // With no registers to allocate, every value is always in memory.
+    if(alloc->count == 0) return;
+
+    RegisterState * from = &alloc->end[pred->index];
+    RegisterState * to = &alloc->start[succ->index];
+
+    // Register each register is moved from (or IN_MEMORY to load it), or 'none'.
+    int none = alloc->count + 1, temp = alloc->count;
+    int source[alloc->count];
+    _Bool changed = false;
+
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        if(needs_store(alloc, from, to, reg, succ)) changed = true;
+
+        source[reg] = none;
+        if(to->held[reg] && from->held[reg] != to->held[reg])
         {
-            IrInstruction * next = instr->next;
+            source[reg] = state_find(from, alloc->count, to->held[reg]);
+            changed = true;
+        }
+    }
+    if(!changed) return;
 
-            if(instr->dest && instr->dest->type == REG_SPILL)
-            {
-                emit_spill_store(instr, instr->dest->spill, spill_regs);
-                instr->dest = spill_src;
-            }
+    // Insert code at the end of the predecessor, if it only jumps to the successor;
+    // at the start of the successor, if only entered from the predecessor; or
+    // otherwise, in a new block on the edge.
+    Cursor at;
+    if(succ_count == 1 && pred->tail->op == IR_JUMP)
+    {
+        at = (Cursor){pred, pred->tail};
+    }
+    else if(succ_count == 1 && !Ir_is_terminator(pred->tail))
+    {
+        at = (Cursor){pred, NULL};
+    }
+    else if(predecessors(succ) == 1)
+    {
+        at = (Cursor){succ, succ->head->op == IR_NOP ? succ->head->next : succ->head};
+    }
+    else
+    {
+        IrBasicBlock * split = split_edge(alloc, pred, succ);
+        at = (Cursor){split, split->tail};
+    }
+
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        if(needs_store(alloc, from, to, reg, succ))
+            emit_spill_store(alloc, &at, from->held[reg], alloc->regs[reg]);
+    }
+
+    // Registers are moved in parallel: each is only written once every move reading
+    // it is done. A cycle is broken by first copying one register to a spill register.
+    for(;;)
+    {
+        int pending = none;
+        _Bool progress = false;
+        for(int reg = 0;reg < alloc->count;reg++)
+        {
+            if(source[reg] == none || source[reg] == IN_MEMORY) continue;
 
-            if(instr->left && instr->left->type == REG_SPILL)
+            _Bool read = false;
+            for(int other = 0;other < alloc->count;other++)
             {
-                emit_spill_load(instr, instr->left->spill, spill_dest_left, spill_regs);
-                instr->left = spill_dest_left;
+                if(source[other] == reg) read = true;
             }
-            if(instr->right && instr->right->type == REG_SPILL)
+            if(read)
             {
-                emit_spill_load(instr, instr->right->spill, spill_dest_right, spill_regs);
-                instr->right = spill_dest_right;
+                pending = reg;
+                continue;
             }
 
-            instr = next;
+            IrRegister * src = source[reg] == temp ? alloc->spill_src : alloc->regs[source[reg]];
+            emit(alloc->function, &at, (IrInstruction){
+                .op = IR_MOV,
+                .dest = alloc->regs[reg],
+                .left = src
+            });
+            source[reg] = none;
+            progress = true;
+        }
+        if(pending == none) break;
+        if(progress) continue;
+
+        emit(alloc->function, &at, (IrInstruction){
+            .op = IR_MOV,
+            .dest = alloc->spill_src,
+            .left = alloc->regs[pending]
+        });
+        for(int reg = 0;reg < alloc->count;reg++)
+        {
+            if(source[reg] == pending) source[reg] = temp;
+        }
+    }
+
+    for(int reg = 0;reg < alloc->count;reg++)
+    {
+        if(source[reg] == IN_MEMORY) emit_spill_load(alloc, &at, to->held[reg], alloc->regs[reg]);
+    }
+}
+
+static RegisterState * states_new(int blocks, int count)
+{
+    RegisterState * states = xcalloc(blocks, sizeof(RegisterState));
+    for(int i = 0;i < blocks;i++)
+    {
+        states[i].held = xcalloc(count, sizeof(IrRegister *));
+        states[i].dirty = xcalloc(count, sizeof(_Bool));
+    }
+    return states;
+}
+
+static void states_free(RegisterState * states, int blocks)
+{
+    for(int i = 0;i < blocks;i++)
+    {
+        xfree(states[i].held);
+        xfree(states[i].dirty);
+    }
+    xfree(states);
+}
+
+static void regalloc_function(IrFunction * function, IrRegister ** regs, int count, IrRegister ** spill_regs)
+{
+    int values = function->registers.count + 1;
+    Allocator alloc = {
+        .function = function,
+        .count = count,
+        .regs = regs,
+        .spill_src = spill_regs[0],
+        .spill_dest_left = spill_regs[1],
+        .spill_dest_right = spill_regs[2],
+        .slot = xmalloc(values * sizeof(int)),
+        .last_use = xmalloc(values * sizeof(int)),
+        .rematerialised = xcalloc(values, sizeof(_Bool)),
+        .defined = xcalloc(values, sizeof(_Bool))
+    };
+    for(int i = 0;i < values;i++) alloc.slot[i] = alloc.last_use[i] = -1;
+
+    int blocks = 0;
+    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next) blocks++;
+    alloc.block_count = Ir_block_count(function);
+    IrBasicBlock ** order = xcalloc(blocks, sizeof(IrBasicBlock *));
+    alloc.start = states_new(alloc.block_count, count);
+    alloc.end = states_new(alloc.block_count, count);
+    alloc.visited = xcalloc(alloc.block_count, sizeof(_Bool));
+    alloc.state.held = xcalloc(count, sizeof(IrRegister *));
+    alloc.state.dirty = xcalloc(count, sizeof(_Bool));
+
+    int i = 0;
+    for(IrBasicBlock * bb = function->head;bb != NULL;bb = bb->next) order[i++] = bb;
+
+    Timing_start("allocate");
+    regalloc_find_remat(function);
+    regalloc_spill_costs(function);
+    next_use_analysis(&alloc, order, blocks);
+
+    for(i = 0;i < blocks;i++)
+    {
+        allocate_block(&alloc, order[i], i > 0 ? order[i - 1] : NULL);
+    }
+    Timing_stop();
+
+    Timing_start("resolve");
+    for(i = 0;i < blocks;i++)
+    {
+        IrBasicBlock * succ[2];
+        int succ_count = Ir_successors(order[i], succ);
+        for(int s = 0;s < succ_count;s++)
+        {
+            resolve_edge(&alloc, order[i], succ[s], succ_count);
         }
     }
+    Ir_compact(function);
+    Timing_stop();
+
+    for(i = 0;i < alloc.block_count;i++) xfree(alloc.next_use[i]);
+    xfree(alloc.next_use);
+    states_free(alloc.start, alloc.block_count);
+    states_free(alloc.end, alloc.block_count);
+    xfree(alloc.state.held);
+    xfree(alloc.state.dirty);
+    xfree(alloc.visited);
+    xfree(alloc.slot);
+    xfree(alloc.last_use);
+    xfree(alloc.rematerialised);
+    xfree(alloc.defined);
+    xfree(order);
+}
+
+static IrRegister * new_register(int index)
+{
+    IrRegister * reg = xcalloc(1, sizeof(IrRegister));
+    reg->type = REG_ANY;
+    reg->index = index;
+    return reg;
 }
 
 void regalloc(IrFunction * function, int * free_registers)
 {
     for(int i = 0;i < REGS_SPILL;i++) assert(free_registers[i] != -1);
 
-    int * spill_regs = free_registers;
-    int * free_regs = free_registers + REGS_SPILL;
+    // Create the spill register set, and allocatable register set.
+    IrRegister * spill_regs[REGS_SPILL];
+    for(int i = 0;i < REGS_SPILL;i++)
+    {
+        spill_regs[i] = new_register(free_registers[i]);
+    }
+
+    int count = 0;
+    for(;free_registers[REGS_SPILL + count] != -1;count++);
+    assert(count <= 32);
+
+    IrRegister ** regs = xcalloc(count + 1, sizeof(IrRegister *));
+    for(int i = 0;i < count;i++)
+    {
+        regs[i] = new_register(free_registers[REGS_SPILL + i]);
+    }
 
     for(;function;function=function->next)
     {
-        regalloc_alloc(function, free_regs);
-        regalloc_fixup(function, spill_regs);
+        regalloc_function(function, regs, count, spill_regs);
     }
 }
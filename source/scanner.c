@@ -5,20 +5,51 @@
 #include <string.h>
 
 #include "error.h"
+#include "intern.h"
 #include "scanner.h"
 #include "token.h"
+#include "util.h"
 
-#define IDENTIFIER_START_CHARACTERS                                                      \
-    "QWERTYUIOPASDFGHJKLZXCVBNMqwertyuiopasdfghjklzxcvbnm_"
-#define IDENTIFIER_CHARACTERS                                                            \
-    "QWERTYUIOPASDFGHJKLZXCVBNMqwertyuiopasdfghjklzxcvbnm_1234567890"
+// Character classes, used for classifying characters in the source input.
+#define CHAR_IDENTIFIER_START 0x1
+#define CHAR_IDENTIFIER 0x2
+#define CHAR_DIGIT 0x4
+
+#define IS_IDENTIFIER_START(c) (char_class[(unsigned char)(c)] & CHAR_IDENTIFIER_START)
+#define IS_IDENTIFIER(c) (char_class[(unsigned char)(c)] & CHAR_IDENTIFIER)
+#define IS_DIGIT(c) (char_class[(unsigned char)(c)] & CHAR_DIGIT)
+
+static const unsigned char char_class[256] = {
+    ['A' ... 'Z'] = CHAR_IDENTIFIER_START | CHAR_IDENTIFIER,
+    ['a' ... 'z'] = CHAR_IDENTIFIER_START | CHAR_IDENTIFIER,
+    ['_'] = CHAR_IDENTIFIER_START | CHAR_IDENTIFIER,
+    ['0' ... '9'] = CHAR_IDENTIFIER | CHAR_DIGIT,
+};
 
 #define COUNT(n) sizeof(n) / sizeof(n[0])
-#define PEEK(scanner)                                                                    \
-    (scanner->current < strlen(scanner->source) ? scanner->source[scanner->current] : 0)
-#define END_OF_FILE(scanner) (scanner->current >= strlen(scanner->source))
+
+// Number of tokens allocated at once, in each chunk of the token arena.
+#define TOKEN_ARENA_CHUNK_SIZE 1024
+
+// The source buffer is terminated by a '\0' sentinel (at source[length]), so
+// peeking at the current character never needs a bounds check: the sentinel
+// matches no token, and stops the scanner's inner loops.
+#define PEEK(scanner) (scanner->source[scanner->current])
+#define END_OF_FILE(scanner) (scanner->current >= scanner->length)
 #define ADVANCE(scanner) (scanner->current++)
 
+/*
+ * Token arena
+ * Tokens are allocated in chunks, which are linked together so they can be freed
+ * when the scanner is destroyed.
+ */
+typedef struct TokenArenaChunk
+{
+    struct TokenArenaChunk *prev;
+    int used;
+    Token tokens[TOKEN_ARENA_CHUNK_SIZE];
+} TokenArenaChunk;
+
 /*
  * Scanner class
  * This struct encapsulates all state required by the scanner.
@@ -27,8 +58,9 @@ typedef struct Scanner_t
 {
     ErrorReporter *error_reporter;
 
-    // Source file
+    // Source file, and its length (excluding the '\0' sentinel).
     const char *source;
+    int length;
 
     // Current position in the input.
     int current;
@@ -39,6 +71,9 @@ typedef struct Scanner_t
     int line_positions_size;
     int line_positions_next;
     const char **line_positions;
+
+    // Token arena (most recently allocated chunk).
+    TokenArenaChunk *tokens;
 } Scanner;
 
 /*
@@ -52,13 +87,27 @@ static bool match_whitespace(Scanner *);
 static bool consume_keyword_or_identifier(Scanner *, TokenType *);
 static bool consume_comment(Scanner *);
 
+static Token *new_token(Scanner *scanner)
+{
+    TokenArenaChunk *chunk = scanner->tokens;
+    if (!chunk || chunk->used == TOKEN_ARENA_CHUNK_SIZE)
+    {
+        chunk = xmalloc(sizeof(TokenArenaChunk));
+        assert(chunk);
+        chunk->prev = scanner->tokens;
+        chunk->used = 0;
+        scanner->tokens = chunk;
+    }
+    return &chunk->tokens[chunk->used++];
+}
+
 static void store_line_position(Scanner *scanner)
 {
     if (scanner->line_positions_next >= scanner->line_positions_size)
     {
-        scanner->line_positions = realloc(
-            scanner->line_positions, sizeof(char *) * (scanner->line_positions_size + 5));
-        scanner->line_positions_size += 5;
+        scanner->line_positions_size *= 2;
+        scanner->line_positions = xrealloc(scanner->line_positions,
+                                           sizeof(char *) * scanner->line_positions_size);
     }
     scanner->line_positions[scanner->line_positions_next++] =
         scanner->source + scanner->current;
@@ -66,12 +115,11 @@ static void store_line_position(Scanner *scanner)
 
 static bool match_character(Scanner *scanner, const char *expected)
 {
-    if (END_OF_FILE(scanner))
-        return false;
-
+    // No end-of-file check required: the sentinel never matches.
+    char focus = PEEK(scanner);
     for (; *expected; expected++)
     {
-        if (scanner->source[scanner->current] == *expected)
+        if (focus == *expected)
         {
             scanner->current++;
             return true;
@@ -106,30 +154,15 @@ static bool match_whitespace(Scanner *scanner)
 static bool consume_keyword_or_identifier(Scanner *scanner, TokenType *token_type)
 {
     const char *identifier_start = scanner->source + scanner->current++;
-    int identifier_length = 1;
 
-    while (match_character(scanner, IDENTIFIER_CHARACTERS))
+    // The sentinel is not an identifier character, so this stops at end-of-file.
+    while (IS_IDENTIFIER(PEEK(scanner)))
     {
-        identifier_length++;
+        ADVANCE(scanner);
     }
 
-    char *keywords[] = {
-        "auto",   "char",   "const",    "else",   "extern",   "if",
-        "int",    "long",   "register", "return", "short",    "signed",
-        "sizeof", "static", "unsigned", "void",   "volatile", "while",
-    };
-
-    for (int i = 0; i < COUNT(keywords); i++)
-    {
-        if (strlen(keywords[i]) != identifier_length)
-            continue;
-        if (strncmp(identifier_start, keywords[i], identifier_length))
-            continue;
-
-        *token_type = AUTO + i;
-        return true;
-    }
-    *token_type = IDENTIFIER;
+    int identifier_length = scanner->source + scanner->current - identifier_start;
+    *token_type = Token_keyword(identifier_start, identifier_length);
     return true;
 }
 
@@ -139,23 +172,25 @@ static bool consume_comment(Scanner *scanner)
     ADVANCE(scanner);
     if (match_character(scanner, "/"))
     {
-        while (scanner->source[scanner->current] != '\n')
+        while (PEEK(scanner) != '\n' && !END_OF_FILE(scanner))
             scanner->current++;
     }
     else if (match_character(scanner, "*"))
     {
-        while (true)
+        while (!END_OF_FILE(scanner))
         {
             if (match_character(scanner, "\n"))
             {
                 scanner->line_number++;
+                scanner->line_start_position = scanner->current;
                 store_line_position(scanner);
                 continue;
             }
             if (scanner->source[scanner->current++] != '*')
                 continue;
-            if (scanner->source[scanner->current++] != '/')
+            if (PEEK(scanner) != '/')
                 continue;
+            ADVANCE(scanner);
             break;
         }
     }
@@ -301,14 +336,14 @@ static TokenType get_next_token_type(Scanner *scanner)
     }
 
     // Number literal.
-    if (strchr("1234567890", focus))
+    if (IS_DIGIT(focus))
     {
-        while (match_character(scanner, "1234567890"))
-            continue;
+        while (IS_DIGIT(PEEK(scanner)))
+            ADVANCE(scanner);
         return CONSTANT;
     }
 
-    if (strchr(IDENTIFIER_START_CHARACTERS, focus))
+    if (IS_IDENTIFIER_START(focus))
     {
         scanner->current--;
         TokenType token;
@@ -339,21 +374,41 @@ static TokenType get_next_token_type(Scanner *scanner)
  */
 Scanner *Scanner_init(char const *source, ErrorReporter *error_reporter)
 {
-    Scanner *scanner = malloc(sizeof(Scanner));
+    return Scanner_init_n(source, strlen(source), error_reporter);
+}
+
+/*
+ * Initialize Scanner, with a known source length.
+ *
+ * Parameters:
+ *  source - pointer to source code. source[len] must be '\0'.
+ *  len - length of the source code, in bytes.
+ *
+ * Returns:
+ *  pointer to allocated Scanner instance.
+ */
+Scanner *Scanner_init_n(char const *source, int len, ErrorReporter *error_reporter)
+{
+    assert(source[len] == '\0');
+
+    Scanner *scanner = xmalloc(sizeof(Scanner));
     assert(scanner);
 
     scanner->error_reporter = error_reporter;
     scanner->source = source;
+    scanner->length = len;
     scanner->current = 0;
     scanner->line_number = 1;
     scanner->line_start_position = 0;
 
     // Allocate space for the line positions array.
-    scanner->line_positions = calloc(5, sizeof(char *));
+    scanner->line_positions = xcalloc(5, sizeof(char *));
     scanner->line_positions_size = 5;
     scanner->line_positions_next = 1;
     scanner->line_positions[0] = scanner->source;
 
+    scanner->tokens = NULL;
+
     return scanner;
 }
 
@@ -373,7 +428,7 @@ Token *Scanner_get_next(Scanner *scanner)
         token_position = scanner->current;
         token_line_number = scanner->line_number;
 
-        if (scanner->current >= strlen(scanner->source))
+        if (END_OF_FILE(scanner))
         {
             token_type = END_OF_FILE;
             break;
@@ -388,20 +443,22 @@ Token *Scanner_get_next(Scanner *scanner)
             break;
     }
 
-    Token *token = calloc(1, sizeof(Token));
-    token->type = token_type;
-    token->pos.line = token_line_number;
-    token->pos.position = token_position - scanner->line_start_position;
-
-    // Make a copy of the lexeme.
-    int token_len = scanner->current - token_position;
-    token->lexeme = calloc(1, token_len + 1);
-    strncpy(token->lexeme, scanner->source + token_position, token_len);
+    Token *token = new_token(scanner);
+    *token = (Token){
+        .type = token_type,
+        .pos = {token_line_number, token_position - scanner->line_start_position},
+        .lexeme = {scanner->current - token_position, scanner->source + token_position},
+    };
 
     // The literal value for the token, if it's a
-    // string literal or constant.
+    // string literal or constant. The lexeme is followed by a non-digit
+    // (or the sentinel), so atoi stops at the end of the slice.
     if (token->type == CONSTANT)
-        token->literal.const_value = atoi(token->lexeme);
+        token->literal.const_value = atoi(token->lexeme.start);
+
+    // Identifiers share a single canonical name, so they can be compared by pointer.
+    if (token->type == IDENTIFIER)
+        token->name = Intern_string(token->lexeme.start, token->lexeme.length);
 
     return token;
 }
@@ -411,8 +468,17 @@ Token *Scanner_get_next(Scanner *scanner)
  */
 void Scanner_destroy(Scanner *scanner)
 {
+    // Free up the token arena.
+    for (TokenArenaChunk *chunk = scanner->tokens; chunk;)
+    {
+        TokenArenaChunk *prev = chunk->prev;
+        xfree(chunk);
+        chunk = prev;
+    }
+
     // Free up scanner.
-    free(scanner);
+    xfree(scanner->line_positions);
+    xfree(scanner);
 }
 
 /*
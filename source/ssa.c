@@ -0,0 +1,795 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ir.h"
+#include "ssa.h"
+#include "util.h"
+
+#define IS_VIRTUAL(reg) ((reg) && (reg)->type == REG_ANY)
+
+/*
+ * The basic blocks reachable from the entry block, in reverse postorder, and the
+ * position of each block in 'order' (by IrBasicBlock.index; -1 if unreachable).
+ */
+typedef struct Cfg
+{
+    IrBasicBlock **order;
+    int *position;
+    int count;
+} Cfg;
+
+static Cfg cfg_init(IrFunction *function)
+{
+    int count = 0, size = 0;
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        count++;
+        if (bb->index >= size)
+            size = bb->index + 1;
+    }
+
+    Cfg cfg = {
+        .order = xmalloc(count * sizeof(IrBasicBlock *)),
+        .position = xmalloc(size * sizeof(int)),
+    };
+    IrBasicBlock **stack = xmalloc(count * sizeof(IrBasicBlock *));
+    int *visited = xcalloc(size, sizeof(int));
+
+    // Depth-first search, recording each block (in postorder) once all of its
+    // successors have been visited. 'visited' counts the successors visited (+1).
+    int top = 0;
+    stack[top++] = function->head;
+    visited[function->head->index] = 1;
+    while (top)
+    {
+        IrBasicBlock *bb = stack[top - 1], *succ[2];
+        int next = visited[bb->index] - 1;
+        if (next < Ir_successors(bb, succ))
+        {
+            visited[bb->index]++;
+            if (!visited[succ[next]->index])
+            {
+                visited[succ[next]->index] = 1;
+                stack[top++] = succ[next];
+            }
+            continue;
+        }
+        cfg.order[cfg.count++] = bb;
+        top--;
+    }
+
+    for (int i = 0; i < cfg.count / 2; i++)
+    {
+        IrBasicBlock *bb = cfg.order[i];
+        cfg.order[i] = cfg.order[cfg.count - 1 - i];
+        cfg.order[cfg.count - 1 - i] = bb;
+    }
+    for (int i = 0; i < size; i++)
+        cfg.position[i] = -1;
+    for (int i = 0; i < cfg.count; i++)
+        cfg.position[cfg.order[i]->index] = i;
+
+    xfree(stack);
+    xfree(visited);
+    return cfg;
+}
+
+static void cfg_free(Cfg *cfg)
+{
+    xfree(cfg->order);
+    xfree(cfg->position);
+}
+
+static bool reachable(Cfg *cfg, IrBasicBlock *bb)
+{
+    return bb && cfg->position[bb->index] >= 0;
+}
+
+static IrBasicBlock *intersect(Cfg *cfg, IrBasicBlock *a, IrBasicBlock *b)
+{
+    while (a != b)
+    {
+        while (cfg->position[a->index] > cfg->position[b->index])
+            a = a->idom;
+        while (cfg->position[b->index] > cfg->position[a->index])
+            b = b->idom;
+    }
+    return a;
+}
+
+/*
+ * Find the immediate dominator of each reachable basic block, iterating over the
+ * blocks in reverse postorder until nothing changes (Cooper, Harvey & Kennedy -
+ * "A Simple, Fast Dominance Algorithm").
+ */
+static void find_dominators(Cfg *cfg)
+{
+    IrBasicBlock *entry = cfg->order[0];
+    for (int i = 0; i < cfg->count; i++)
+        cfg->order[i]->idom = NULL;
+    entry->idom = entry;
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int i = 1; i < cfg->count; i++)
+        {
+            IrBasicBlock *bb = cfg->order[i], *idom = NULL;
+            for (int p = 0; p < 2; p++)
+            {
+                IrBasicBlock *pred = bb->cfg_entry[p];
+                if (!reachable(cfg, pred) || !pred->idom)
+                    continue;
+                idom = idom ? intersect(cfg, idom, pred) : pred;
+            }
+            if (bb->idom != idom)
+            {
+                bb->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    entry->idom = NULL;
+}
+
+static bool dominates(IrBasicBlock *a, IrBasicBlock *b)
+{
+    for (; b; b = b->idom)
+    {
+        if (b == a)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Basic blocks as a list, for each block position (E.g. the dominance frontier,
+ * or the dominator tree children, of each block).
+ */
+typedef struct BlockList
+{
+    IrBasicBlock **blocks;
+    int count, size;
+} BlockList;
+
+static void block_list_add(BlockList *list, IrBasicBlock *bb)
+{
+    if (list->count == list->size)
+    {
+        list->size = list->size ? list->size * 2 : 4;
+        list->blocks = xrealloc(list->blocks, list->size * sizeof(IrBasicBlock *));
+    }
+    list->blocks[list->count++] = bb;
+}
+
+static void block_lists_free(BlockList *lists, int count)
+{
+    for (int i = 0; i < count; i++)
+        xfree(lists[i].blocks);
+    xfree(lists);
+}
+
+/*
+ * Find the dominance frontier of each basic block: the join points where its
+ * dominance ends.
+ */
+static BlockList *find_frontiers(Cfg *cfg)
+{
+    BlockList *frontiers = xcalloc(cfg->count, sizeof(BlockList));
+    for (int i = 0; i < cfg->count; i++)
+    {
+        IrBasicBlock *bb = cfg->order[i];
+        if (!reachable(cfg, bb->cfg_entry[0]) || !reachable(cfg, bb->cfg_entry[1]))
+            continue;
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (IrBasicBlock *runner = bb->cfg_entry[p]; runner != bb->idom;
+                 runner = runner->idom)
+            {
+                BlockList *frontier = &frontiers[cfg->position[runner->index]];
+                if (frontier->count && frontier->blocks[frontier->count - 1] == bb)
+                    break;
+                block_list_add(frontier, bb);
+            }
+        }
+    }
+    return frontiers;
+}
+
+static IrInstruction *first_phi(IrBasicBlock *bb)
+{
+    IrInstruction *instr = bb->head;
+    while (instr && instr->op == IR_NOP)
+        instr = instr->next;
+    return instr && instr->op == IR_PHI ? instr : NULL;
+}
+
+static IrInstruction *next_phi(IrInstruction *phi)
+{
+    return phi->next && phi->next->op == IR_PHI ? phi->next : NULL;
+}
+
+/*
+ * Insert a phi for register 'reg' at the start of basic block 'bb' (after the
+ * leading NOP, if any).
+ */
+static void insert_phi(IrFunction *function, IrBasicBlock *bb, IrRegister *reg)
+{
+    IrInstruction *phi = Ir_new_instr(function, (IrInstruction){
+                                                    .op = IR_PHI,
+                                                    .dest = reg,
+                                                    .left = reg,
+                                                    .right = reg,
+                                                    .control.jump_true = bb->cfg_entry[0],
+                                                    .control.jump_false = bb->cfg_entry[1],
+                                                });
+    if (bb->head->op == IR_NOP)
+    {
+        Ir_emit_instr_after(bb->head, phi);
+        if (bb->tail == bb->head)
+            bb->tail = phi;
+    }
+    else
+    {
+        Ir_emit_instr_before(bb->head, phi);
+        bb->head = phi;
+    }
+}
+
+/*
+ * Place phis for each register which is live across basic blocks (read in a block
+ * before it is defined there - 'semi-pruned' SSA), at the iterated dominance
+ * frontier of the blocks defining it.
+ */
+static void place_phis(IrFunction *function, Cfg *cfg, BlockList *frontiers)
+{
+    int regs = function->registers.count;
+    bool *global = xcalloc(regs + 1, sizeof(bool));
+    int *stamp = xmalloc((regs + 1) * sizeof(int));
+    BlockList *defs = xcalloc(regs + 1, sizeof(BlockList));
+
+    for (int i = 0; i < regs; i++)
+        stamp[i] = -1;
+    for (int i = 0; i < cfg->count; i++)
+    {
+        IrBasicBlock *bb = cfg->order[i];
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            IrRegister *uses[] = {instr->left, instr->right, instr->index};
+            for (int u = 0; u < 3; u++)
+            {
+                if (IS_VIRTUAL(uses[u]) && stamp[uses[u]->index] != i)
+                    global[uses[u]->index] = true;
+            }
+            if (IS_VIRTUAL(instr->dest) && stamp[instr->dest->index] != i)
+            {
+                stamp[instr->dest->index] = i;
+                block_list_add(&defs[instr->dest->index], bb);
+            }
+        }
+    }
+
+    // 'has_phi' and 'queued' record the register each block was last handled for.
+    int *has_phi = xmalloc(cfg->count * sizeof(int));
+    int *queued = xmalloc(cfg->count * sizeof(int));
+    IrBasicBlock **work = xmalloc(cfg->count * sizeof(IrBasicBlock *));
+    for (int i = 0; i < cfg->count; i++)
+        has_phi[i] = queued[i] = -1;
+
+    for (int r = 0; r < regs; r++)
+    {
+        if (!global[r])
+            continue;
+
+        int top = 0;
+        for (int d = 0; d < defs[r].count; d++)
+        {
+            work[top++] = defs[r].blocks[d];
+            queued[cfg->position[defs[r].blocks[d]->index]] = r;
+        }
+        while (top)
+        {
+            BlockList *frontier = &frontiers[cfg->position[work[--top]->index]];
+            for (int f = 0; f < frontier->count; f++)
+            {
+                IrBasicBlock *bb = frontier->blocks[f];
+                int position = cfg->position[bb->index];
+                if (has_phi[position] == r)
+                    continue;
+                insert_phi(function, bb, function->registers.list[r]);
+                has_phi[position] = r;
+                if (queued[position] != r)
+                {
+                    queued[position] = r;
+                    work[top++] = bb;
+                }
+            }
+        }
+    }
+
+    xfree(global);
+    xfree(stamp);
+    block_lists_free(defs, regs + 1);
+    xfree(has_phi);
+    xfree(queued);
+    xfree(work);
+}
+
+/*
+ * Register renaming state. 'current' maps each original register (by index) to
+ * the register holding its value at this point in the dominator tree walk, and
+ * 'saved' records the previous mappings, to restore on leaving each block.
+ */
+typedef struct Renamer
+{
+    IrFunction *function;
+    Cfg *cfg;
+    BlockList *children;
+
+    int regs;
+    IrRegister **current;
+    bool *defined;
+
+    struct
+    {
+        int index;
+        IrRegister *reg;
+    } *saved;
+    int saved_count, saved_size;
+
+    // Register read where no definition reaches it (E.g. on a path where a variable
+    // is not initialised), defined as 0 in the entry block.
+    IrRegister *undefined;
+} Renamer;
+
+static IrRegister *rename_use(Renamer *renamer, IrRegister *reg)
+{
+    if (!IS_VIRTUAL(reg) || reg->index >= renamer->regs)
+        return reg;
+    if (renamer->current[reg->index])
+        return renamer->current[reg->index];
+
+    if (!renamer->undefined)
+    {
+        IrBasicBlock *entry = renamer->function->head;
+        renamer->undefined = Ir_new_register(renamer->function);
+        IrInstruction *loadi = Ir_new_instr(
+            renamer->function,
+            (IrInstruction){.op = IR_LOADI, .dest = renamer->undefined, .value = 0});
+        Ir_emit_instr_before(entry->head, loadi);
+        entry->head = loadi;
+    }
+    return renamer->undefined;
+}
+
+/*
+ * Give the destination of 'instr' a new register (unless this is the first
+ * definition of the original register found).
+ */
+static void rename_def(Renamer *renamer, IrInstruction *instr)
+{
+    int index = instr->dest->index;
+    if (renamer->saved_count == renamer->saved_size)
+    {
+        renamer->saved_size = renamer->saved_size ? renamer->saved_size * 2 : 64;
+        renamer->saved =
+            xrealloc(renamer->saved, renamer->saved_size * sizeof(renamer->saved[0]));
+    }
+    renamer->saved[renamer->saved_count].index = index;
+    renamer->saved[renamer->saved_count++].reg = renamer->current[index];
+
+    if (renamer->defined[index])
+        instr->dest = Ir_new_register(renamer->function);
+    renamer->defined[index] = true;
+    renamer->current[index] = instr->dest;
+}
+
+static void rename_block(Renamer *renamer, IrBasicBlock *bb)
+{
+    int saved_count = renamer->saved_count;
+
+    for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+    {
+        if (instr->op != IR_PHI)
+        {
+            instr->left = rename_use(renamer, instr->left);
+            instr->right = rename_use(renamer, instr->right);
+            instr->index = rename_use(renamer, instr->index);
+        }
+        if (IS_VIRTUAL(instr->dest) && instr->dest->index < renamer->regs)
+            rename_def(renamer, instr);
+    }
+
+    // Fill in the phi operands for this predecessor.
+    IrBasicBlock *succ[2];
+    for (int s = Ir_successors(bb, succ) - 1; s >= 0; s--)
+    {
+        for (IrInstruction *phi = first_phi(succ[s]); phi; phi = next_phi(phi))
+        {
+            if (phi->control.jump_true == bb)
+                phi->left = rename_use(renamer, phi->left);
+            if (phi->control.jump_false == bb)
+                phi->right = rename_use(renamer, phi->right);
+        }
+    }
+
+    BlockList *children = &renamer->children[renamer->cfg->position[bb->index]];
+    for (int i = 0; i < children->count; i++)
+        rename_block(renamer, children->blocks[i]);
+
+    while (renamer->saved_count > saved_count)
+    {
+        renamer->saved_count--;
+        renamer->current[renamer->saved[renamer->saved_count].index] =
+            renamer->saved[renamer->saved_count].reg;
+    }
+}
+
+static void rename_registers(IrFunction *function, Cfg *cfg)
+{
+    int regs = function->registers.count;
+    Renamer renamer = {
+        .function = function,
+        .cfg = cfg,
+        .children = xcalloc(cfg->count, sizeof(BlockList)),
+        .regs = regs,
+        .current = xcalloc(regs + 1, sizeof(IrRegister *)),
+        .defined = xcalloc(regs + 1, sizeof(bool)),
+    };
+
+    for (int i = 1; i < cfg->count; i++)
+    {
+        IrBasicBlock *bb = cfg->order[i];
+        block_list_add(&renamer.children[cfg->position[bb->idom->index]], bb);
+    }
+    rename_block(&renamer, cfg->order[0]);
+
+    block_lists_free(renamer.children, cfg->count);
+    xfree(renamer.current);
+    xfree(renamer.defined);
+    xfree(renamer.saved);
+}
+
+/*
+ * Remove phis whose result is not used (other than by phis which are themselves
+ * not used).
+ */
+static void remove_dead_phis(IrFunction *function, Cfg *cfg)
+{
+    int regs = function->registers.count;
+    bool *used = xcalloc(regs + 1, sizeof(bool));
+    IrInstruction **phis = xcalloc(regs + 1, sizeof(IrInstruction *));
+    IrRegister **work = xmalloc((regs + 1) * sizeof(IrRegister *));
+    int top = 0;
+
+    for (int i = 0; i < cfg->count; i++)
+    {
+        for (IrInstruction *instr = cfg->order[i]->head; instr; instr = instr->next)
+        {
+            if (instr->op == IR_PHI)
+            {
+                phis[instr->dest->index] = instr;
+                continue;
+            }
+            IrRegister *uses[] = {instr->left, instr->right, instr->index};
+            for (int u = 0; u < 3; u++)
+            {
+                if (IS_VIRTUAL(uses[u]) && !used[uses[u]->index])
+                {
+                    used[uses[u]->index] = true;
+                    work[top++] = uses[u];
+                }
+            }
+        }
+    }
+
+    // The operands of used phis are used.
+    while (top)
+    {
+        IrInstruction *phi = phis[work[--top]->index];
+        if (!phi)
+            continue;
+        IrRegister *operands[] = {phi->left, phi->control.jump_false ? phi->right : NULL};
+        for (int o = 0; o < 2; o++)
+        {
+            if (IS_VIRTUAL(operands[o]) && !used[operands[o]->index])
+            {
+                used[operands[o]->index] = true;
+                work[top++] = operands[o];
+            }
+        }
+    }
+
+    for (int i = 0; i < cfg->count; i++)
+    {
+        IrBasicBlock *bb = cfg->order[i];
+        for (IrInstruction *phi = first_phi(bb); phi;)
+        {
+            IrInstruction *next = next_phi(phi);
+            if (!used[phi->dest->index])
+                Ir_remove_instr(bb, phi);
+            phi = next;
+        }
+    }
+
+    xfree(used);
+    xfree(phis);
+    xfree(work);
+}
+
+static void construct(IrFunction *function)
+{
+    Cfg cfg = cfg_init(function);
+    find_dominators(&cfg);
+
+    BlockList *frontiers = find_frontiers(&cfg);
+    place_phis(function, &cfg, frontiers);
+    block_lists_free(frontiers, cfg.count);
+
+    rename_registers(function, &cfg);
+    remove_dead_phis(function, &cfg);
+    Ir_compact(function);
+
+    cfg_free(&cfg);
+}
+
+/*
+ * Check that the definition of 'reg' (in 'def_block') reaches instruction 'instr'
+ * in basic block 'bb'.
+ */
+static bool definition_reaches(IrRegister *reg, IrInstruction **defs, IrBasicBlock **def_blocks,
+                               IrBasicBlock *bb, IrInstruction *instr)
+{
+    if (!IS_VIRTUAL(reg))
+        return true;
+    if (!defs[reg->index])
+        return false;
+    if (def_blocks[reg->index] != bb)
+        return dominates(def_blocks[reg->index], bb);
+
+    // Defined earlier in the same basic block.
+    for (IrInstruction *prev = instr ? instr->prev : bb->tail; prev; prev = prev->prev)
+    {
+        if (prev == defs[reg->index])
+            return true;
+    }
+    return false;
+}
+
+bool Ssa_verify(IrFunction *function)
+{
+    Cfg cfg = cfg_init(function);
+    find_dominators(&cfg);
+
+    int regs = function->registers.count;
+    IrInstruction **defs = xcalloc(regs + 1, sizeof(IrInstruction *));
+    IrBasicBlock **def_blocks = xcalloc(regs + 1, sizeof(IrBasicBlock *));
+    bool valid = true;
+
+    // Each register is defined once, and phis are at the start of basic blocks, with
+    // an operand for each predecessor.
+    for (int i = 0; i < cfg.count; i++)
+    {
+        IrBasicBlock *bb = cfg.order[i];
+        bool leading = true;
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            if (instr->op == IR_PHI)
+            {
+                IrBasicBlock *a = instr->control.jump_true, *b = instr->control.jump_false;
+                valid &= leading;
+                valid &= (a == bb->cfg_entry[0] && b == bb->cfg_entry[1]) ||
+                         (a == bb->cfg_entry[1] && b == bb->cfg_entry[0]);
+            }
+            else if (instr->op != IR_NOP)
+            {
+                leading = false;
+            }
+
+            if (IS_VIRTUAL(instr->dest))
+            {
+                valid &= !defs[instr->dest->index];
+                defs[instr->dest->index] = instr;
+                def_blocks[instr->dest->index] = bb;
+            }
+        }
+    }
+
+    // Each use is reached by its definition.
+    for (int i = 0; valid && i < cfg.count; i++)
+    {
+        IrBasicBlock *bb = cfg.order[i];
+        for (IrInstruction *instr = bb->head; instr; instr = instr->next)
+        {
+            if (instr->op == IR_PHI)
+            {
+                valid &= definition_reaches(instr->left, defs, def_blocks,
+                                            instr->control.jump_true, NULL);
+                if (instr->control.jump_false)
+                    valid &= definition_reaches(instr->right, defs, def_blocks,
+                                                instr->control.jump_false, NULL);
+                continue;
+            }
+            valid &= definition_reaches(instr->left, defs, def_blocks, bb, instr);
+            valid &= definition_reaches(instr->right, defs, def_blocks, bb, instr);
+            valid &= definition_reaches(instr->index, defs, def_blocks, bb, instr);
+        }
+    }
+
+    xfree(defs);
+    xfree(def_blocks);
+    cfg_free(&cfg);
+    return valid;
+}
+
+/*
+ * Split the critical edges into basic blocks with phis: from a predecessor with
+ * two successors, where the copies for the phis cannot be placed.
+ */
+static void split_critical_edges(IrFunction *function)
+{
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+    {
+        if (!first_phi(bb))
+            continue;
+
+        for (int p = 0; p < 2; p++)
+        {
+            IrBasicBlock *pred = bb->cfg_entry[p], *succ[2];
+            if (!pred || Ir_successors(pred, succ) < 2)
+                continue;
+
+            IrBasicBlock *split = xcalloc(1, sizeof(IrBasicBlock));
+            split->index = Ir_new_block_index(function);
+            Ir_emit_instr(function, split, (IrInstruction){.op = IR_NOP});
+            Ir_emit_instr(function, split, (IrInstruction){.op = IR_JUMP, .control.jump_true = bb});
+            split->cfg_entry[0] = pred;
+            split->loop_depth = pred->loop_depth < bb->loop_depth ? pred->loop_depth
+                                                                  : bb->loop_depth;
+            bb->cfg_entry[p] = split;
+
+            IrInstruction *branch = pred->tail;
+            if (branch->control.jump_true == bb)
+                branch->control.jump_true = split;
+            if (branch->control.jump_false == bb)
+                branch->control.jump_false = split;
+            for (IrInstruction *phi = first_phi(bb); phi; phi = next_phi(phi))
+            {
+                if (phi->control.jump_true == pred)
+                    phi->control.jump_true = split;
+                if (phi->control.jump_false == pred)
+                    phi->control.jump_false = split;
+            }
+
+            split->next = pred->next;
+            pred->next = split;
+            if (function->tail == pred)
+                function->tail = split;
+        }
+    }
+}
+
+/*
+ * Emit a MOV at the end of basic block 'bb' (before its terminator, if any).
+ */
+static void emit_copy(IrFunction *function, IrBasicBlock *bb, IrRegister *dest, IrRegister *src)
+{
+    IrInstruction mov = {.op = IR_MOV, .dest = dest, .left = src};
+    if (!Ir_is_terminator(bb->tail))
+    {
+        Ir_emit_instr(function, bb, mov);
+        return;
+    }
+
+    IrInstruction *instr = Ir_new_instr(function, mov);
+    Ir_emit_instr_before(bb->tail, instr);
+    if (bb->head == bb->tail)
+        bb->head = instr;
+}
+
+/*
+ * Sequentialise the parallel copy (dests[i] = srcs[i], for all i at once) at the
+ * end of basic block 'bb'. A copy is emitted once no other pending copy reads its
+ * destination; if every pending copy is part of a cycle, one destination is saved
+ * to a new register first.
+ */
+static void parallel_copy(IrFunction *function, IrBasicBlock *bb, IrRegister **dests,
+                          IrRegister **srcs, int count)
+{
+    while (count)
+    {
+        int ready = -1;
+        for (int i = 0; i < count && ready < 0; i++)
+        {
+            ready = i;
+            for (int j = 0; j < count; j++)
+            {
+                if (srcs[j] == dests[i])
+                    ready = -1;
+            }
+        }
+
+        if (ready < 0)
+        {
+            IrRegister *saved = Ir_new_register(function);
+            emit_copy(function, bb, saved, dests[0]);
+            for (int j = 0; j < count; j++)
+            {
+                if (srcs[j] == dests[0])
+                    srcs[j] = saved;
+            }
+            continue;
+        }
+
+        emit_copy(function, bb, dests[ready], srcs[ready]);
+        count--;
+        dests[ready] = dests[count];
+        srcs[ready] = srcs[count];
+    }
+}
+
+/*
+ * Replace the phis in basic block 'bb' with copies in its predecessors.
+ */
+static void remove_phis(IrFunction *function, IrBasicBlock *bb)
+{
+    int count = 0;
+    for (IrInstruction *phi = first_phi(bb); phi; phi = next_phi(phi))
+        count++;
+    if (!count)
+        return;
+
+    IrRegister **dests = xmalloc(count * sizeof(IrRegister *));
+    IrRegister **srcs = xmalloc(count * sizeof(IrRegister *));
+    for (int p = 0; p < 2; p++)
+    {
+        IrBasicBlock *pred = bb->cfg_entry[p];
+        if (!pred)
+            continue;
+
+        int copies = 0;
+        for (IrInstruction *phi = first_phi(bb); phi; phi = next_phi(phi))
+        {
+            IrRegister *src = phi->control.jump_true == pred ? phi->left : phi->right;
+            if (src == phi->dest)
+                continue;
+            dests[copies] = phi->dest;
+            srcs[copies++] = src;
+        }
+        parallel_copy(function, pred, dests, srcs, copies);
+    }
+
+    for (IrInstruction *phi = first_phi(bb); phi;)
+    {
+        IrInstruction *next = next_phi(phi);
+        Ir_remove_instr(bb, phi);
+        phi = next;
+    }
+    xfree(dests);
+    xfree(srcs);
+}
+
+static void destruct(IrFunction *function)
+{
+    split_critical_edges(function);
+    for (IrBasicBlock *bb = function->head; bb; bb = bb->next)
+        remove_phis(function, bb);
+    Ir_compact(function);
+}
+
+void Ssa_construct(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        construct(function);
+    }
+}
+
+void Ssa_destruct(IrFunction *program)
+{
+    for (IrFunction *function = program; function; function = function->next)
+    {
+        destruct(function);
+    }
+}
@@ -1,23 +1,80 @@
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 
 #include "ctype.h"
 #include "symbol.h"
+#include "util.h"
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 8
+#define SYMBOL_TABLE_INITIAL_SHIFT (32 - 3)
 
 /*
  * Symbol Table struct. This includes:
  * - set of Symbol's defined within this scope
  * - pointer to the parent scope/symbol table.
+ *
+ * Symbols are stored in an open-addressing (linear probing) hash table, keyed on
+ * the interned name. The capacity is a power of two, and the table is grown when
+ * it becomes three-quarters full.
  */
 struct SymbolTable_t
 {
     struct SymbolTable_t *parent;
 
-    // List of symbols within this symbol table.
-    struct Symbol_t *symbols_list;
+    // Hash table of symbols within this symbol table (empty slots are NULL).
+    struct Symbol_t **symbols;
+    int symbols_capacity;
     int symbols_count;
+
+    // 32 - log2(symbols_capacity): the hash is the top bits of a 32-bit product.
+    int symbols_shift;
 };
 
+/*
+ * Symbol names are interned, so the hash is computed from the name's address
+ * (Fibonacci hashing), rather than its characters. Interned strings are packed
+ * with no alignment, so every address bit is kept, and the slot is taken from
+ * the high bits of the product (the low bits only depend on the low bits of the
+ * address).
+ */
+static uint32_t hash_name(const char *name, int shift)
+{
+    uint64_t addr = (uintptr_t)name;
+    return ((uint32_t)(addr ^ addr >> 32) * 2654435761u) >> shift;
+}
+
+/*
+ * Find the slot for 'name': either the slot holding it, or the empty slot where it
+ * should be inserted.
+ */
+static Symbol **find_slot(Symbol **symbols, int capacity, int shift, const char *name)
+{
+    for (uint32_t i = hash_name(name, shift);; i = (i + 1) & (capacity - 1))
+    {
+        if (symbols[i] == NULL || symbols[i]->name == name)
+            return &symbols[i];
+    }
+}
+
+static void grow_table(SymbolTable *tab)
+{
+    int capacity = tab->symbols_capacity * 2;
+    int shift = tab->symbols_shift - 1;
+    Symbol **symbols = xcalloc(capacity, sizeof(Symbol *));
+
+    for (int i = 0; i < tab->symbols_capacity; i++)
+    {
+        Symbol *sym = tab->symbols[i];
+        if (sym)
+            *find_slot(symbols, capacity, shift, sym->name) = sym;
+    }
+
+    xfree(tab->symbols);
+    tab->symbols = symbols;
+    tab->symbols_capacity = capacity;
+    tab->symbols_shift = shift;
+}
+
 /*
  * Create a new symbol table.
  *
@@ -25,46 +82,56 @@ struct SymbolTable_t
  */
 SymbolTable *symbol_table_create(SymbolTable *parent)
 {
-    SymbolTable *table = calloc(1, sizeof(SymbolTable));
+    SymbolTable *table = xcalloc(1, sizeof(SymbolTable));
     table->parent = parent;
-    table->symbols_list = NULL;
+    table->symbols = xcalloc(SYMBOL_TABLE_INITIAL_CAPACITY, sizeof(Symbol *));
+    table->symbols_capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
+    table->symbols_shift = SYMBOL_TABLE_INITIAL_SHIFT;
     table->symbols_count = 0;
     return table;
 }
 
 /*
  * Define a entry in a symbol table.
+ *
+ * If 'name' is already defined in this scope, the earlier entry is kept in the
+ * table (and is still returned by symbol_table_get).
  */
-Symbol *symbol_table_put(SymbolTable *tab, char *name, CType *type)
+Symbol *symbol_table_put(SymbolTable *tab, const char *name, CType *type)
 {
-    Symbol **ptr = &tab->symbols_list;
-    for (; *ptr != NULL; ptr = &(**ptr).next)
-        ;
+    if ((tab->symbols_count + 1) * 4 > tab->symbols_capacity * 3)
+        grow_table(tab);
 
-    *ptr = calloc(1, sizeof(Symbol));
-    (*ptr)->name = name;
-    (*ptr)->type = type;
+    Symbol *sym = xcalloc(1, sizeof(Symbol));
+    sym->name = name;
+    sym->type = type;
 
-    return *ptr;
+    Symbol **slot = find_slot(tab->symbols, tab->symbols_capacity, tab->symbols_shift, name);
+    if (*slot == NULL)
+    {
+        *slot = sym;
+        tab->symbols_count++;
+    }
+    return sym;
 }
 
 /*
  * Retrieve a symbol table entry within this scope.
  *
+ * Names are interned, so they are compared by pointer.
  * 'search_parent' instructs this function to recursively
  * search ancestors' symbol tables also.
  */
-Symbol *symbol_table_get(SymbolTable *tab, char *name, bool search_parent)
+Symbol *symbol_table_get(SymbolTable *tab, const char *name, bool search_parent)
 {
-    for (Symbol *sym = tab->symbols_list; sym != NULL; sym = sym->next)
+    for (; tab != NULL; tab = tab->parent)
     {
-        if (strcmp(name, sym->name) == 0)
-        {
+        Symbol *sym = *find_slot(tab->symbols, tab->symbols_capacity, tab->symbols_shift, name);
+        if (sym)
             return sym;
-        }
-    }
-    if (search_parent == false || tab->parent == NULL)
-        return NULL;
 
-    return symbol_table_get(tab->parent, name, true);
-}
\ No newline at end of file
+        if (search_parent == false)
+            break;
+    }
+    return NULL;
+}
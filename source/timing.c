@@ -0,0 +1,213 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+#define MAX_TIMERS 64
+#define MAX_DEPTH 16
+
+typedef struct Timer
+{
+    const char *name;
+    int parent;
+
+    // Accumulated totals.
+    double wall, cpu;
+    long allocations;
+    long peak_bytes;
+
+    // Values when the timer was (most recently) started.
+    double start_wall, start_cpu;
+    long start_allocations;
+    long saved_peak_bytes;
+} Timer;
+
+static struct
+{
+    bool enabled;
+
+    Timer timers[MAX_TIMERS];
+    int count;
+
+    // Stack of running timers (indices into 'timers').
+    int stack[MAX_DEPTH];
+    int depth;
+} timing;
+
+/*
+ * Memory statistics.
+ *
+ * Every heap block the compiler allocates and frees is reported (by xmalloc() and
+ * friends in util.c, and by the AST arena for its aligned chunks), which counts
+ * allocations and tracks the number of bytes in use (and the high-water mark since
+ * the innermost running timer was started).
+ */
+static struct
+{
+    long allocations;
+    long bytes;
+    long peak_bytes;
+} heap;
+
+/*
+ * Record a heap block of 'bytes' allocated.
+ */
+void Timing_allocated(size_t bytes)
+{
+    heap.allocations++;
+    heap.bytes += bytes;
+    if (heap.bytes > heap.peak_bytes)
+        heap.peak_bytes = heap.bytes;
+}
+
+/*
+ * Record a heap block of 'bytes' freed.
+ */
+void Timing_freed(size_t bytes)
+{
+    heap.bytes -= bytes;
+}
+
+static double clock_seconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Enable timers.
+ */
+void Timing_enable(void)
+{
+    timing.enabled = true;
+}
+
+/*
+ * Start a timer, nested within the currently running timer (if any).
+ */
+void Timing_start(const char *name)
+{
+    if (!timing.enabled || timing.depth == MAX_DEPTH)
+        return;
+
+    int parent = timing.depth ? timing.stack[timing.depth - 1] : -1;
+
+    // Find the existing timer, or create a new one.
+    int index = 0;
+    for (; index < timing.count; index++)
+    {
+        Timer *timer = &timing.timers[index];
+        if (timer->parent == parent && strcmp(timer->name, name) == 0)
+            break;
+    }
+    if (index == timing.count)
+    {
+        if (timing.count == MAX_TIMERS)
+            return;
+        timing.timers[timing.count++] = (Timer){.name = name, .parent = parent};
+    }
+
+    Timer *timer = &timing.timers[index];
+    timer->start_wall = clock_seconds(CLOCK_MONOTONIC);
+    timer->start_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    timer->start_allocations = heap.allocations;
+
+    // Track the high-water mark from here, restored to the outer value on stop.
+    timer->saved_peak_bytes = heap.peak_bytes;
+    heap.peak_bytes = heap.bytes;
+
+    timing.stack[timing.depth++] = index;
+}
+
+/*
+ * Stop the most recently started timer.
+ */
+void Timing_stop(void)
+{
+    if (!timing.enabled || timing.depth == 0)
+        return;
+
+    Timer *timer = &timing.timers[timing.stack[--timing.depth]];
+    timer->wall += clock_seconds(CLOCK_MONOTONIC) - timer->start_wall;
+    timer->cpu += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - timer->start_cpu;
+    timer->allocations += heap.allocations - timer->start_allocations;
+
+    if (heap.peak_bytes > timer->peak_bytes)
+        timer->peak_bytes = heap.peak_bytes;
+    if (timer->saved_peak_bytes > heap.peak_bytes)
+        heap.peak_bytes = timer->saved_peak_bytes;
+}
+
+static void report_table(FILE *fd, int parent, int depth)
+{
+    for (int i = 0; i < timing.count; i++)
+    {
+        Timer *timer = &timing.timers[i];
+        if (timer->parent != parent)
+            continue;
+
+        fprintf(fd, "%*s%-*s %10.3f %10.3f %10ld %12.1f\n", depth * 2, "", 24 - depth * 2,
+                timer->name, timer->wall * 1e3, timer->cpu * 1e3, timer->allocations,
+                timer->peak_bytes / 1024.0);
+        report_table(fd, i, depth + 1);
+    }
+}
+
+static void report_json(FILE *fd, int parent, int depth)
+{
+    int indent = depth * 4 + 4;
+    _Bool first = true;
+
+    for (int i = 0; i < timing.count; i++)
+    {
+        Timer *timer = &timing.timers[i];
+        if (timer->parent != parent)
+            continue;
+
+        fprintf(fd, "%s\n%*s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                    "\"allocations\": %ld, \"peak_bytes\": %ld, \"timers\": [",
+                first ? "" : ",", indent, "", timer->name, timer->wall * 1e3,
+                timer->cpu * 1e3, timer->allocations, timer->peak_bytes);
+        report_json(fd, i, depth + 1);
+        fprintf(fd, "]}");
+        first = false;
+    }
+}
+
+/*
+ * Print a report of all timers, as a table or as JSON.
+ */
+void Timing_report(FILE *fd, bool json)
+{
+    if (json)
+    {
+        fprintf(fd, "{\n  \"phases\": [");
+        report_json(fd, -1, 0);
+        fprintf(fd, "\n  ]\n}\n");
+        return;
+    }
+
+    double wall = 0, cpu = 0;
+    long allocations = 0, peak_bytes = 0;
+    for (int i = 0; i < timing.count; i++)
+    {
+        Timer *timer = &timing.timers[i];
+        if (timer->parent != -1)
+            continue;
+
+        wall += timer->wall;
+        cpu += timer->cpu;
+        allocations += timer->allocations;
+        if (timer->peak_bytes > peak_bytes)
+            peak_bytes = timer->peak_bytes;
+    }
+
+    fprintf(fd, "%-24s %10s %10s %10s %12s\n", "Phase", "Wall (ms)", "CPU (ms)", "Allocs",
+            "Peak (KB)");
+    report_table(fd, -1, 0);
+    fprintf(fd, "%-24s %10.3f %10.3f %10ld %12.1f\n", "total", wall * 1e3, cpu * 1e3,
+            allocations, peak_bytes / 1024.0);
+}
@@ -1,5 +1,51 @@
+#include <string.h>
+
 #include "token.h"
 
+/*
+ * Keywords are recognised with a perfect hash over the first and last characters,
+ * and the length, of the lexeme. Every keyword (AUTO..WHILE) has a unique slot in
+ * keyword_table; unused slots are NAT.
+ */
+#define KEYWORD_HASH(first, last, len) ((3 * (first) + 2 * (last) + 5 * (len)) & 31)
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 8
+
+static const TokenType keyword_table[32] = {
+    [KEYWORD_HASH('a', 'o', 4)] = AUTO,     [KEYWORD_HASH('c', 'r', 4)] = CHAR,
+    [KEYWORD_HASH('c', 't', 5)] = CONST,    [KEYWORD_HASH('e', 'e', 4)] = ELSE,
+    [KEYWORD_HASH('e', 'n', 6)] = EXTERN,   [KEYWORD_HASH('i', 'f', 2)] = IF,
+    [KEYWORD_HASH('i', 't', 3)] = INT,      [KEYWORD_HASH('l', 'g', 4)] = LONG,
+    [KEYWORD_HASH('r', 'r', 8)] = REGISTER, [KEYWORD_HASH('r', 'n', 6)] = RETURN,
+    [KEYWORD_HASH('s', 't', 5)] = SHORT,    [KEYWORD_HASH('s', 'd', 6)] = SIGNED,
+    [KEYWORD_HASH('s', 'f', 6)] = SIZEOF,   [KEYWORD_HASH('s', 'c', 6)] = STATIC,
+    [KEYWORD_HASH('u', 'd', 8)] = UNSIGNED, [KEYWORD_HASH('v', 'd', 4)] = VOID,
+    [KEYWORD_HASH('v', 'e', 8)] = VOLATILE, [KEYWORD_HASH('w', 'e', 5)] = WHILE,
+};
+
+/*
+ * Get the keyword token type for a lexeme (which need not be null-terminated).
+ * Returns IDENTIFIER if the lexeme is not a keyword.
+ */
+TokenType Token_keyword(const char *lexeme, int length)
+{
+    if (length < KEYWORD_MIN_LEN || length > KEYWORD_MAX_LEN)
+        return IDENTIFIER;
+
+    const unsigned char *l = (const unsigned char *)lexeme;
+    TokenType type = keyword_table[KEYWORD_HASH(l[0], l[length - 1], length)];
+    if (type == NAT)
+        return IDENTIFIER;
+
+    // Confirm the match against the keyword spelling. strncmp() stops at the end of
+    // a shorter keyword (the lexeme has no null), before reading past it.
+    const char *keyword = Token_str(type);
+    if (strncmp(lexeme, keyword, length) != 0 || keyword[length] != '\0')
+        return IDENTIFIER;
+
+    return type;
+}
+
 char *Token_str(TokenType type)
 {
     switch (type)
@@ -1,6 +1,80 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <util.h>
+#include "timing.h"
+
+/*
+ * Each heap block is preceded by its size, so it can be reported when freed.
+ * (The header is padded to keep the block aligned for any type.)
+ */
+typedef union
+{
+    size_t size;
+    max_align_t align;
+} BlockHeader;
+
+static void *block_start(BlockHeader *header, size_t size)
+{
+    if (!header)
+        return NULL;
+
+    header->size = size;
+    Timing_allocated(size);
+    return header + 1;
+}
+
+/*
+ * Allocate a block of 'size' bytes.
+ */
+void *xmalloc(size_t size)
+{
+    return block_start(malloc(sizeof(BlockHeader) + size), size);
+}
+
+/*
+ * Allocate a block of 'count' elements of 'size' bytes, set to zero.
+ */
+void *xcalloc(size_t count, size_t size)
+{
+    if (size && count > (SIZE_MAX - sizeof(BlockHeader)) / size)
+        return NULL;
+
+    return block_start(calloc(1, sizeof(BlockHeader) + count * size), count * size);
+}
+
+/*
+ * Resize a block (allocating one, if 'ptr' is NULL). It is recorded as a new
+ * allocation.
+ */
+void *xrealloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return xmalloc(size);
+
+    BlockHeader *header = (BlockHeader *)ptr - 1;
+    size_t old_size = header->size;
+
+    header = realloc(header, sizeof(BlockHeader) + size);
+    if (!header)
+        return NULL;
+
+    Timing_freed(old_size);
+    return block_start(header, size);
+}
+
+/*
+ * Free a block (nothing is done if 'ptr' is NULL).
+ */
+void xfree(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    BlockHeader *header = (BlockHeader *)ptr - 1;
+    Timing_freed(header->size);
+    free(header);
+}
 
 /*
  * Concatenate a sequence of null-terminated strings into a single string.
@@ -8,17 +82,17 @@
  *
  * The returned string is allocated from the heap.
  */
-char *str_concat(char **source_str)
+char *str_concat(const char **source_str)
 {
     // Find out how much space is needed for the total string.
     int len = 0;
-    for (char **str = source_str; *str != NULL; str++)
+    for (const char **str = source_str; *str != NULL; str++)
     {
         len += strlen(*str);
     }
 
-    char *new_str = calloc(len + 1, sizeof(char));
-    for (char **str = source_str; *str != NULL; str++)
+    char *new_str = xcalloc(len + 1, sizeof(char));
+    for (const char **str = source_str; *str != NULL; str++)
     {
         strcat(strchr(new_str, '\0'), *str);
     }
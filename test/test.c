@@ -12,11 +12,13 @@
 #include <cmocka.h>
 
 #include "error.h"
+#include "intern.h"
 #include "parser.h"
 #include "pretty_print.h"
 #include "scanner.h"
 #include "symbol.h"
 #include "token.h"
+#include "util.h"
 /*
  * Compare the expected textual AST representation for expr/decl/stmt
  * against 'expected'.
@@ -117,6 +119,14 @@ void Error_report_error(ErrorReporter *error_reporter, ErrorType error_type, Pos
     check_expected(msg);
 }
 
+/*
+ * Mock Error_limit_reached function (no limit).
+ */
+int Error_limit_reached(ErrorReporter *error_reporter)
+{
+    return 0;
+}
+
 /*
  * Helper function for declaring expected errors.
  */
@@ -159,17 +169,21 @@ Symbol *_char_ptr;
 void test_symbol_table_setup()
 {
     test_symbol_table = symbol_table_create(NULL);
-    _int = symbol_table_put(test_symbol_table, "_int", &_int_type);
-    _short_int = symbol_table_put(test_symbol_table, "_short_int", &_short_type);
-    _char = symbol_table_put(test_symbol_table, "_char", &_char_type);
-    _ptr = symbol_table_put(test_symbol_table, "_ptr", &_ptr_type);
-    _ptr_ptr = symbol_table_put(test_symbol_table, "_ptr_ptr", &_ptr_ptr_type);
-    _function = symbol_table_put(test_symbol_table, "_function", &_function_type);
-    _short_ptr = symbol_table_put(test_symbol_table, "_short_ptr", &_short_ptr_type);
-    _char_ptr = symbol_table_put(test_symbol_table, "_char_ptr", &_char_ptr_type);
+    _int = symbol_table_put(test_symbol_table, Intern_cstr("_int"), &_int_type);
+    _short_int =
+        symbol_table_put(test_symbol_table, Intern_cstr("_short_int"), &_short_type);
+    _char = symbol_table_put(test_symbol_table, Intern_cstr("_char"), &_char_type);
+    _ptr = symbol_table_put(test_symbol_table, Intern_cstr("_ptr"), &_ptr_type);
+    _ptr_ptr = symbol_table_put(test_symbol_table, Intern_cstr("_ptr_ptr"), &_ptr_ptr_type);
+    _function =
+        symbol_table_put(test_symbol_table, Intern_cstr("_function"), &_function_type);
+    _short_ptr =
+        symbol_table_put(test_symbol_table, Intern_cstr("_short_ptr"), &_short_ptr_type);
+    _char_ptr =
+        symbol_table_put(test_symbol_table, Intern_cstr("_char_ptr"), &_char_ptr_type);
 }
 
 void test_symbol_table_teardown()
 {
-    free(test_symbol_table);
+    xfree(test_symbol_table);
 }
\ No newline at end of file
@@ -0,0 +1,1172 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#include "ir.h"
+#include "optimise.h"
+#include "util.h"
+
+// Registers are heap-allocated, since unused registers are freed by the
+// optimisation passes.
+static IrRegister *new_reg(int index)
+{
+    IrRegister *reg = xcalloc(1, sizeof(IrRegister));
+    reg->type = REG_ANY;
+    reg->index = index;
+    return reg;
+}
+
+static void link_instructions(IrBasicBlock *bb, IrInstruction **instrs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        instrs[i]->prev = i ? instrs[i - 1] : NULL;
+        instrs[i]->next = i + 1 < count ? instrs[i + 1] : NULL;
+    }
+    bb->head = instrs[0];
+    bb->tail = instrs[count - 1];
+}
+
+static void copy_propagation_basic_block(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADI t0, 1
+    //  - MOV t1, t0
+    //  - ADD t2, t1, t1
+    //  - MOV r0, t2
+    //  - RETURN
+    // The copy (t1) should be replaced with t0, and the MOV removed.
+    IrRegister *t0 = new_reg(0), *t1 = new_reg(1), *t2 = new_reg(2);
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+    IrRegister *reg_list[] = {t0, t1, t2};
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction mov = {.op = IR_MOV, .dest = t1, .left = t0};
+    IrInstruction add = {.op = IR_ADD, .dest = t2, .left = t1, .right = t1};
+    IrInstruction ret_mov = {.op = IR_MOV, .dest = &r0, .left = t2};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadi, &mov, &add, &ret_mov, &ret}, 6);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_copy_propagation(&function);
+
+    assert_true(function.movs_removed == 1);
+
+    // t1 is no longer used, and t2 is renumbered.
+    assert_true(function.registers.count == 2);
+    assert_true(function.registers.list[0] == t0 && t0->index == 0);
+    assert_true(function.registers.list[1] == t2 && t2->index == 1);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_LOADI && instr->dest == t0);
+    instr = instr->next;
+    assert_true(instr->op == IR_ADD && instr->left == t0 && instr->right == t0);
+    instr = instr->next;
+    assert_true(instr->op == IR_MOV && instr->dest == &r0 && instr->left == t2);
+    instr = instr->next;
+    assert_true(instr->op == IR_RETURN && instr->next == NULL);
+    assert_true(bb.tail == instr);
+}
+
+static void copy_propagation_redefined(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADI t0, 1
+    //  - MOV t1, t0
+    //  - LOADI t0, 2
+    //  - ADD t2, t1, t0
+    //  - RETURN
+    // t0 is redefined after the copy, so t1 should not be replaced.
+    IrRegister *t0 = new_reg(0), *t1 = new_reg(1), *t2 = new_reg(2);
+    IrRegister *reg_list[] = {t0, t1, t2};
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction mov = {.op = IR_MOV, .dest = t1, .left = t0};
+    IrInstruction redefine = {.op = IR_LOADI, .dest = t0, .value = 2};
+    IrInstruction add = {.op = IR_ADD, .dest = t2, .left = t1, .right = t0};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadi, &mov, &redefine, &add, &ret}, 6);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_copy_propagation(&function);
+
+    assert_true(function.movs_removed == 0);
+    assert_true(function.registers.count == 3);
+
+    IrInstruction *instr = bb.head->next->next;
+    assert_true(instr->op == IR_MOV && instr->dest == t1 && instr->left == t0);
+    instr = instr->next->next;
+    assert_true(instr->op == IR_ADD && instr->left == t1 && instr->right == t0);
+}
+
+static void constant_folding_arithmetic(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADI t0, 6
+    //  - LOADI t1, 7
+    //  - MUL t2, t0, t1
+    //  - LOADI t3, 0
+    //  - ADD t4, t5, t3
+    //  - LT t6, t2, t0
+    //  - STORE32 t4, t6
+    //  - MOV r0, t2
+    //  - RETURN
+    // The MUL, LT and MOV should be folded, the ADD simplified to a MOV, and the
+    // constants no longer used (including the MUL result) removed.
+    IrRegister *t[7], *reg_list[7];
+    for (int i = 0; i < 7; i++)
+        t[i] = reg_list[i] = new_reg(i);
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadi6 = {.op = IR_LOADI, .dest = t[0], .value = 6};
+    IrInstruction loadi7 = {.op = IR_LOADI, .dest = t[1], .value = 7};
+    IrInstruction mul = {.op = IR_MUL, .dest = t[2], .left = t[0], .right = t[1]};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t[3], .value = 0};
+    IrInstruction add = {.op = IR_ADD, .dest = t[4], .left = t[5], .right = t[3]};
+    IrInstruction lt = {.op = IR_LT, .dest = t[6], .left = t[2], .right = t[0]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[4], .right = t[6]};
+    IrInstruction ret_mov = {.op = IR_MOV, .dest = &r0, .left = t[2]};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadi6, &loadi7, &mul, &loadi0, &add,
+                                               &lt, &store, &ret_mov, &ret}, 10);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 7, .list_size = 7},
+    };
+
+    Optimise_constant_folding(&function);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_MOV && instr->dest == t[4] && instr->left == t[5]);
+    instr = instr->next;
+    assert_true(instr->op == IR_LOADI && instr->dest == t[6] && instr->value == 0);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE32);
+    instr = instr->next;
+    assert_true(instr->op == IR_LOADI && instr->dest == &r0 && instr->value == 42);
+    instr = instr->next;
+    assert_true(instr->op == IR_RETURN && instr->next == NULL);
+}
+
+static void constant_folding_branch(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 0
+    //   - BRANCHZ t0, BB 1, BB 2
+    //  BB 1:
+    //   - NOP
+    //  BB 2:
+    //   - NOP
+    // The branch is never taken, so should be replaced by a jump to BB 2.
+    IrRegister *t0 = new_reg(0);
+    IrRegister *reg_list[] = {t0};
+
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t0, .value = 0};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t0};
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi, &branch}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1}, 1);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2}, 1);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {.list = reg_list, .count = 1, .list_size = 1},
+    };
+
+    Optimise_constant_folding(&function);
+
+    // The constant is no longer used.
+    assert_true(function.registers.count == 0);
+
+    IrInstruction *instr = bb0.head->next;
+    assert_true(instr->op == IR_JUMP && instr->control.jump_true == &bb2);
+    assert_true(instr->next == NULL);
+    assert_true(bb1.cfg_entry[0] == NULL);
+    assert_true(bb2.cfg_entry[0] == &bb0);
+}
+
+static void constant_folding_immediate(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADI t0, 5
+    //  - ADD t2, t0, t1
+    //  - SUB t3, t2, t0
+    //  - STORE32 t2, t3
+    // The constant operands should be replaced with immediate values (swapping
+    // the operands of the ADD), and the LOADI removed.
+    IrRegister *t[4], *reg_list[4];
+    for (int i = 0; i < 4; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t[0], .value = 5};
+    IrInstruction add = {.op = IR_ADD, .dest = t[2], .left = t[0], .right = t[1]};
+    IrInstruction sub = {.op = IR_SUB, .dest = t[3], .left = t[2], .right = t[0]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[2], .right = t[3]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadi, &add, &sub, &store}, 5);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 4, .list_size = 4},
+    };
+
+    Optimise_constant_folding(&function);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_ADD && instr->left == t[1] && instr->right == NULL);
+    assert_true(instr->immediate && instr->value == 5);
+    instr = instr->next;
+    assert_true(instr->op == IR_SUB && instr->left == t[2] && instr->right == NULL);
+    assert_true(instr->immediate && instr->value == 5);
+    assert_true(instr->next->op == IR_STORE32);
+    assert_true(function.registers.count == 3);
+}
+
+static void constant_folding_strength_reduction(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADI t0, 8
+    //  - MUL t2, t1, t0
+    //  - STORE32 t1, t2
+    // The multiply by a power of two should be replaced with a shift.
+    IrRegister *t[3], *reg_list[3];
+    for (int i = 0; i < 3; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t[0], .value = 8};
+    IrInstruction mul = {.op = IR_MUL, .dest = t[2], .left = t[1], .right = t[0]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[1], .right = t[2]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadi, &mul, &store}, 4);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_constant_folding(&function);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_SLL && instr->left == t[1] && instr->right == NULL);
+    assert_true(instr->immediate && instr->value == 3);
+    assert_true(instr->next->op == IR_STORE32);
+}
+
+static void dead_code(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 4
+    //   - LOADI t1, 8
+    //   - ADD t2, t0, t0
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - STORE32 [t0], t0
+    //   - RETURN
+    //   - JUMP BB 2
+    //  BB 2:
+    //   - NOP
+    //   - STORE32 [t1], t1
+    //   - RETURN
+    // The JUMP after the RETURN should be removed, leaving BB 2 unreachable. t1
+    // (only read in BB 2) and t2 (never read) are then dead.
+    IrRegister *t0 = new_reg(0), *t1 = new_reg(1), *t2 = new_reg(2);
+    IrRegister *reg_list[] = {t0, t1, t2};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t0, .value = 4};
+    IrInstruction loadi1 = {.op = IR_LOADI, .dest = t1, .value = 8};
+    IrInstruction add = {.op = IR_ADD, .dest = t2, .left = t0, .right = t0};
+    IrInstruction jump0 = {.op = IR_JUMP};
+    IrInstruction store0 = {.op = IR_STORE32, .left = t0, .right = t0};
+    IrInstruction ret0 = {.op = IR_RETURN};
+    IrInstruction jump1 = {.op = IR_JUMP};
+    IrInstruction store1 = {.op = IR_STORE32, .left = t1, .right = t1};
+    IrInstruction ret1 = {.op = IR_RETURN};
+    // clang-format on
+
+    // Unreachable basic blocks are freed.
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1};
+    IrBasicBlock *bb2 = xcalloc(1, sizeof(IrBasicBlock));
+    bb2->index = 2;
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &loadi1, &add, &jump0}, 5);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &store0, &ret0, &jump1}, 4);
+    link_instructions(bb2, (IrInstruction *[]){&nop2, &store1, &ret1}, 3);
+    jump0.control.jump_true = &bb1;
+    jump1.control.jump_true = bb2;
+    bb0.next = &bb1;
+    bb1.next = bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2->cfg_entry[0] = &bb1;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = bb2,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_dead_code(&function);
+
+    assert_true(bb0.next == &bb1 && bb1.next == NULL && function.tail == &bb1);
+    assert_true(bb1.cfg_entry[0] == &bb0 && bb1.cfg_entry[1] == NULL);
+
+    assert_true(bb0.head->op == IR_NOP);
+    assert_true(bb0.head->next->op == IR_LOADI && bb0.head->next->dest == t0);
+    assert_true(bb0.head->next->next->op == IR_JUMP);
+    assert_true(bb1.head->next->op == IR_STORE32);
+    assert_true(bb1.tail->op == IR_RETURN && bb1.tail->prev == bb1.head->next);
+    assert_int_equal(function.registers.count, 1);
+}
+
+static void value_numbering(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 4
+    //   - LOADI t1, 4
+    //   - ADD t2, t0, t1
+    //   - ADD t3, t1, t0
+    //   - LOAD32 t4, t2
+    //   - LOAD32 t5, t3
+    //   - BRANCHZ t4, BB 1, BB 2
+    //  BB 1:
+    //   - NOP
+    //   - ADD t6, t0, t0
+    //   - STORE32 t6, t6
+    //   - LOAD32 t7, t2
+    //   - JUMP BB 2
+    //  BB 2:
+    //   - NOP
+    //   - LOAD32 t8, t2
+    //   - MOV r0, t8
+    //   - RETURN
+    // t1, t3 and t5 recompute values from BB 0, and t6 a value from BB 0 (which
+    // dominates BB 1). The load of t2 in BB 1 is the value just stored there, and
+    // the load in BB 2 may see the store.
+    IrRegister *t[9], *reg_list[9];
+    for (int i = 0; i < 9; i++)
+        t[i] = reg_list[i] = new_reg(i);
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t[0], .value = 4};
+    IrInstruction loadi1 = {.op = IR_LOADI, .dest = t[1], .value = 4};
+    IrInstruction add2 = {.op = IR_ADD, .dest = t[2], .left = t[0], .right = t[1]};
+    IrInstruction add3 = {.op = IR_ADD, .dest = t[3], .left = t[1], .right = t[0]};
+    IrInstruction load4 = {.op = IR_LOAD32, .dest = t[4], .left = t[2]};
+    IrInstruction load5 = {.op = IR_LOAD32, .dest = t[5], .left = t[3]};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t[4]};
+    IrInstruction add6 = {.op = IR_ADD, .dest = t[6], .left = t[0], .right = t[0]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[6], .right = t[6]};
+    IrInstruction load7 = {.op = IR_LOAD32, .dest = t[7], .left = t[2]};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction load8 = {.op = IR_LOAD32, .dest = t[8], .left = t[2]};
+    IrInstruction mov = {.op = IR_MOV, .dest = &r0, .left = t[8]};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &loadi1, &add2, &add3,
+                                                &load4, &load5, &branch}, 8);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &add6, &store, &load7, &jump}, 5);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &load8, &mov, &ret}, 4);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+    jump.control.jump_true = &bb2;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[1] = &bb1;
+    bb1.idom = bb2.idom = &bb0;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {.list = reg_list, .count = 9, .list_size = 9},
+    };
+
+    Optimise_value_numbering(&function);
+
+    assert_int_equal(function.redundant_removed, 5);
+    assert_int_equal(function.registers.count, 4);
+
+    IrInstruction *instr = bb0.head->next;
+    assert_true(instr->op == IR_LOADI && instr->dest == t[0]);
+    instr = instr->next;
+    assert_true(instr->op == IR_ADD && instr->left == t[0] && instr->right == t[0]);
+    instr = instr->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[4] && instr->left == t[2]);
+    assert_true(instr->next->op == IR_BRANCHZ && instr->next->left == t[4]);
+
+    instr = bb1.head->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == t[2] && instr->right == t[2]);
+    assert_true(instr->next->op == IR_JUMP);
+
+    instr = bb2.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[8]);
+}
+
+static void value_numbering_phi(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 1
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - PHI t1, t0 [BB 0], t2 [BB 2]
+    //   - BRANCHZ t1, BB 2, BB 3
+    //  BB 2:
+    //   - NOP
+    //   - MOV t2, t1
+    //   - JUMP BB 1
+    //  BB 3:
+    //   - NOP
+    //   - MOV r0, t1
+    //   - RETURN
+    // t2 is a copy of t1, so the phi only selects t0.
+    IrRegister *t0 = new_reg(0), *t1 = new_reg(1), *t2 = new_reg(2);
+    IrRegister *reg_list[] = {t0, t1, t2};
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction nop2 = {.op = IR_NOP}, nop3 = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction jump0 = {.op = IR_JUMP};
+    IrInstruction phi = {.op = IR_PHI, .dest = t1, .left = t0, .right = t2};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t1};
+    IrInstruction copy = {.op = IR_MOV, .dest = t2, .left = t1};
+    IrInstruction jump2 = {.op = IR_JUMP};
+    IrInstruction mov = {.op = IR_MOV, .dest = &r0, .left = t1};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2}, bb3 = {.index = 3};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi, &jump0}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &phi, &branch}, 3);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &copy, &jump2}, 3);
+    link_instructions(&bb3, (IrInstruction *[]){&nop3, &mov, &ret}, 3);
+    jump0.control.jump_true = &bb1;
+    phi.control.jump_true = &bb0;
+    phi.control.jump_false = &bb2;
+    branch.control.jump_true = &bb2;
+    branch.control.jump_false = &bb3;
+    jump2.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb2.next = &bb3;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb2;
+    bb2.cfg_entry[0] = &bb1;
+    bb3.cfg_entry[0] = &bb1;
+    bb1.idom = &bb0;
+    bb2.idom = bb3.idom = &bb1;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb3,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_value_numbering(&function);
+
+    assert_int_equal(function.movs_removed, 1);
+    assert_int_equal(function.redundant_removed, 1);
+    assert_int_equal(function.registers.count, 1);
+    assert_true(bb1.head->next->op == IR_BRANCHZ && bb1.head->next->left == t0);
+    assert_true(bb2.head->next->op == IR_JUMP);
+    assert_true(bb3.head->next->left == t0);
+}
+
+static void loop_invariant_code_motion(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 3
+    //   - BRANCHZ t0, BB 1, BB 3
+    //  BB 1:
+    //   - NOP
+    //   - PHI t1, t0 [BB 0], t3 [BB 2]
+    //   - BRANCHZ t1, BB 2, BB 3
+    //  BB 2:
+    //   - NOP
+    //   - MUL t2, t0, #7
+    //   - ADD t3, t1, t2
+    //   - DIV t4, t0, t0
+    //   - STORE32 t4, t3
+    //   - JUMP BB 1
+    //  BB 3:
+    //   - NOP
+    //   - RETURN
+    // BB 0 also branches to BB 3, so a preheader should be inserted before BB 1.
+    // t2 is invariant, so should be hoisted into it; t4 is invariant, but may
+    // divide by zero.
+    IrRegister *t[5], *reg_list[5];
+    for (int i = 0; i < 5; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction nop2 = {.op = IR_NOP}, nop3 = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t[0], .value = 3};
+    IrInstruction branch0 = {.op = IR_BRANCHZ, .left = t[0]};
+    IrInstruction phi = {.op = IR_PHI, .dest = t[1], .left = t[0], .right = t[3]};
+    IrInstruction branch1 = {.op = IR_BRANCHZ, .left = t[1]};
+    IrInstruction mul = {.op = IR_MUL, .dest = t[2], .left = t[0], .value = 7, .immediate = true};
+    IrInstruction add = {.op = IR_ADD, .dest = t[3], .left = t[1], .right = t[2]};
+    IrInstruction div = {.op = IR_DIV, .dest = t[4], .left = t[0], .right = t[0]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[4], .right = t[3]};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2}, bb3 = {.index = 3};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi, &branch0}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &phi, &branch1}, 3);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &mul, &add, &div, &store, &jump}, 6);
+    link_instructions(&bb3, (IrInstruction *[]){&nop3, &ret}, 2);
+    branch0.control.jump_true = &bb1;
+    branch0.control.jump_false = &bb3;
+    phi.control.jump_true = &bb0;
+    phi.control.jump_false = &bb2;
+    branch1.control.jump_true = &bb2;
+    branch1.control.jump_false = &bb3;
+    jump.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb2.next = &bb3;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb2;
+    bb2.cfg_entry[0] = &bb1;
+    bb3.cfg_entry[0] = &bb0;
+    bb3.cfg_entry[1] = &bb1;
+    bb1.idom = bb3.idom = &bb0;
+    bb2.idom = &bb1;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb3,
+        .registers = {.list = reg_list, .count = 5, .list_size = 5},
+    };
+
+    Optimise_loop_invariant_code_motion(&function);
+
+    assert_int_equal(function.invariants_hoisted, 1);
+
+    IrBasicBlock *preheader = bb0.next;
+    assert_true(preheader != &bb1 && preheader->next == &bb1);
+    assert_true(branch0.control.jump_true == preheader && phi.control.jump_true == preheader);
+    assert_true(bb1.cfg_entry[0] == preheader && preheader->cfg_entry[0] == &bb0);
+    assert_true(preheader->head->next == &mul && mul.next->op == IR_JUMP);
+
+    assert_true(bb2.head->next == &add && add.next == &div);
+    assert_int_equal(bb0.loop_depth, 0);
+    assert_int_equal(preheader->loop_depth, 0);
+    assert_int_equal(bb1.loop_depth, 1);
+    assert_int_equal(bb2.loop_depth, 1);
+    assert_int_equal(bb3.loop_depth, 0);
+    xfree(preheader);
+}
+
+static void induction_variables(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADSO t0, 0
+    //   - LOADI t1, 1
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - PHI t2, t1 [BB 0], t3 [BB 2]
+    //   - LT t4, t2, #5
+    //   - BRANCHZ t4, BB 2, BB 3
+    //  BB 2:
+    //   - NOP
+    //   - SUB t5, t2, #1
+    //   - SLL t6, t5, #2
+    //   - ADD t7, t0, t6
+    //   - LOAD32 t8, t7
+    //   - SLL t9, t2, #2
+    //   - ADD t10, t0, t9
+    //   - STORE32 t10, t8
+    //   - ADD t3, t2, #1
+    //   - JUMP BB 1
+    //  BB 3:
+    //   - NOP
+    //   - RETURN
+    // (a[i] = a[i - 1], for i = 1 to 4). The addresses should be replaced with a
+    // pointer p = PHI(sp + 4, p + 4), and the exit test with p == sp + 20.
+    IrRegister *t[11];
+    IrRegister **reg_list = xmalloc(11 * sizeof(IrRegister *));
+    for (int i = 0; i < 11; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction nop2 = {.op = IR_NOP}, nop3 = {.op = IR_NOP};
+    IrInstruction loadso = {.op = IR_LOADSO, .dest = t[0], .value = 0};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t[1], .value = 1};
+    IrInstruction jump0 = {.op = IR_JUMP};
+    IrInstruction phi = {.op = IR_PHI, .dest = t[2], .left = t[1], .right = t[3]};
+    IrInstruction lt = {.op = IR_LT, .dest = t[4], .left = t[2], .value = 5, .immediate = true};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t[4]};
+    IrInstruction sub = {.op = IR_SUB, .dest = t[5], .left = t[2], .value = 1, .immediate = true};
+    IrInstruction sll6 = {.op = IR_SLL, .dest = t[6], .left = t[5], .value = 2, .immediate = true};
+    IrInstruction add7 = {.op = IR_ADD, .dest = t[7], .left = t[0], .right = t[6]};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t[8], .left = t[7]};
+    IrInstruction sll9 = {.op = IR_SLL, .dest = t[9], .left = t[2], .value = 2, .immediate = true};
+    IrInstruction add10 = {.op = IR_ADD, .dest = t[10], .left = t[0], .right = t[9]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[10], .right = t[8]};
+    IrInstruction increment = {.op = IR_ADD, .dest = t[3], .left = t[2], .value = 1, .immediate = true};
+    IrInstruction jump2 = {.op = IR_JUMP};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2}, bb3 = {.index = 3};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadso, &loadi, &jump0}, 4);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &phi, &lt, &branch}, 4);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &sub, &sll6, &add7, &load, &sll9,
+                                                &add10, &store, &increment, &jump2}, 10);
+    link_instructions(&bb3, (IrInstruction *[]){&nop3, &ret}, 2);
+    jump0.control.jump_true = &bb1;
+    phi.control.jump_true = &bb0;
+    phi.control.jump_false = &bb2;
+    branch.control.jump_true = &bb2;
+    branch.control.jump_false = &bb3;
+    jump2.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb2.next = &bb3;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb2;
+    bb2.cfg_entry[0] = &bb1;
+    bb3.cfg_entry[0] = &bb1;
+    bb1.idom = &bb0;
+    bb2.idom = bb3.idom = &bb1;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb3,
+        .registers = {.list = reg_list, .count = 11, .list_size = 11},
+    };
+
+    Optimise_induction_variables(&function);
+
+    // p, its increment and initial value, the end value, and t4 and t8 remain.
+    assert_int_equal(function.registers.count, 6);
+
+    IrInstruction *instr = bb0.head->next;
+    assert_true(instr->op == IR_LOADSO && instr->value == 4);
+    IrRegister *start = instr->dest;
+    instr = instr->next;
+    assert_true(instr->op == IR_LOADSO && instr->value == 20);
+    IrRegister *end = instr->dest;
+    assert_true(instr->next->op == IR_JUMP);
+
+    IrInstruction *p = bb1.head->next;
+    assert_true(p->op == IR_PHI && p->left == start && p->control.jump_true == &bb0);
+    instr = p->next;
+    assert_true(instr->op == IR_EQ && instr->left == p->dest && instr->right == end);
+    assert_true(instr->next->op == IR_BRANCHZ);
+    assert_true(branch.control.jump_true == &bb3 && branch.control.jump_false == &bb2);
+
+    instr = bb2.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->left == p->dest);
+    assert_true(instr->immediate && instr->value == -4);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == p->dest && !instr->immediate);
+    instr = instr->next;
+    assert_true(instr->op == IR_ADD && instr->dest == p->right && instr->left == p->dest);
+    assert_true(instr->immediate && instr->value == 4);
+    assert_true(instr->next->op == IR_JUMP);
+    xfree(function.registers.list);
+}
+
+static void addressing_modes(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - SLL t2, t1, #2
+    //  - ADD t3, t0, t2
+    //  - LOAD32 t4, t3
+    //  - ADD t5, t0, #8
+    //  - STORE32 t5, t4
+    // The address calculations should be folded into the load and store.
+    IrRegister *t[6], *reg_list[6];
+    for (int i = 0; i < 6; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction sll = {.op = IR_SLL, .dest = t[2], .left = t[1], .value = 2, .immediate = true};
+    IrInstruction add = {.op = IR_ADD, .dest = t[3], .left = t[0], .right = t[2]};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t[4], .left = t[3]};
+    IrInstruction addi = {.op = IR_ADD, .dest = t[5], .left = t[0], .value = 8, .immediate = true};
+    IrInstruction store = {.op = IR_STORE32, .left = t[5], .right = t[4]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &sll, &add, &load, &addi, &store}, 6);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 6, .list_size = 6},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    // t2, t3 and t5 are no longer used.
+    assert_true(function.registers.count == 3);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[4] && instr->left == t[0]);
+    assert_true(instr->index == t[1] && instr->shift == 2 && !instr->immediate);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == t[0] && instr->right == t[4]);
+    assert_true(instr->index == NULL && instr->immediate && instr->value == 8);
+    assert_true(instr->next == NULL);
+}
+
+static void addressing_modes_shared(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - SLL t2, t1, #2
+    //  - ADD t3, t0, t2
+    //  - STORE32 t3, t1
+    //  - LOAD32 t4, t3
+    //  - STORE32 t0, t4
+    // The address is shared by the first store and the load, so should be folded
+    // into both, and then removed.
+    IrRegister *t[5], *reg_list[5];
+    for (int i = 0; i < 5; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction sll = {.op = IR_SLL, .dest = t[2], .left = t[1], .value = 2, .immediate = true};
+    IrInstruction add = {.op = IR_ADD, .dest = t[3], .left = t[0], .right = t[2]};
+    IrInstruction store1 = {.op = IR_STORE32, .left = t[3], .right = t[1]};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t[4], .left = t[3]};
+    IrInstruction store2 = {.op = IR_STORE32, .left = t[0], .right = t[4]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &sll, &add, &store1, &load, &store2},
+                      6);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 5, .list_size = 5},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    // t2 and t3 are no longer used.
+    assert_true(function.registers.count == 3);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == t[0] && instr->right == t[1]);
+    assert_true(instr->index == t[1] && instr->shift == 2);
+    instr = instr->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[4] && instr->left == t[0]);
+    assert_true(instr->index == t[1] && instr->shift == 2);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == t[0] && instr->index == NULL);
+    assert_true(instr->next == NULL);
+}
+
+static void addressing_modes_post_index(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOAD32 t1, t0
+    //  - ADD t2, t0, #4
+    //  - STORE32 t3, t1
+    //  - MOV t0, t2
+    // t0 is incremented after the load (E.g. a pointer induction variable), so
+    // should be post-indexed.
+    IrRegister *t[4], *reg_list[4];
+    for (int i = 0; i < 4; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t[1], .left = t[0]};
+    IrInstruction add = {.op = IR_ADD, .dest = t[2], .left = t[0], .value = 4, .immediate = true};
+    IrInstruction store = {.op = IR_STORE32, .left = t[3], .right = t[1]};
+    IrInstruction mov = {.op = IR_MOV, .dest = t[0], .left = t[2]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &load, &add, &store, &mov}, 5);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 4, .list_size = 4},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    // t2 is no longer used.
+    assert_true(function.registers.count == 3);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[1] && instr->left == t[0]);
+    assert_true(instr->post_index && instr->value == 4 && !instr->immediate);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == t[3] && !instr->post_index);
+    assert_true(instr->next == NULL);
+}
+
+static void addressing_modes_redefined(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - ADD t2, t0, t1
+    //  - LOADI t0, 4
+    //  - LOAD8 t3, t2
+    //  - STORE8 t0, t3
+    // t0 is redefined before the load, so the ADD should not be folded.
+    IrRegister *t[4], *reg_list[4];
+    for (int i = 0; i < 4; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction add = {.op = IR_ADD, .dest = t[2], .left = t[0], .right = t[1]};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t[0], .value = 4};
+    IrInstruction load = {.op = IR_LOAD8, .dest = t[3], .left = t[2]};
+    IrInstruction store = {.op = IR_STORE8, .left = t[0], .right = t[3]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &add, &loadi, &load, &store}, 5);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 4, .list_size = 4},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    assert_true(function.registers.count == 4);
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_ADD && instr->dest == t[2]);
+    instr = instr->next->next;
+    assert_true(instr->op == IR_LOAD8 && instr->left == t[2]);
+    assert_true(instr->index == NULL && !instr->immediate);
+}
+
+static void addressing_modes_stack(void **state)
+{
+    // Code input:
+    //  - NOP
+    //  - LOADSO t0, 8
+    //  - ADD t1, t0, #4
+    //  - LOAD32 t2, t1
+    //  - LOADSO t3, 0
+    //  - STORE16 t3, t2
+    // Both stack addresses should be folded into sp-relative addresses.
+    IrRegister *t[4], *reg_list[4];
+    for (int i = 0; i < 4; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction loadso8 = {.op = IR_LOADSO, .dest = t[0], .value = 8};
+    IrInstruction add = {.op = IR_ADD, .dest = t[1], .left = t[0], .value = 4, .immediate = true};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t[2], .left = t[1]};
+    IrInstruction loadso0 = {.op = IR_LOADSO, .dest = t[3], .value = 0};
+    IrInstruction store = {.op = IR_STORE16, .left = t[3], .right = t[2]};
+    // clang-format on
+
+    IrBasicBlock bb = {0};
+    link_instructions(&bb, (IrInstruction *[]){&nop, &loadso8, &add, &load, &loadso0, &store}, 6);
+    IrFunction function = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {.list = reg_list, .count = 4, .list_size = 4},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    assert_true(function.registers.count == 1);
+
+    IrInstruction *instr = bb.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->dest == t[2] && instr->left == NULL);
+    assert_true(instr->immediate && instr->value == 12);
+    instr = instr->next;
+    assert_true(instr->op == IR_STORE16 && instr->left == NULL && instr->right == t[2]);
+    assert_true(instr->immediate && instr->value == 0);
+    assert_true(instr->next == NULL);
+}
+
+static void addressing_modes_stack_shared(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADSO t0, 8
+    //   - LOAD32 t1, t0
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - STORE32 t0, t1
+    //   - RETURN
+    // The stack address (shared after value numbering) should be folded into both
+    // the load and the store, and then removed.
+    IrRegister *t0 = new_reg(0), *t1 = new_reg(1);
+    IrRegister *reg_list[] = {t0, t1};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction loadso = {.op = IR_LOADSO, .dest = t0, .value = 8};
+    IrInstruction load = {.op = IR_LOAD32, .dest = t1, .left = t0};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction store = {.op = IR_STORE32, .left = t0, .right = t1};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadso, &load, &jump}, 4);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &store, &ret}, 3);
+    jump.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb1,
+        .registers = {.list = reg_list, .count = 2, .list_size = 2},
+    };
+
+    Optimise_addressing_modes(&function);
+
+    assert_true(function.registers.count == 1);
+    IrInstruction *instr = bb0.head->next;
+    assert_true(instr->op == IR_LOAD32 && instr->left == NULL);
+    assert_true(instr->immediate && instr->value == 8);
+    assert_true(instr->next->op == IR_JUMP);
+    instr = bb1.head->next;
+    assert_true(instr->op == IR_STORE32 && instr->left == NULL && instr->right == t1);
+    assert_true(instr->immediate && instr->value == 8);
+}
+
+static void branch_fusion(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LE t1, t0, #10
+    //   - NOT t2, t1
+    //   - BRANCHZ t2, BB 1, BB 2
+    // The comparison should be fused into the branch, and the NOT removed by
+    // swapping the branch targets.
+    IrRegister *t[3], *reg_list[3];
+    for (int i = 0; i < 3; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction le = {.op = IR_LE, .dest = t[1], .left = t[0], .value = 10, .immediate = true};
+    IrInstruction not = {.op = IR_NOT, .dest = t[2], .left = t[1]};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t[2]};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop, &le, &not, &branch}, 4);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb0,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_branch_fusion(&function);
+
+    assert_true(function.registers.count == 1);
+
+    IrInstruction *instr = bb0.head->next;
+    assert_true(instr->op == IR_BRANCH_LE && instr->left == t[0] && instr->right == NULL);
+    assert_true(instr->immediate && instr->value == 10);
+    assert_true(instr->control.jump_true == &bb2 && instr->control.jump_false == &bb1);
+    assert_true(instr->next == NULL);
+}
+
+static void branch_fusion_used(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LT t2, t0, t1
+    //   - STORE32 t0, t2
+    //   - BRANCHZ t2, BB 1, BB 2
+    // The comparison result is also stored, so should not be fused.
+    IrRegister *t[3], *reg_list[3];
+    for (int i = 0; i < 3; i++)
+        t[i] = reg_list[i] = new_reg(i);
+
+    // clang-format off
+    IrInstruction nop = {.op = IR_NOP};
+    IrInstruction lt = {.op = IR_LT, .dest = t[2], .left = t[0], .right = t[1]};
+    IrInstruction store = {.op = IR_STORE32, .left = t[0], .right = t[2]};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t[2]};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop, &lt, &store, &branch}, 4);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb0,
+        .registers = {.list = reg_list, .count = 3, .list_size = 3},
+    };
+
+    Optimise_branch_fusion(&function);
+
+    assert_true(function.registers.count == 3);
+    IrInstruction *instr = bb0.tail;
+    assert_true(instr->op == IR_BRANCHZ && instr->left == t[2]);
+    assert_true(instr->control.jump_true == &bb1 && instr->control.jump_false == &bb2);
+    assert_true(instr->prev->prev->op == IR_LT);
+}
+
+static void block_layout(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - BRANCHZ t0, BB 2, BB 1
+    //  BB 1:
+    //   - NOP
+    //   - RETURN
+    //  BB 2:
+    //   - NOP
+    //   - JUMP BB 0
+    // BB 2 should be placed after BB 0 (falling through from the branch), with
+    // the function exit (BB 1) last.
+    IrRegister *t0 = new_reg(0);
+    IrRegister *reg_list[] = {t0};
+
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t0};
+    IrInstruction ret = {.op = IR_RETURN};
+    IrInstruction jump = {.op = IR_JUMP};
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &branch}, 2);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &ret}, 2);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &jump}, 2);
+    branch.control.jump_true = &bb2;
+    branch.control.jump_false = &bb1;
+    jump.control.jump_true = &bb0;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+
+    IrFunction function = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {.list = reg_list, .count = 1, .list_size = 1},
+    };
+
+    Optimise_block_layout(&function);
+
+    assert_true(function.head == &bb0);
+    assert_true(bb0.next == &bb2);
+    assert_true(bb2.next == &bb1);
+    assert_true(bb1.next == NULL && function.tail == &bb1);
+    assert_true(bb0.tail->op == IR_BRANCHZ && bb2.tail->op == IR_JUMP);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(copy_propagation_basic_block),
+        cmocka_unit_test(copy_propagation_redefined),
+        cmocka_unit_test(constant_folding_arithmetic),
+        cmocka_unit_test(constant_folding_branch),
+        cmocka_unit_test(constant_folding_immediate),
+        cmocka_unit_test(constant_folding_strength_reduction),
+        cmocka_unit_test(dead_code),
+        cmocka_unit_test(value_numbering),
+        cmocka_unit_test(value_numbering_phi),
+        cmocka_unit_test(loop_invariant_code_motion),
+        cmocka_unit_test(induction_variables),
+        cmocka_unit_test(addressing_modes),
+        cmocka_unit_test(addressing_modes_shared),
+        cmocka_unit_test(addressing_modes_post_index),
+        cmocka_unit_test(addressing_modes_redefined),
+        cmocka_unit_test(addressing_modes_stack),
+        cmocka_unit_test(addressing_modes_stack_shared),
+        cmocka_unit_test(branch_fusion),
+        cmocka_unit_test(branch_fusion_used),
+        cmocka_unit_test(block_layout),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -10,326 +10,771 @@
 #include "regalloc.h"
 #include "liveness.h"
 
-static void regalloc_no_spill()
+// Link an array of instructions into a basic block.
+static void link_block(IrBasicBlock * bb, IrInstruction * instrs, int count)
 {
-    // Test the Linear scan register allocation, with no regist;
-    IrRegister regA = {
-        .type = REG_ANY,
-        .liveness = {0, 8}
-    };
-    IrRegister regB = {
-        .type = REG_ANY,
-        .liveness = {1, 4}
-    };
-    IrRegister regC = {
-        .type = REG_ANY,
-        .liveness = {5, 10}
-    };
+    for(int i = 0;i < count;i++)
+    {
+        instrs[i].prev = i ? &instrs[i - 1] : NULL;
+        instrs[i].next = i < count - 1 ? &instrs[i + 1] : NULL;
+    }
+    bb->head = &instrs[0];
+    bb->tail = &instrs[count - 1];
+}
+
+static void compare_reg(IrRegister * regA, IrRegister * regB)
+{
+    if(regA == NULL)
+    {
+        assert_true(regB == NULL);
+    }
+    else {
+        assert_true(regB);
+        assert_true(regA->index == regB->index);
+    }
+}
+
+// Compare the instructions following a basic block's (NOP) head with the expected code.
+static void compare_code(IrBasicBlock * bb, IrInstruction * expected, int count)
+{
+    IrInstruction * cut = bb->head->next;
+    for(int i = 0;i < count;i++)
+    {
+        assert_true(cut != NULL);
+        assert_true(cut->op == expected[i].op);
+
+        assert_true(cut->value == expected[i].value);
+        assert_true(cut->immediate == expected[i].immediate);
 
-    // Registers are out-of-order. regalloc() should sort these.
-    IrRegister * reg_list[] = {&regC, &regB, &regA};
+        compare_reg(cut->dest, expected[i].dest);
+        compare_reg(cut->left, expected[i].left);
+        compare_reg(cut->right, expected[i].right);
 
-    IrFunction function = {
+        cut = cut->next;
+    }
+    assert_true(cut == NULL);
+}
+
+static void regalloc_no_spill()
+{
+    // Code input:
+    //  0 - NOP
+    //  1 - LOAD32 regA, [sp + 0]
+    //  2 - LOAD32 regB, [sp + 4]
+    //  3 - ADD regC, regA, regB
+    //  4 - STORE32 [sp + 8], regC
+    // regA and regB are live at once, so are given different registers. regC can
+    // reuse the register of either (both die at the ADD).
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrRegister regC = {.type = REG_ANY, .index = 2, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_ADD, .dest = &regC, .left = &regA, .right = &regB},
+        {.op = IR_STORE32, .right = &regC, .value = 8, .immediate = true}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 5);
+
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
         .registers = {
             .count = 3,
-            .list = reg_list
-        }
+            .list = (IrRegister*[]){&regA, &regB, &regC}
+        },
+        .stack_size = 12
     };
-    regalloc(&function, (int[]){4,5,6,7,8,9,-1});
-    assert_true(reg_list[2] == &regC);
-
-    // Check the register allocations.
-    assert_true(regA.type == REG_ANY && regA.index == 9);
-    assert_true(regB.type == REG_ANY && regB.index == 8);
-    assert_true(regC.type == REG_ANY && regC.index == 8);
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,8,9,-1});
+
+    // Allocated registers are substituted, with no spill code.
+    IrRegister r7 = {.index = 7}, r8 = {.index = 8};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r8, .value = 4, .immediate = true},
+        {.op = IR_ADD, .dest = &r7, .left = &r7, .right = &r8},
+        {.op = IR_STORE32, .right = &r7, .value = 8, .immediate = true}
+    }, 4);
+    assert_true(func.stack_size == 12);
 }
 
 static void regalloc_no_fixup()
 {
-    // Test the Linear Scan register allocation only.
-    // This test does not verify the 'fixup' stage - where spill
-    // code is inserted into the IR code.
-    //
-    // This test should include register spills where:
-    //  - a register needs to be removed from the active set
-    //  - a register should never be allocated to begin with.
-
-    // Linear scan:
-    // 1. Allocate reg A to register.
-    // 2. Allocate register B to register.
-    // 3. Spill register B, allocate register C (regB.finish < regC.finish)
-    // 4. Spill register D (regD.finish < regC.finish)
-    IrRegister regA = {
-        .type = REG_ANY,
-        .liveness = {
-            .start = 0,
-            .finish = 10
+    // Code input:
+    //  0 - NOP
+    //  1 - LOAD32 regA, [sp + 0]
+    //  2 - LOAD32 regB, [sp + 4]
+    //  3 - LOAD32 regC, [sp + 8]
+    //  4 - LOAD32 regD, [sp + 12]
+    //  5 - ADD regE, regB, regD
+    //  6 - STORE32 [sp + 16], regE
+    //  7 - STORE32 [sp + 20], regC
+    //  8 - STORE32 [sp + 24], regA
+    // Only the choice of registers is checked here (the spill code is checked by
+    // regalloc_fixup_store and regalloc_fixup_load). With three free registers, regD
+    // needs the register of regA, regB or regC: regA is used furthest ahead (and
+    // least densely), so is stored to a new slot and reloaded at its use.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrRegister regC = {.type = REG_ANY, .index = 2, .liveness = {-1, 0}};
+    IrRegister regD = {.type = REG_ANY, .index = 3, .liveness = {-1, 0}};
+    IrRegister regE = {.type = REG_ANY, .index = 4, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regC, .value = 8, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regD, .value = 12, .immediate = true},
+        {.op = IR_ADD, .dest = &regE, .left = &regB, .right = &regD},
+        {.op = IR_STORE32, .right = &regE, .value = 16, .immediate = true},
+        {.op = IR_STORE32, .right = &regC, .value = 20, .immediate = true},
+        {.op = IR_STORE32, .right = &regA, .value = 24, .immediate = true}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 9);
+
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {
+            .count = 5,
+            .list = (IrRegister*[]){&regA, &regB, &regC, &regD, &regE}
         },
-    };
-    IrRegister regB = {
-        .type = REG_ANY,
-        .liveness = {
-            .start = 1,
-            .finish = 5
-        }
-    };
-    IrRegister regC = {
-        .type = REG_ANY,
-        .liveness = {
-            .start = 2,
-            .finish = 7
-        }
-    };
-    IrRegister regD = {
-        .type = REG_ANY,
-        .liveness = {
-            .start = 3,
-            .finish = 5
-        }
-    };
+        .stack_size = 28
+    };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,8,9,-1});
+
+    IrRegister r7 = {.index = 7}, r8 = {.index = 8}, r9 = {.index = 9};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r8, .value = 4, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r9, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 28, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 12, .immediate = true},
+        {.op = IR_ADD, .dest = &r7, .left = &r8, .right = &r7},
+        {.op = IR_STORE32, .right = &r7, .value = 16, .immediate = true},
+        {.op = IR_STORE32, .right = &r9, .value = 20, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 28, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 24, .immediate = true}
+    }, 10);
+    assert_true(func.stack_size == 32);
+}
 
-    IrRegister * reg_list[] = {&regD, &regC, &regB, &regA};
+static void regalloc_fixup_store()
+{
+    // Code input:
+    //  0 - NOP
+    //  1 - LOAD32 regA, [sp + 4]
+    //  2 - STORE32 [sp + 8], regA
+    // With no free registers (only spill registers), regA is stored to a new stack
+    // slot after its definition, and loaded at its use.
+    // (A constant would be rematerialised, rather than stored.)
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &regA, .value = 8, .immediate = true}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 3);
 
-    // Registers are out-of-order, regalloc() should sort thes;
-    IrFunction function = {
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
         .registers = {
-            .count = 4,
-            .list = reg_list
+            .count = 1,
+            .list = (IrRegister*[]){&regA}
         },
-        .stack_size = 0
+        .stack_size = 12
     };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,-1});
 
-    regalloc(&function, (int[]){4,5,6,7,8,9,-1});
-    assert_true(regA.type = REG_ANY && regA.index == 9);
-    assert_true(regC.type = REG_ANY && regC.index == 8);
-    assert_true(regB.type == REG_SPILL && regB.spill == 0);
-    assert_true(regD.type == REG_SPILL && regD.spill == 4);
+    // Transformed code:
+    // - LOAD32 reg4, [sp + 4]
+    // - STORE32 [sp + 12], reg4
+    // - LOAD32 reg6, [sp + 12]
+    // - STORE32 [sp + 8], reg6
+    IrRegister r4 = {.index = 4}, r6 = {.index = 6};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r4, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &r4, .value = 12, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r6, .value = 12, .immediate = true},
+        {.op = IR_STORE32, .right = &r6, .value = 8, .immediate = true}
+    }, 4);
+    assert_true(func.stack_size == 16);
 }
 
-static void compare_reg(IrRegister * regA, IrRegister * regB)
+static void regalloc_fixup_load()
 {
-    if(regA == NULL)
-    {
-        assert_true(regB == NULL);
-    }
-    else {
-        assert_true(regB);
-        assert_true(regA->index == regB->index);
-    }
+    // Code input:
+    //  - NOP
+    //  - ADD (?), regA, regA
+    // regA is live on entry to the function (in its stack slot).
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_ADD, .value = 99, .left = &regA, .right = &regA}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 2);
+
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {
+            .count = 1,
+            .list = (IrRegister*[]){&regA}
+        },
+        .stack_size = 12
+    };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,-1});
+
+    // Transformed code (regA is loaded once, for both operands):
+    //  - LOAD32 reg5, [sp + 12]
+    //  - ADD (?), reg5, reg5
+    IrRegister r5 = {.index = 5};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r5, .value = 12, .immediate = true},
+        {.op = IR_ADD, .left = &r5, .right = &r5, .value = 99}
+    }, 2);
 }
 
-static void regalloc_fixup_store()
+static void regalloc_coalesce()
 {
-    IrRegister regA = {
-        .type = REG_ANY,
-        .index = 1,
-        .liveness = {
-            .start = 1,
-            .finish = 1
+    // Code input:
+    //  0 - NOP
+    //  1 - LOADI regA, 1
+    //  2 - MOV regB, regA
+    //  3 - STORE32 regB, regB
+    // regA dies at the MOV, where regB is born, so both should share a register,
+    // and the MOV should be removed.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOADI, .dest = &regA, .value = 1},
+        {.op = IR_MOV, .dest = &regB, .left = &regA},
+        {.op = IR_STORE32, .left = &regB, .right = &regB}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 4);
+
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
         }
     };
-    IrInstruction nop = {
-        .op = IR_NOP
-    };
-    IrInstruction loadi = {
-        .op = IR_LOADI,
-        .value = 99,
-        .dest = &regA
-    };
-    nop.next = &loadi;
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,8,9,-1});
+
+    assert_true(func.movs_removed == 1);
+
+    IrRegister r7 = {.index = 7};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOADI, .dest = &r7, .value = 1},
+        {.op = IR_STORE32, .left = &r7, .right = &r7}
+    }, 2);
+}
+
+static void regalloc_remat()
+{
+    // Code input:
+    //  0 - NOP
+    //  1 - LOADI regA, 99
+    //  2 - LOADSO regB, 8
+    //  3 - STORE32 regB, regA
+    // With no free registers (only spill registers), both are spilled. They are
+    // recomputed at the store, without allocating a stack slot.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOADI, .dest = &regA, .value = 99},
+        {.op = IR_LOADSO, .dest = &regB, .value = 8},
+        {.op = IR_STORE32, .left = &regB, .right = &regA}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 4);
 
-    IrBasicBlock bb = {
-        .head = &nop,
-        .tail = &loadi
-    };
     IrFunction func = {
         .head = &bb,
         .tail = &bb,
         .registers = {
-            .count = 1,
-            .list = (IrRegister*[]){&regA}
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
         },
         .stack_size = 12
     };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,-1});
 
-    regalloc(&func, (int[]){4,5,6,7,-1});
+    assert_true(func.stack_size == 12);
+    assert_true(func.rematerialised == 2);
 
     // Transformed code:
-    // - LOADI reg1, 99
-    // - LOADSO reg0, 12
-    // - STORE32 reg0, reg1
-    IrRegister reg0 = {
-        .type = REG_ANY,
-        .index = 4
-    };
-    IrRegister reg1 = {
-        .type = REG_ANY,
-        .index = 5
-    };
-    IrInstruction loadi_t = {
-        .op = IR_LOADI,
-        .dest = &reg1,
-        .value = 99
-    };
-    IrInstruction loadso_t = {
-        .op = IR_LOADSO,
-        .value = 12,
-        .dest = &reg0
-    };
-    IrInstruction store_t = {
-        .op = IR_STORE32,
-        .left = &reg0,
-        .right = &reg1
-    };
-    loadi_t.next = &loadso_t;
-    loadso_t.next = &store_t;
-
-    IrInstruction * cut = func.head->head->next;
-    IrInstruction * expected = &loadi_t;
-
-    while(cut != NULL && expected != NULL)
-    {
-        assert_true(cut->op == expected->op);
+    //  - LOADSO reg5, 8
+    //  - LOADI reg6, 99
+    //  - STORE32 reg5, reg6
+    IrRegister r5 = {.index = 5}, r6 = {.index = 6};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOADSO, .dest = &r5, .value = 8},
+        {.op = IR_LOADI, .dest = &r6, .value = 99},
+        {.op = IR_STORE32, .left = &r5, .right = &r6}
+    }, 3);
+}
 
-        if(expected->op == IR_LOADI)
-        {
-            assert_true(cut->value == expected->value);
-        }
+static void regalloc_split_reload()
+{
+    // Code input:
+    //  0 - NOP
+    //  1 - LOAD32 regA, [sp + 0]
+    //  2 - LOAD32 regB, [sp + 4]
+    //  3 - STORE32 [sp + 8], regB
+    //  4 - STORE32 [sp + 12], regB
+    //  5 - NOP
+    //  6 - STORE32 [sp + 16], regA
+    // With one free register, regA is spilled when regB is defined (it is next used
+    // after both uses of regB), and reloaded into the register once regB dies.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 12, .immediate = true},
+        {.op = IR_NOP},
+        {.op = IR_STORE32, .right = &regA, .value = 16, .immediate = true}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 7);
 
-        compare_reg(cut->dest, expected->dest);
-        compare_reg(cut->left, expected->left);
-        compare_reg(cut->right, expected->right);
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
+        },
+        .stack_size = 20
+    };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,-1});
 
-        cut = cut->next;
-        expected = expected->next;
-    }
+    IrRegister r7 = {.index = 7};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 20, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 12, .immediate = true},
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &r7, .value = 20, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 16, .immediate = true}
+    }, 8);
+    assert_true(func.stack_size == 24);
+}
+
+static void regalloc_spill_density()
+{
+    // Code input:
+    //  0 - NOP
+    //  1 - LOAD32 regA, [sp + 0]
+    //  2 - LOAD32 regB, [sp + 4]
+    //  3 - LOAD32 regC, [sp + 8]
+    //  4 - STORE32 [sp + 12], regC
+    //  5 - STORE32 [sp + 16], regA
+    //  6 - STORE32 [sp + 20], regB
+    //  7 - STORE32 [sp + 24], regB
+    //  8 - STORE32 [sp + 28], regB
+    //  9 - STORE32 [sp + 32], regB
+    // With two free registers, regC needs the register of regA or regB. regA is used
+    // sooner, but regB is used more densely - so regA is spilled, and regB keeps its
+    // register.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrRegister regC = {.type = REG_ANY, .index = 2, .liveness = {-1, 0}};
+    IrInstruction instrs[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regC, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &regC, .value = 12, .immediate = true},
+        {.op = IR_STORE32, .right = &regA, .value = 16, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 20, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 24, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 28, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 32, .immediate = true}
+    };
+    IrBasicBlock bb = {0};
+    link_block(&bb, instrs, 10);
 
-    assert_true(cut == NULL && expected == NULL);
+    IrFunction func = {
+        .head = &bb,
+        .tail = &bb,
+        .registers = {
+            .count = 3,
+            .list = (IrRegister*[]){&regA, &regB, &regC}
+        },
+        .stack_size = 36
+    };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,8,-1});
+
+    IrRegister r7 = {.index = 7}, r8 = {.index = 8};
+    compare_code(&bb, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r8, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 36, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 12, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 36, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 16, .immediate = true},
+        {.op = IR_STORE32, .right = &r8, .value = 20, .immediate = true},
+        {.op = IR_STORE32, .right = &r8, .value = 24, .immediate = true},
+        {.op = IR_STORE32, .right = &r8, .value = 28, .immediate = true},
+        {.op = IR_STORE32, .right = &r8, .value = 32, .immediate = true}
+    }, 11);
+    assert_true(func.stack_size == 40);
 }
 
-static void regalloc_fixup_load()
+static void regalloc_spill_loop_depth()
 {
     // Code input:
-    //  - NOP
-    //  - ADD (?), regA, regA
-    IrRegister regA = {
-        .type = REG_ANY,
-        .index = 1,
-        .liveness = {
-            .start = 0,
-            .finish = 1
-        }
-    };
-    IrInstruction nop = {
-        .op = IR_NOP
-    };
-    IrInstruction add = {
-        .op = IR_ADD,
-        .value = 99,
-        .dest = NULL,
-        .left = &regA,
-        .right = &regA,
-        .prev = &nop
+    //  BB 0:
+    //   NOP
+    //   LOAD32 regA, [sp + 0]
+    //   LOAD32 regB, [sp + 4]
+    //  BB 1 (loop depth 1):
+    //   NOP
+    //   STORE32 [sp + 8], regB
+    //   BRANCHZ regB, BB 2, BB 1
+    //  BB 2:
+    //   NOP
+    //   STORE32 [sp + 12], regA
+    //   RETURN
+    // With one free register, regB is kept in it through the loop, and regA
+    // (used after the loop) is spilled before it.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1, .loop_depth = 1}, bb2 = {.index = 2};
+    IrInstruction instrs0[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true}
+    };
+    IrInstruction instrs1[] = {
+        {.op = IR_NOP},
+        {.op = IR_STORE32, .right = &regB, .value = 8, .immediate = true},
+        {.op = IR_BRANCHZ, .left = &regB, .control = {.jump_true = &bb2, .jump_false = &bb1}}
+    };
+    IrInstruction instrs2[] = {
+        {.op = IR_NOP},
+        {.op = IR_STORE32, .right = &regA, .value = 12, .immediate = true},
+        {.op = IR_RETURN}
+    };
+    link_block(&bb0, instrs0, 3);
+    link_block(&bb1, instrs1, 3);
+    link_block(&bb2, instrs2, 3);
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb1;
+    bb2.cfg_entry[0] = &bb1;
+
+    IrFunction func = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
+        },
+        .stack_size = 16
     };
-    nop.next = &add;
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,-1});
 
-    IrBasicBlock bb = {
-        .head = &nop,
-        .tail = &add
+    // regA is stored before the loop (and regB, which is unchanged by the loop, on
+    // entry to it), and reloaded after it.
+    IrRegister r7 = {.index = 7};
+    compare_code(&bb0, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 16, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 20, .immediate = true}
+    }, 4);
+    compare_code(&bb1, (IrInstruction[]){
+        {.op = IR_STORE32, .right = &r7, .value = 8, .immediate = true},
+        {.op = IR_BRANCHZ, .left = &r7}
+    }, 2);
+    compare_code(&bb2, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 16, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 12, .immediate = true},
+        {.op = IR_RETURN}
+    }, 3);
+}
+
+static void regalloc_resolve_edge()
+{
+    // Code input:
+    //  BB 0:
+    //   NOP
+    //   LOAD32 regA, [sp + 0]
+    //   BRANCHZ regA, BB 1, BB 2
+    //  BB 1:
+    //   NOP
+    //   LOAD32 regB, [sp + 4]
+    //   STORE32 [sp + 8], regB
+    //   STORE32 [sp + 12], regB
+    //   JUMP BB 2
+    //  BB 2:
+    //   NOP
+    //   STORE32 [sp + 16], regA
+    //   RETURN
+    // With one free register, regA is spilled in BB 1 (for regB), so BB 2 starts
+    // with regA in memory. On the edge from BB 0 (where regA is held in a register,
+    // and has not been stored), regA is stored, in a new basic block: BB 0 has two
+    // successors, and BB 2 two predecessors.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    IrInstruction instrs0[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true},
+        {.op = IR_BRANCHZ, .left = &regA, .control = {.jump_true = &bb1, .jump_false = &bb2}}
+    };
+    IrInstruction instrs1[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &regB, .value = 12, .immediate = true},
+        {.op = IR_JUMP, .control = {.jump_true = &bb2}}
+    };
+    IrInstruction instrs2[] = {
+        {.op = IR_NOP},
+        {.op = IR_STORE32, .right = &regA, .value = 16, .immediate = true},
+        {.op = IR_RETURN}
+    };
+    link_block(&bb0, instrs0, 3);
+    link_block(&bb1, instrs1, 5);
+    link_block(&bb2, instrs2, 3);
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[1] = &bb1;
+
+    IrFunction func = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
+        },
+        .stack_size = 20
     };
-    IrFunction function = {
-        .head = &bb,
-        .tail = &bb,
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,-1});
+
+    IrRegister r7 = {.index = 7};
+    compare_code(&bb1, (IrInstruction[]){
+        {.op = IR_STORE32, .right = &r7, .value = 20, .immediate = true},
+        {.op = IR_LOAD32, .dest = &r7, .value = 4, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 8, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 12, .immediate = true},
+        {.op = IR_JUMP}
+    }, 5);
+    compare_code(&bb2, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 20, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 16, .immediate = true},
+        {.op = IR_RETURN}
+    }, 3);
+
+    // The new basic block is placed last (BB 0 does not fall through to BB 2).
+    IrBasicBlock * split = func.tail;
+    assert_true(bb2.next == split && split->next == NULL);
+    assert_true(bb0.tail->control.jump_true == &bb1);
+    assert_true(bb0.tail->control.jump_false == split);
+    assert_true(split->cfg_entry[0] == &bb0 && split->cfg_entry[1] == NULL);
+    assert_true(bb2.cfg_entry[0] == split && bb2.cfg_entry[1] == &bb1);
+    compare_code(split, (IrInstruction[]){
+        {.op = IR_STORE32, .right = &r7, .value = 20, .immediate = true},
+        {.op = IR_JUMP}
+    }, 2);
+    assert_true(split->tail->control.jump_true == &bb2);
+}
+
+static void regalloc_live_across_loop()
+{
+    // Code input:
+    //  BB 0:
+    //   NOP
+    //   LOAD32 regA, [sp + 0]
+    //  BB 1 (loop depth 1):
+    //   NOP
+    //   LOAD32 regB, [sp + 4]
+    //   MOV r0, regB
+    //   BRANCHZ regB, BB 2, BB 1
+    //  BB 2:
+    //   NOP
+    //   STORE32 [sp + 8], regA
+    //   RETURN
+    // With one free register, regA (used after the loop) is spilled for regB, so
+    // must be stored before the loop. The reserved register r0 written in the loop
+    // shares regA's index, but is not regA.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1, .loop_depth = 1}, bb2 = {.index = 2};
+    IrInstruction instrs0[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regA, .value = 0, .immediate = true}
+    };
+    IrInstruction instrs1[] = {
+        {.op = IR_NOP},
+        {.op = IR_LOAD32, .dest = &regB, .value = 4, .immediate = true},
+        {.op = IR_MOV, .dest = &r0, .left = &regB},
+        {.op = IR_BRANCHZ, .left = &regB, .control = {.jump_true = &bb2, .jump_false = &bb1}}
+    };
+    IrInstruction instrs2[] = {
+        {.op = IR_NOP},
+        {.op = IR_STORE32, .right = &regA, .value = 8, .immediate = true},
+        {.op = IR_RETURN}
+    };
+    link_block(&bb0, instrs0, 2);
+    link_block(&bb1, instrs1, 4);
+    link_block(&bb2, instrs2, 3);
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb1;
+    bb2.cfg_entry[0] = &bb1;
+
+    IrFunction func = {
+        .head = &bb0,
+        .tail = &bb2,
         .registers = {
-            .count = 1,
-            .list = (IrRegister*[]){&regA}
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
         },
         .stack_size = 12
     };
-    
-    regalloc(&function, (int[]){4,5,6,7,-1});
+    Liveness_analysis(&func);
+    assert_true(bb1.live.entry[0] & 1);
+    regalloc(&func, (int[]){4,5,6,7,-1});
 
-    // Transformed code:
-    //  - LOADSO reg0, 12
-    //  - LOAD32 reg2, reg0
-    //  - LOADSO reg0, 12
-    //  - LOAD32 reg3, reg0
-    //  - ADD (?), reg2, reg3
-    IrRegister reg0 = {
-        .type = REG_ANY,
-        .index = 4
-    };
-    IrRegister reg2 = {
-        .type = REG_ANY,
-        .index = 6
-    };
-    IrRegister reg3 = {
-        .type = REG_ANY,
-        .index = 7
-    };
-    IrInstruction loadso_t1 = {
-        .op = IR_LOADSO,
-        .value = 12,
-        .dest = &reg0
-    };
-    IrInstruction load32_t1 = {
-        .op = IR_LOAD32,
-        .dest = &reg2,
-        .left = &reg0
-    };
-    IrInstruction loadso_t2 = {
-        .op = IR_LOADSO,
-        .value = 12,
-        .dest = &reg0
-    };
-    IrInstruction load32_t2 = {
-        .op = IR_LOAD32,
-        .dest = &reg3,
-        .left = &reg0
-    };
-    IrInstruction add_t = {
-        .op = IR_ADD,
-        .dest = NULL,
-        .left = &reg2,
-        .right = &reg3
-    };
-    loadso_t1.next = &load32_t1;
-    load32_t1.next = &loadso_t2;
-    loadso_t2.next = &load32_t2;
-    load32_t2.next = &add_t;
-
-    IrInstruction * cut = function.head->head->next;
-    IrInstruction * expected = &loadso_t1;
-
-    while(cut != NULL && expected != NULL)
-    {
-        assert_true(cut->op == expected->op);
+    // regA is stored to its stack slot on entry to the loop, and reloaded after it.
+    IrRegister r7 = {.index = 7};
+    compare_code(&bb0, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 0, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 12, .immediate = true}
+    }, 2);
+    compare_code(&bb1, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 4, .immediate = true},
+        {.op = IR_MOV, .dest = &r0, .left = &r7},
+        {.op = IR_BRANCHZ, .left = &r7}
+    }, 3);
+    compare_code(&bb2, (IrInstruction[]){
+        {.op = IR_LOAD32, .dest = &r7, .value = 12, .immediate = true},
+        {.op = IR_STORE32, .right = &r7, .value = 8, .immediate = true},
+        {.op = IR_RETURN}
+    }, 3);
+    assert_true(func.stack_size == 16);
+}
 
-        if(expected->op == IR_LOADI)
-        {
-            assert_true(cut->value == expected->value);
-        }
+static void regalloc_loop_no_spill()
+{
+    // Code input:
+    //  BB 0:
+    //   NOP
+    //   MOV regA, r0
+    //  BB 1 (loop depth 1):
+    //   NOP
+    //   ADD regB, regA, regA
+    //   MOV r1, regB
+    //   BRANCHZ regB, BB 2, BB 1
+    //  BB 2:
+    //   NOP
+    //   MOV r0, regA
+    //   RETURN
+    // With two free registers, both values fit in registers through the loop, so
+    // regA (not changed within the loop) is not stored on entry to it.
+    IrRegister regA = {.type = REG_ANY, .index = 0, .liveness = {-1, 0}};
+    IrRegister regB = {.type = REG_ANY, .index = 1, .liveness = {-1, 0}};
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0}, r1 = {.type = REG_RESERVED, .index = 1};
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1, .loop_depth = 1}, bb2 = {.index = 2};
+    IrInstruction instrs0[] = {
+        {.op = IR_NOP},
+        {.op = IR_MOV, .dest = &regA, .left = &r0}
+    };
+    IrInstruction instrs1[] = {
+        {.op = IR_NOP},
+        {.op = IR_ADD, .dest = &regB, .left = &regA, .right = &regA},
+        {.op = IR_MOV, .dest = &r1, .left = &regB},
+        {.op = IR_BRANCHZ, .left = &regB, .control = {.jump_true = &bb2, .jump_false = &bb1}}
+    };
+    IrInstruction instrs2[] = {
+        {.op = IR_NOP},
+        {.op = IR_MOV, .dest = &r0, .left = &regA},
+        {.op = IR_RETURN}
+    };
+    link_block(&bb0, instrs0, 2);
+    link_block(&bb1, instrs1, 4);
+    link_block(&bb2, instrs2, 3);
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb1;
+    bb2.cfg_entry[0] = &bb1;
 
-        compare_reg(cut->dest, expected->dest);
-        compare_reg(cut->left, expected->left);
-        compare_reg(cut->right, expected->right);
+    IrFunction func = {
+        .head = &bb0,
+        .tail = &bb2,
+        .registers = {
+            .count = 2,
+            .list = (IrRegister*[]){&regA, &regB}
+        }
+    };
+    Liveness_analysis(&func);
+    regalloc(&func, (int[]){4,5,6,7,8,-1});
 
-        cut = cut->next;
-        expected = expected->next;
+    // No spill code, and no stack frame.
+    for(IrBasicBlock * bb = func.head;bb != NULL;bb = bb->next)
+    {
+        for(IrInstruction * instr = bb->head;instr != NULL;instr = instr->next)
+        {
+            assert_true(instr->op != IR_STORE32 && instr->op != IR_LOAD32);
+        }
     }
-
-    assert_true(cut == NULL && expected == NULL);
+    assert_true(func.tail == &bb2);
+    assert_true(func.stack_size == 0);
 }
 
-
 int main(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(regalloc_no_spill),
         cmocka_unit_test(regalloc_no_fixup),
         cmocka_unit_test(regalloc_fixup_store),
-        cmocka_unit_test(regalloc_fixup_load)
+        cmocka_unit_test(regalloc_fixup_load),
+        cmocka_unit_test(regalloc_coalesce),
+        cmocka_unit_test(regalloc_remat),
+        cmocka_unit_test(regalloc_split_reload),
+        cmocka_unit_test(regalloc_spill_density),
+        cmocka_unit_test(regalloc_spill_loop_depth),
+        cmocka_unit_test(regalloc_resolve_edge),
+        cmocka_unit_test(regalloc_live_across_loop),
+        cmocka_unit_test(regalloc_loop_no_spill)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
-}
\ No newline at end of file
+}
@@ -152,6 +152,20 @@ static void keyword(void **state)
     }
 }
 
+static void keyword_like_identifier(void **state)
+{
+    // Identifiers that share a length, or first/last character, with a keyword.
+    const char *source = "whilf iff in autos sizeOf uNsigned v d9 _int";
+    Scanner *scanner = Scanner_init(source, MOCK_ERROR_REPORTER);
+
+    for (int i = 0; i < 9; i++)
+    {
+        Token *token = Scanner_get_next(scanner);
+        assert_int_equal(token->type, IDENTIFIER);
+    }
+    assert_int_equal(Scanner_get_next(scanner)->type, END_OF_FILE);
+}
+
 static void invalid_character(void **state)
 {
     const char *source = " 432\n @ ";
@@ -178,6 +192,7 @@ int main(void)
                                        cmocka_unit_test(operators),
                                        cmocka_unit_test(comment),
                                        cmocka_unit_test(keyword),
+                                       cmocka_unit_test(keyword_like_identifier),
                                        cmocka_unit_test(invalid_character)};
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,395 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#include "ir.h"
+#include "ssa.h"
+#include "util.h"
+
+// Registers (and the register list) are heap-allocated, since SSA construction
+// and destruction add new registers.
+static void new_registers(IrFunction *function, int count)
+{
+    function->registers.list = xcalloc(count, sizeof(IrRegister *));
+    function->registers.list_size = count;
+    for (int i = 0; i < count; i++)
+        Ir_new_register(function);
+}
+
+static IrRegister *reg(IrFunction *function, int index)
+{
+    return function->registers.list[index];
+}
+
+static void link_instructions(IrBasicBlock *bb, IrInstruction **instrs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        instrs[i]->prev = i ? instrs[i - 1] : NULL;
+        instrs[i]->next = i + 1 < count ? instrs[i + 1] : NULL;
+    }
+    bb->head = instrs[0];
+    bb->tail = instrs[count - 1];
+}
+
+static void ssa_construct_loop(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 0
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - BRANCH_LT t0, #10, BB 2, BB 3
+    //  BB 2:
+    //   - NOP
+    //   - ADD t0, t0, #1
+    //   - JUMP BB 1
+    //  BB 3:
+    //   - NOP
+    //   - MOV r0, t0
+    //   - RETURN
+    // t0 is defined twice, so a phi is needed in BB 1 (the loop header).
+    IrFunction function = {0};
+    new_registers(&function, 1);
+    IrRegister *t0 = reg(&function, 0);
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction nop2 = {.op = IR_NOP}, nop3 = {.op = IR_NOP};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t0, .value = 0};
+    IrInstruction jump0 = {.op = IR_JUMP};
+    IrInstruction branch = {.op = IR_BRANCH_LT, .left = t0, .value = 10, .immediate = true};
+    IrInstruction add = {.op = IR_ADD, .dest = t0, .left = t0, .value = 1, .immediate = true};
+    IrInstruction jump2 = {.op = IR_JUMP};
+    IrInstruction mov = {.op = IR_MOV, .dest = &r0, .left = t0};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2}, bb3 = {.index = 3};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi, &jump0}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &branch}, 2);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &add, &jump2}, 3);
+    link_instructions(&bb3, (IrInstruction *[]){&nop3, &mov, &ret}, 3);
+    jump0.control.jump_true = &bb1;
+    branch.control.jump_true = &bb2;
+    branch.control.jump_false = &bb3;
+    jump2.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb2.next = &bb3;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb2;
+    bb2.cfg_entry[0] = &bb1;
+    bb3.cfg_entry[0] = &bb1;
+    function.head = &bb0;
+    function.tail = &bb3;
+
+    assert_false(Ssa_verify(&function));
+    Ssa_construct(&function);
+    assert_true(Ssa_verify(&function));
+
+    assert_true(bb0.idom == NULL && bb1.idom == &bb0);
+    assert_true(bb2.idom == &bb1 && bb3.idom == &bb1);
+
+    // t0' = phi(t0 [BB 0], t0'' [BB 2])
+    IrInstruction *phi = bb1.head->next;
+    IrInstruction *inc = bb2.head->next;
+    assert_int_equal(phi->op, IR_PHI);
+    assert_true(phi->control.jump_true == &bb0 && phi->left == t0);
+    assert_true(phi->control.jump_false == &bb2 && phi->right == inc->dest);
+    assert_true(phi->dest != t0 && inc->dest != t0 && inc->dest != phi->dest);
+
+    assert_true(bb1.tail->left == phi->dest);
+    assert_true(inc->left == phi->dest);
+    assert_true(bb3.head->next->left == phi->dest);
+    assert_int_equal(function.registers.count, 3);
+}
+
+static void ssa_construct_dead_phi(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 1
+    //   - BRANCHZ t0, BB 1, BB 2
+    //  BB 1:
+    //   - NOP
+    //   - LOADI t0, 2
+    //   - JUMP BB 2
+    //  BB 2:
+    //   - NOP
+    //   - RETURN
+    // t0 is not used after the join point (BB 2), so no phi is needed.
+    IrFunction function = {0};
+    new_registers(&function, 1);
+    IrRegister *t0 = reg(&function, 0);
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t0};
+    IrInstruction loadi1 = {.op = IR_LOADI, .dest = t0, .value = 2};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &branch}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &loadi1, &jump}, 3);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &ret}, 2);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+    jump.control.jump_true = &bb2;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[1] = &bb1;
+    function.head = &bb0;
+    function.tail = &bb2;
+
+    Ssa_construct(&function);
+    assert_true(Ssa_verify(&function));
+
+    assert_true(bb2.idom == &bb0);
+    assert_int_equal(bb2.head->next->op, IR_RETURN);
+    assert_true(bb1.head->next->dest != t0);
+}
+
+static void ssa_verify_invalid(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - BRANCHZ t0, BB 1, BB 2
+    //  BB 1:
+    //   - NOP
+    //   - LOADI t1, 1
+    //   - JUMP BB 2
+    //  BB 2:
+    //   - NOP
+    //   - MOV t2, t1
+    //   - RETURN
+    // t0 is never defined, and the definition of t1 does not dominate its use.
+    IrFunction function = {0};
+    new_registers(&function, 4);
+    IrRegister *t0 = reg(&function, 0), *t1 = reg(&function, 1), *t2 = reg(&function, 2);
+    IrRegister *t3 = reg(&function, 3);
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t0};
+    IrInstruction loadi = {.op = IR_LOADI, .dest = t1, .value = 1};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction mov = {.op = IR_MOV, .dest = t2, .left = t1};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &branch}, 2);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &loadi, &jump}, 3);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &mov, &ret}, 3);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+    jump.control.jump_true = &bb2;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[1] = &bb1;
+    function.head = &bb0;
+    function.tail = &bb2;
+
+    assert_false(Ssa_verify(&function));
+
+    // Define t0 - the use of t1 in BB 2 is still invalid.
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t0, .value = 0};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &branch}, 3);
+    assert_false(Ssa_verify(&function));
+
+    // Read t1 through a phi (0 if entered from BB 0).
+    IrInstruction phi = {.op = IR_PHI, .dest = t2, .left = t0, .right = t1};
+    phi.control.jump_true = &bb0;
+    phi.control.jump_false = &bb1;
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &phi, &ret}, 3);
+    assert_true(Ssa_verify(&function));
+
+    // Phis must come first.
+    mov.dest = t3;
+    mov.left = t0;
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &mov, &phi, &ret}, 4);
+    assert_false(Ssa_verify(&function));
+}
+
+static void ssa_destruct_swap(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 1
+    //   - LOADI t1, 2
+    //   - JUMP BB 1
+    //  BB 1:
+    //   - NOP
+    //   - PHI t2, t0 [BB 0], t3 [BB 2]
+    //   - PHI t3, t1 [BB 0], t2 [BB 2]
+    //   - BRANCH_LT t2, #10, BB 2, BB 3
+    //  BB 2:
+    //   - NOP
+    //   - JUMP BB 1
+    //  BB 3:
+    //   - NOP
+    //   - RETURN
+    // The phis swap t2 and t3 on each iteration, so BB 2 must save one of them
+    // first.
+    IrFunction function = {0};
+    new_registers(&function, 4);
+    IrRegister *t0 = reg(&function, 0), *t1 = reg(&function, 1);
+    IrRegister *t2 = reg(&function, 2), *t3 = reg(&function, 3);
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP};
+    IrInstruction nop2 = {.op = IR_NOP}, nop3 = {.op = IR_NOP};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction loadi1 = {.op = IR_LOADI, .dest = t1, .value = 2};
+    IrInstruction jump0 = {.op = IR_JUMP};
+    IrInstruction phi0 = {.op = IR_PHI, .dest = t2, .left = t0, .right = t3};
+    IrInstruction phi1 = {.op = IR_PHI, .dest = t3, .left = t1, .right = t2};
+    IrInstruction branch = {.op = IR_BRANCH_LT, .left = t2, .value = 10, .immediate = true};
+    IrInstruction jump2 = {.op = IR_JUMP};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2}, bb3 = {.index = 3};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &loadi1, &jump0}, 4);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &phi0, &phi1, &branch}, 4);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &jump2}, 2);
+    link_instructions(&bb3, (IrInstruction *[]){&nop3, &ret}, 2);
+    jump0.control.jump_true = &bb1;
+    phi0.control.jump_true = phi1.control.jump_true = &bb0;
+    phi0.control.jump_false = phi1.control.jump_false = &bb2;
+    branch.control.jump_true = &bb2;
+    branch.control.jump_false = &bb3;
+    jump2.control.jump_true = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb2.next = &bb3;
+    bb1.cfg_entry[0] = &bb0;
+    bb1.cfg_entry[1] = &bb2;
+    bb2.cfg_entry[0] = &bb1;
+    bb3.cfg_entry[0] = &bb1;
+    function.head = &bb0;
+    function.tail = &bb3;
+
+    assert_true(Ssa_verify(&function));
+    Ssa_destruct(&function);
+
+    // No phis remain, and no blocks are added.
+    assert_int_equal(bb1.head->next->op, IR_BRANCH_LT);
+    assert_true(bb0.next == &bb1 && bb1.next == &bb2 && bb2.next == &bb3);
+
+    // BB 0: MOV t2, t0 and MOV t3, t1 (in either order).
+    IrInstruction *mov0 = bb0.tail->prev->prev, *mov1 = bb0.tail->prev;
+    assert_true(mov0->op == IR_MOV && mov1->op == IR_MOV);
+    assert_true((mov0->dest == t2 && mov0->left == t0 && mov1->dest == t3 && mov1->left == t1) ||
+                (mov0->dest == t3 && mov0->left == t1 && mov1->dest == t2 && mov1->left == t0));
+
+    // BB 2: MOV t4, t2; MOV t2, t3; MOV t3, t4
+    IrInstruction *save = bb2.head->next;
+    assert_true(save->op == IR_MOV && save->left == t2);
+    assert_true(save->next->op == IR_MOV && save->next->dest == t2 && save->next->left == t3);
+    assert_true(save->next->next->op == IR_MOV && save->next->next->dest == t3 &&
+                save->next->next->left == save->dest);
+    assert_int_equal(save->next->next->next->op, IR_JUMP);
+    assert_int_equal(function.registers.count, 5);
+}
+
+static void ssa_destruct_critical_edge(void **state)
+{
+    // Code input:
+    //  BB 0:
+    //   - NOP
+    //   - LOADI t0, 1
+    //   - BRANCHZ t0, BB 1, BB 2
+    //  BB 1:
+    //   - NOP
+    //   - LOADI t1, 2
+    //   - JUMP BB 2
+    //  BB 2:
+    //   - NOP
+    //   - PHI t2, t0 [BB 0], t1 [BB 1]
+    //   - MOV r0, t2
+    //   - RETURN
+    // The edge from BB 0 to BB 2 is critical, so the copy into t2 is placed in a
+    // new basic block.
+    IrFunction function = {0};
+    new_registers(&function, 3);
+    IrRegister *t0 = reg(&function, 0), *t1 = reg(&function, 1), *t2 = reg(&function, 2);
+    IrRegister r0 = {.type = REG_RESERVED, .index = 0};
+
+    // clang-format off
+    IrInstruction nop0 = {.op = IR_NOP}, nop1 = {.op = IR_NOP}, nop2 = {.op = IR_NOP};
+    IrInstruction loadi0 = {.op = IR_LOADI, .dest = t0, .value = 1};
+    IrInstruction branch = {.op = IR_BRANCHZ, .left = t0};
+    IrInstruction loadi1 = {.op = IR_LOADI, .dest = t1, .value = 2};
+    IrInstruction jump = {.op = IR_JUMP};
+    IrInstruction phi = {.op = IR_PHI, .dest = t2, .left = t0, .right = t1};
+    IrInstruction mov = {.op = IR_MOV, .dest = &r0, .left = t2};
+    IrInstruction ret = {.op = IR_RETURN};
+    // clang-format on
+
+    IrBasicBlock bb0 = {.index = 0}, bb1 = {.index = 1}, bb2 = {.index = 2};
+    link_instructions(&bb0, (IrInstruction *[]){&nop0, &loadi0, &branch}, 3);
+    link_instructions(&bb1, (IrInstruction *[]){&nop1, &loadi1, &jump}, 3);
+    link_instructions(&bb2, (IrInstruction *[]){&nop2, &phi, &mov, &ret}, 4);
+    branch.control.jump_true = &bb1;
+    branch.control.jump_false = &bb2;
+    jump.control.jump_true = &bb2;
+    phi.control.jump_true = &bb0;
+    phi.control.jump_false = &bb1;
+    bb0.next = &bb1;
+    bb1.next = &bb2;
+    bb1.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[0] = &bb0;
+    bb2.cfg_entry[1] = &bb1;
+    function.head = &bb0;
+    function.tail = &bb2;
+
+    assert_true(Ssa_verify(&function));
+    Ssa_destruct(&function);
+
+    // BB 0 -> BB 3 -> BB 2
+    IrBasicBlock *split = bb0.next;
+    assert_true(split != &bb1 && split->next == &bb1);
+    assert_int_equal(split->index, 3);
+    assert_true(bb0.tail->control.jump_false == split);
+    assert_true(split->cfg_entry[0] == &bb0);
+    assert_true(bb2.cfg_entry[0] == split && bb2.cfg_entry[1] == &bb1);
+
+    assert_true(split->head->next->op == IR_MOV && split->head->next->dest == t2 &&
+                split->head->next->left == t0);
+    assert_true(split->tail->op == IR_JUMP && split->tail->control.jump_true == &bb2);
+    assert_true(bb1.tail->prev->op == IR_MOV && bb1.tail->prev->dest == t2 &&
+                bb1.tail->prev->left == t1);
+    assert_true(bb2.head->next->op == IR_MOV && bb2.head->next->left == t2);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(ssa_construct_loop),
+        cmocka_unit_test(ssa_construct_dead_phi),
+        cmocka_unit_test(ssa_verify_invalid),
+        cmocka_unit_test(ssa_destruct_swap),
+        cmocka_unit_test(ssa_destruct_critical_edge),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
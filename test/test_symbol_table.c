@@ -4,6 +4,7 @@
 
 #include <cmocka.h>
 
+#include "intern.h"
 #include "symbol.h"
 
 static void create_table(void **state)
@@ -14,42 +15,59 @@ static void create_table(void **state)
 static void get_symbol_missing(void **state)
 {
     SymbolTable *tab = symbol_table_create(NULL);
-    assert_true(symbol_table_get(tab, "abcdef", false) == NULL);
+    assert_true(symbol_table_get(tab, Intern_cstr("abcdef"), false) == NULL);
 }
 
 static void put_symbol(void **state)
 {
     SymbolTable *tab = symbol_table_create(NULL);
 
-    symbol_table_put(tab, "testing", (CType *)0x1234);
-    symbol_table_put(tab, "testing2", (CType *)0x2345);
+    symbol_table_put(tab, Intern_cstr("testing"), (CType *)0x1234);
+    symbol_table_put(tab, Intern_cstr("testing2"), (CType *)0x2345);
 
-    Symbol *sym = symbol_table_get(tab, "testing", false);
+    Symbol *sym = symbol_table_get(tab, Intern_cstr("testing"), false);
     assert_true(sym->type == (CType *)0x1234);
-    sym = symbol_table_get(tab, "testing2", false);
+    sym = symbol_table_get(tab, Intern_cstr("testing2"), false);
     assert_true(sym->type == (CType *)0x2345);
 }
 
 static void get_symbol_nested(void **state)
 {
     SymbolTable *tab = symbol_table_create(NULL);
-    symbol_table_put(tab, "s1", (CType *)0x4567);
-    symbol_table_put(tab, "s2", (CType *)0x9876);
+    symbol_table_put(tab, Intern_cstr("s1"), (CType *)0x4567);
+    symbol_table_put(tab, Intern_cstr("s2"), (CType *)0x9876);
 
     SymbolTable *nested = symbol_table_create(tab);
-    symbol_table_put(nested, "s1", (CType *)0xabcd);
+    symbol_table_put(nested, Intern_cstr("s1"), (CType *)0xabcd);
 
     // Should find 's1' in the nested scope, which
     // shadows 's1' in the outer scope.
-    Symbol *s1 = symbol_table_get(nested, "s1", true);
+    Symbol *s1 = symbol_table_get(nested, Intern_cstr("s1"), true);
     assert_true(s1->type == (CType *)0xabcd);
 
     // Should find 's2' in the outer scope.
-    Symbol *s2 = symbol_table_get(nested, "s2", true);
+    Symbol *s2 = symbol_table_get(nested, Intern_cstr("s2"), true);
     assert_true(s2->type == (CType *)0x9876);
 
     // Should not find 's2' in the nested scope.
-    assert_true(symbol_table_get(nested, "s2", false) == NULL);
+    assert_true(symbol_table_get(nested, Intern_cstr("s2"), false) == NULL);
+}
+
+static void get_symbol_interned(void **state)
+{
+    SymbolTable *tab = symbol_table_create(NULL);
+    symbol_table_put(tab, Intern_cstr("abc"), (CType *)0x1234);
+
+    // The same identifier from a different buffer (E.g. a later token slice)
+    // interns to the same name, and so finds the same symbol.
+    char source[] = "x = abcd + abc;";
+    const char *name = Intern_string(source + 11, 3);
+    assert_true(name == Intern_cstr("abc"));
+    assert_true(symbol_table_get(tab, name, false)->type == (CType *)0x1234);
+
+    // A prefix of a different identifier is not the same name.
+    assert_true(symbol_table_get(tab, Intern_string(source + 4, 4), false) == NULL);
+    assert_string_equal(Intern_string(source + 4, 4), "abcd");
 }
 
 int main(void)
@@ -59,6 +77,7 @@ int main(void)
         cmocka_unit_test(get_symbol_missing),
         cmocka_unit_test(put_symbol),
         cmocka_unit_test(get_symbol_nested),
+        cmocka_unit_test(get_symbol_interned),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);